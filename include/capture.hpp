@@ -0,0 +1,126 @@
+#ifndef CHIP8_CAPTURE_HPP
+#define CHIP8_CAPTURE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "constants.hpp"
+#include "screen.hpp"
+#include "tone_generator.hpp"
+
+namespace CaptureSpecs
+{
+    constexpr int SampleRate {44100};
+    // 44100 / 60, exact
+    constexpr int SamplesPerFrame {735};
+    // 512x256, small frames are badly handled by players
+    constexpr int DefaultScale {8};
+    constexpr int MaxScale {32};
+    // Chunks waiting for the encoder, the emulation
+    // waits for it beyond that
+    constexpr size_t QueueDepth {256};
+}
+
+/*
+    Records the output of a machine, one call per 60 Hz frame,
+    without any window:
+      - video as a Y4M stream (path ending with .y4m), or as a
+        PNG sequence in a directory (any other path). A PNG is
+        only written when the picture changes, named after the
+        first frame it is shown at
+      - audio as a 16 bits mono WAV of the sound timer tone
+        (or of the XO-CHIP pattern)
+
+    The picture is 64x32 pixels of scale size. For the extended
+    models, high resolution pixels are half that size and the
+    planes are shades of gray
+
+    Consecutive identical frames are merged before they reach
+    the queue, idle frames cost one comparison. Encoding and
+    writing happen on a background thread
+*/
+
+class FrameCapture
+{
+private:
+    // Run of identical frames
+    struct Chunk
+    {
+        Screen screen {};
+        bool sound_active {false};
+        AudioPattern pattern {};
+        uint32_t frame_count {};
+    };
+
+    enum class VideoFormat
+    {
+        None,
+        Y4m,
+        Png,
+    };
+
+    // === Producer side ===
+    Chunk pending {};
+    bool has_pending {false};
+    uint64_t pushed_frames {};
+
+    // === Shared ===
+    std::mutex mutex {};
+    std::condition_variable changed {};
+    std::deque<Chunk> queue {};
+    bool closing {false};
+    std::thread encoder {};
+
+    // === Encoder side ===
+    VideoFormat format {VideoFormat::None};
+    int scale {};
+    // Extended models: high resolution and bit planes
+    bool extended {false};
+    std::ofstream video_file {};
+    std::filesystem::path png_directory {};
+    // Last encoded picture, repeated for identical frames
+    std::vector<uint8_t> encoded {};
+    uint64_t encoded_frames {};
+
+    std::ofstream audio_file {};
+    uint64_t audio_samples {};
+    ToneGenerator tone {CaptureSpecs::SampleRate};
+    AudioPattern tone_pattern {};
+    std::vector<int16_t> samples {};
+
+    void enqueue(const Chunk& chunk);
+    void Encode();
+    void encodeVideo(const Chunk& chunk);
+    void encodeAudio(const Chunk& chunk);
+    void encodeY4mFrame(const Screen& screen);
+    void encodePng(const Screen& screen);
+    void writeWavHeader();
+public:
+    // Empty paths disable the video or the audio. The scale is
+    // rounded up to an even size for an extended screen.
+    // Throws if the outputs cannot be created
+    FrameCapture(const std::string& video_path, const std::string& audio_path,
+                 int scale = CaptureSpecs::DefaultScale, bool extended_screen = false);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Called after each frame, with the sound timer state of the frame
+    void Push(const Screen& screen, bool sound_active, const AudioPattern& pattern = {});
+    // Encodes what is left and finalizes the files. Throws
+    // if something could not be written
+    void Close();
+
+    uint64_t getFrameCount();
+};
+
+#endif
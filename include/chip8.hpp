@@ -2,45 +2,111 @@
 #define CHIP8_HPP
 
 #include <cstdint>
+#include <string>
+#include <vector>
 
 #include "constants.hpp"
 #include "cpu.hpp"
+#include "machine_model.hpp"
 #include "random.hpp"
+#include "screen.hpp"
+#include "tone_generator.hpp"
 
 class Chip8
 {
 private:
-    // RAM
-    uint8_t memory[Chip8Specs::MemorySize] {};
+    MachineModel model {MachineModel::Chip8};
+    // RAM, memory_size bytes, resized with the model
+    std::vector<uint8_t> memory {};
+    int memory_size {Chip8Specs::ClassicMemorySize};
     // Special register used to store memory addresses
     uint16_t index_register {};
     uint8_t delay_timer {};
     uint8_t sound_timer {};
     uint8_t keypad[Chip8Specs::KeysCount] {};
-    // 1D array representing a 2D screen
-    uint32_t video[Chip8Specs::ScreenWidth * Chip8Specs::ScreenHeight] {};
+    // Bit-packed screen, see screen.hpp
+    Screen screen {};
+    // Planes drawn and scrolled by the display instructions (Fn01)
+    uint8_t plane_mask {1};
+    // SUPER-CHIP user flags (Fx75 / Fx85)
+    uint8_t rpl_flags[Chip8Specs::RplFlagsCount] {};
+    // XO-CHIP sound, played instead of the tone once loaded (F002)
+    AudioPattern audio_pattern {};
+    // Bumped every time the screen content may have changed,
+    // lets frontends skip presenting identical frames
+    uint32_t video_version {};
+    // One bit per screen row touched since the last clear
+    uint64_t dirty_rows {};
+    // Reads and writes past the end of the memory, which are
+    // ignored. Diagnostic only, not part of the save states
+    uint64_t out_of_bounds_accesses {};
     RandomGenerator random_device {};
     Cpu cpu {};
 public:
     Chip8();
 
+    // Set the model first, it bounds the ROM size. Both
+    // throw if the ROM does not fit in the memory
     void loadRomIntoMemory(const std::string& filename);
+    void loadRom(const uint8_t* data, size_t size);
 
-    uint32_t* getVideo();
+    // Snapshot of the whole machine as a versioned binary blob
+    // (see save_state.hpp). The buffer is reused between calls
+    void saveState(std::vector<uint8_t>& state);
+    // Throws if the blob is not a valid save state, the
+    // machine is then left untouched
+    void loadState(const std::vector<uint8_t>& state);
+
+    // Selects the instruction set, memory and display modes. The
+    // machine is expected to be reset: the screen is cleared and
+    // the quirk profile set to the model default
+    void setModel(MachineModel value);
+    MachineModel getModel();
+
+    // Plane 0 of the screen, one word per row of a 64x32 screen.
+    // Only meaningful as such while the screen is in low resolution
+    uint64_t* getVideo();
+    Screen& getScreen();
+    bool isHires();
+    // 00FE / 00FF, the screen is cleared
+    void setHires(bool value);
+    uint8_t getPlaneMask();
+    void setPlaneMask(uint8_t value);
+    uint8_t* getRplFlags();
+    const AudioPattern& getAudioPattern();
+    uint32_t getVideoVersion();
+    uint64_t getDirtyRows();
     uint8_t* getKeypad();
     uint16_t getIndexRegister();
+    uint64_t getOutOfBoundsAccesses();
+    // Out of bounds, reads return 0 and writes are dropped
     uint8_t getMemoryAt(uint16_t index);
     uint8_t getDelayTimer();
     uint8_t getSoundTimer();
     uint8_t getRandomByte();
+    Cpu* getCpu();
 
     void setIndexRegister(uint16_t value);
     void writeMemory(uint16_t index, uint8_t value);
     void setDelayTimer(uint8_t value);
     void setSoundTimer(uint8_t value);
+    // F002, 16 bytes read from memory at the index register
+    void loadAudioPattern();
+    void setPitch(uint8_t value);
     void setKeypad(int index, uint8_t value);
+    // Makes Cxkk reproducible, the same seed gives the same sequence
+    void setSeed(uint64_t seed);
+    // Called by the drawing instructions on the rows they modify
+    void markVideoDirty(int first_row, int row_count);
+    void clearDirtyRows();
 
+    // Executes a single instruction
     void Cycle();
+    // Executes up to max_instructions instructions, stops
+    // early if the program halts. Returns the executed count
+    uint32_t Run(uint32_t max_instructions);
+    // Decrements the delay and sound timers, called at 60 Hz
+    void TickTimers();
 
 };
 
@@ -2,29 +2,43 @@
 #define CHIP8_CONSTANTS_HPP
 
 #include <cstdint>
-#include <SDL.h>
-#include <unordered_map>
 
 namespace Chip8Specs
 {
     // === Hardware specifications ===
-    constexpr int MemorySize    {4096};
+    // Largest address space (XO-CHIP), CHIP-8 and
+    // SUPER-CHIP only address the first 4 KB
+    constexpr int MemorySize        {0x10000};
+    constexpr int ClassicMemorySize {0x1000};
     constexpr int RegisterCount {16};
     constexpr int StackDepth    {16};
     constexpr int ScreenWidth   {64};
     constexpr int ScreenHeight   {32};
+    // SUPER-CHIP / XO-CHIP high resolution mode
+    constexpr int HiresScreenWidth  {128};
+    constexpr int HiresScreenHeight {64};
+    // XO-CHIP bit planes
+    constexpr int PlaneCount    {2};
     constexpr int KeysCount     {16};
+    // SUPER-CHIP user flags (8 on the HP48, 16 on XO-CHIP)
+    constexpr int RplFlagsCount {16};
+    // XO-CHIP sound: 128 one-bit samples, played at
+    // 4000 * 2^((pitch - 64) / 48) samples per second
+    constexpr int AudioPatternSize {16};
+    constexpr uint8_t DefaultPitch {64};
 
     // === Memory Mapping === 
     constexpr uint16_t FontSetStartAddress {0x050};
+    constexpr uint16_t BigFontSetStartAddress {0x0A0};
     constexpr uint16_t ProgramStartAddress {0x200};
 
     // === Pixels ===
-    constexpr uint32_t PixelOn  {0xFFFFFFFF};
-    constexpr uint32_t PixelOff {0x00000000};
     // RGBA format
     constexpr uint32_t ColorOn  {0x2A0032FF};
     constexpr uint32_t ColorOff {0xA9A3FFFF};
+    // Second XO-CHIP plane alone, and both planes
+    constexpr uint32_t ColorPlane2 {0x6A52B5FF};
+    constexpr uint32_t ColorPlanes {0x1A0020FF};
 
     // === Sprite ===
     constexpr int SpriteWidth {8};
@@ -52,12 +66,27 @@ namespace Chip8Specs
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
 
-    // Keys code
-    const std::unordered_map<SDL_Keycode, uint8_t> KeyMap {
-        {SDLK_x, 0x0}, {SDLK_1, 0x1}, {SDLK_2, 0x2}, {SDLK_3, 0x3},
-        {SDLK_q, 0x4}, {SDLK_w, 0x5}, {SDLK_e, 0x6}, {SDLK_a, 0x7},
-        {SDLK_s, 0x8}, {SDLK_d, 0x9}, {SDLK_z, 0xA}, {SDLK_c, 0xB},
-        {SDLK_4, 0xC}, {SDLK_r, 0xD}, {SDLK_f, 0xE}, {SDLK_v, 0xF},
+    // SUPER-CHIP 8x10 digits (Fx30), A to F were added by XO-CHIP
+    constexpr unsigned int BigFontsetSize  {160};
+    constexpr unsigned int BigFontCharSize {10};
+    constexpr uint8_t BigFontSet[BigFontsetSize]
+    {
+        0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+        0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+        0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+        0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+        0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+        0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+        0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+        0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+        0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
     };
 }
 
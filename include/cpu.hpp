@@ -2,9 +2,32 @@
 #define CHIP8_CPU_HPP
 
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 #include "constants.hpp"
+#include "machine_model.hpp"
+#include "quirks.hpp"
 
 class Chip8;
+class Profiler;
+class Recompiler;
+class StateReader;
+class StateWriter;
+
+// Execution engines, selectable at runtime
+enum class CpuEngine
+{
+    // Fetch, decode and execute one instruction at a time
+    Interpreter,
+    // Straight-line blocks executed with direct-threaded
+    // dispatch (needs GCC/Clang labels-as-values)
+    Threaded,
+    // Hot blocks compiled to x86-64 machine code
+    Recompiler,
+};
+
+CpuEngine engineFromName(const std::string& name);
 
 class Cpu {
 private:
@@ -18,73 +41,260 @@ private:
     // recent value placed in the stack
     uint8_t sp {};
     // Operation code, represents an instruction that has
-    // to be executed by the cpu
+    // to be executed by the cpu. Only meaningful while decoding,
+    // compiled code does not keep it up to date, so it is not
+    // part of the save state
     uint16_t opcode {};
+    // Set when the program jumps to its own address,
+    // the usual way for a ROM to signal it is done
+    bool halted {false};
+    // Fx0A key wait: set once a key went down,
+    // the instruction completes when it is released
+    bool key_wait_pressed {false};
+    uint8_t key_wait_key {};
     // Reference to the Chip8 system
     // used to simplify memory access
     Chip8* system {nullptr};
     // alias for pointer to a Cpu member function
     // of type void with no argument
     using CpuInstruction = void (Cpu::*)();
-    // function pointer table. Will contain
-    // references to instructions
+    // function pointer tables. Will contain
+    // references to instructions, the first one is indexed
+    // by the high nibble, the others resolve the opcode
+    // groups sharing a high nibble
     CpuInstruction table[0xF + 1] {};
+    CpuInstruction table0[0xFF + 1] {};
+    CpuInstruction table5[0xF + 1] {};
+    CpuInstruction table8[0xF + 1] {};
+    CpuInstruction tableE[0xFF + 1] {};
+    CpuInstruction tableF[0xFF + 1] {};
+    // Profile the quirk-dependent table entries were instantiated for
+    QuirkProfile quirks {QuirkProfile::Vip};
+    // Model the extended instructions were bound for
+    MachineModel model {MachineModel::Chip8};
+    // Addressable memory of the model, the size of the
+    // per-address tables below
+    int memory_size {Chip8Specs::ClassicMemorySize};
+
+    template <QuirkProfile Profile>
+    void dispatchQuirkInstructions();
+    template <MachineModel Model>
+    void dispatchModelInstructions();
+
+    // Moves pc past the next instruction, F000 nnnn
+    // counts as one on XO-CHIP
+    template <MachineModel Model>
+    void skipNextInstruction();
+
+    // The state the shared instruction semantics run on,
+    // see cpu_access.hpp and instructions.hpp
+    template <MachineModel Model = MachineModel::Chip8>
+    class Access;
+
+    // An instruction decoded once: direct handler
+    // and operands already extracted from the opcode
+    struct DecodedInstruction
+    {
+        CpuInstruction handler {nullptr};
+        uint16_t opcode {};
+        uint16_t address {};
+        uint8_t x {};
+        uint8_t y {};
+        uint8_t byte {};
+        uint8_t nibble {};
+    };
+    // Decoded instructions indexed by address. An entry
+    // without handler has to be decoded (again)
+    // (one entry per byte of memory, resized with the model)
+    std::vector<DecodedInstruction> decoded_cache {};
+    // Used for instructions fetched outside of memory
+    DecodedInstruction decoded_scratch {};
+    // Instruction being executed
+    const DecodedInstruction* current {&decoded_scratch};
+
+    void decode(uint16_t address, DecodedInstruction& instruction);
+
+    // === Idle detection ===
+    // Delay timer polling loop around pc:
+    //     start:     Fx07       vx = DT
+    //     start + 2: 3xkk/4xkk  leaves when vx reaches kk
+    //     start + 4: 1nnn       back to start
+    struct TimerLoop
+    {
+        uint16_t start {};
+        uint8_t x {};
+        // Instruction pc is on, 0 to 2
+        int position {};
+        // The 3xkk/4xkk instruction
+        uint16_t test {};
+    };
+
+    // 0 outside of memory
+    uint16_t wordAt(uint32_t address);
+    bool findTimerLoop(TimerLoop& loop);
+    bool isKeyWaitIdle();
+    bool isTimerLoopIdle(const TimerLoop& loop);
+
+    // === Threaded engine ===
+    CpuEngine engine {CpuEngine::Interpreter};
+
+    struct ThreadedOp
+    {
+        DecodedInstruction decoded {};
+        // Label of the code implementing the operation
+        const void* target {nullptr};
+        // Address of the instruction
+        uint16_t address {};
+        uint8_t kind {};
+    };
+    // Straight-line run of instructions, ending with the first
+    // instruction that can change the flow or write memory
+    struct ThreadedBlock
+    {
+        uint16_t end {};
+        std::vector<ThreadedOp> ops {};
+    };
+    // Blocks indexed by start address
+    std::vector<std::unique_ptr<ThreadedBlock>> blocks {};
+    // Marks the addresses covered by a block. Writing to one
+    // of them flushes all the blocks before the next lookup
+    std::vector<uint8_t> block_coverage {};
+    bool blocks_flush_pending {false};
+
+    void buildBlock(uint16_t start, ThreadedBlock& block);
+    void flushBlocks();
+    uint32_t RunThreaded(uint32_t max_instructions);
+    static bool isThreadedSupported();
+
+    // === Recompiler engine ===
+    std::unique_ptr<Recompiler> recompiler {};
+    friend class Recompiler;
+
+    // Only used by profiler builds, see profiler.hpp
+    Profiler* profiler {nullptr};
 public: 
     Cpu();
+    ~Cpu();
 
     void setSystem(Chip8* sys);
     void setPC(uint16_t value);
+    // Returns false if the engine is not available on this build
+    bool setEngine(CpuEngine value);
+    CpuEngine getEngine();
+    // Rebinds the quirk-dependent handlers, the decoded
+    // instructions and the compiled blocks are dropped
+    void setQuirks(QuirkProfile value);
+    QuirkProfile getQuirks();
+    // Rebinds the extended instructions, see Chip8::setModel
+    void setModel(MachineModel value);
+    MachineModel getModel();
+    // Instructions then run one at a time through the interpreter,
+    // whatever the engine. Returns false if the build has no profiler
+    // hooks. nullptr detaches it
+    bool setProfiler(Profiler* value);
+
+    uint8_t getRegister(uint8_t index);
+    uint16_t getPC();
+    uint8_t getSP();
+    bool isHalted();
+    // True while the program sits on Fx0A, nothing is
+    // drawn until a key goes down then up
+    bool isWaitingForKey();
+    // True when the program cannot make progress before the next
+    // timer tick or key change: Fx0A with no new key, or a
+    // delay timer polling loop
+    bool isIdle();
+    // Fast-forwards an idle program over max_instructions, leaving
+    // the exact state running them would. Returns the instructions
+    // skipped, 0 when the program is not idle
+    uint32_t SkipIdle(uint32_t max_instructions);
 
     uint8_t extractVx(uint16_t mask);
     uint8_t extractVy(uint16_t mask);
 
-    // Instructions
+    // Registers, stack, pc and Fx0A wait state, see Chip8::saveState
+    void saveState(StateWriter& writer);
+    void loadState(StateReader& reader);
+
+    // Drops the decoded instructions overlapping a written address
+    void invalidateDecoded(uint16_t address);
+    void invalidateDecodedCache();
+
+    // Instructions. The templates are instantiated
+    // once per quirk profile (see quirks.hpp)
     void opc_8xy0();
-    void opc_8xy1();
-    void opc_8xy2();
-    void opc_8xy3();
+    template <QuirkProfile Profile> void opc_8xy1();
+    template <QuirkProfile Profile> void opc_8xy2();
+    template <QuirkProfile Profile> void opc_8xy3();
     void opc_8xy4();
     void opc_8xy5();
-    void opc_8xy6();
+    template <QuirkProfile Profile> void opc_8xy6();
     void opc_8xy7();
-    void opc_8xyE();
+    template <QuirkProfile Profile> void opc_8xyE();
 
     void opc_00E0();
     void opc_00EE();
 
     void opc_1nnn();
     void opc_2nnn();
-    void opc_3xkk();
-    void opc_4xkk();
-    void opc_5xy0();
-    void opc_9xy0();
-    void opc_Bnnn();
+    // Skips are instantiated once per machine model
+    template <MachineModel Model> void opc_3xkk();
+    template <MachineModel Model> void opc_4xkk();
+    template <MachineModel Model> void opc_5xy0();
+    template <MachineModel Model> void opc_9xy0();
+    template <QuirkProfile Profile> void opc_Bnnn();
 
     void opc_6xkk();
     void opc_7xkk();
     void opc_Annn();
     void opc_Fx1E();
-    void opc_Fx55();
-    void opc_Fx65();
+    template <QuirkProfile Profile> void opc_Fx55();
+    template <QuirkProfile Profile> void opc_Fx65();
     void opc_Fx33();
     void opc_Cxkk();
 
     void opc_Fx07();
     void opc_Fx15();
     void opc_Fx18();
-    void opc_Ex9E();
-    void opc_ExA1();
+    template <MachineModel Model> void opc_Ex9E();
+    template <MachineModel Model> void opc_ExA1();
     void opc_Fx0A();
-    void opc_Dxyn();
+    template <QuirkProfile Profile> void opc_Dxyn();
     void opc_Fx29();
 
+    // SUPER-CHIP instructions
+    void opc_00Cn();
+    void opc_00FB();
+    void opc_00FC();
+    void opc_00FD();
+    void opc_00FE();
+    void opc_00FF();
+    // Dxyn on the extended models: both resolutions,
+    // 16x16 sprites (Dxy0) and bit planes
+    template <QuirkProfile Profile> void opc_DxynExtended();
+    void opc_Fx30();
+    void opc_Fx75();
+    void opc_Fx85();
+
+    // XO-CHIP instructions
+    void opc_00Dn();
+    void opc_5xy2();
+    void opc_5xy3();
+    void opc_F000();
+    void opc_Fn01();
+    void opc_F002();
+    void opc_Fx3A();
+
+    // Unknown opcodes are ignored
+    void opc_unknown();
+
     void dispatchInstructions();
-    void handle0Instructions();
-    void handle8Instructions();
-    void handleEInstructions();
-    void handleFInstructions();
+    CpuInstruction resolveHandler(uint16_t opcode);
 
     void Cycle();
+    // Executes up to max_instructions instructions with the selected
+    // engine, stops early if the program halts. Returns the executed count
+    uint32_t Run(uint32_t max_instructions);
     
 };
 
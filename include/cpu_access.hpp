@@ -0,0 +1,48 @@
+#ifndef CHIP8_CPU_ACCESS_HPP
+#define CHIP8_CPU_ACCESS_HPP
+
+#include "chip8.hpp"
+#include "cpu.hpp"
+
+// === Header only class ===
+/*
+    State of a Cpu and of its system, as the shared instruction
+    semantics see it (see instructions.hpp). Only the engines
+    include it, skips move pc as the machine model does
+*/
+
+template <MachineModel Model>
+class Cpu::Access
+{
+private:
+    Cpu& cpu;
+public:
+    explicit Access(Cpu& cpu) : cpu {cpu} {}
+
+    uint8_t& v(uint8_t index) { return cpu.registers[index]; }
+    uint16_t& pc() { return cpu.pc; }
+    uint16_t* stack() { return cpu.stack; }
+    uint8_t& sp() { return cpu.sp; }
+
+    uint16_t index() { return cpu.system->getIndexRegister(); }
+    void setIndex(uint16_t value) { cpu.system->setIndexRegister(value); }
+    uint8_t read(uint16_t address) { return cpu.system->getMemoryAt(address); }
+    void write(uint16_t address, uint8_t value) { cpu.system->writeMemory(address, value); }
+
+    uint8_t delayTimer() { return cpu.system->getDelayTimer(); }
+    void setDelayTimer(uint8_t value) { cpu.system->setDelayTimer(value); }
+    void setSoundTimer(uint8_t value) { cpu.system->setSoundTimer(value); }
+
+    const uint8_t* keypad() { return cpu.system->getKeypad(); }
+    bool& keyWaitPressed() { return cpu.key_wait_pressed; }
+    uint8_t& keyWaitKey() { return cpu.key_wait_key; }
+    uint8_t randomByte() { return cpu.system->getRandomByte(); }
+
+    uint64_t* video() { return cpu.system->getVideo(); }
+    void markVideoDirty(int first_row, int row_count) { cpu.system->markVideoDirty(first_row, row_count); }
+
+    void skipNext() { cpu.skipNextInstruction<Model>(); }
+    void halt() { cpu.halted = true; }
+};
+
+#endif
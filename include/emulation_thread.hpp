@@ -0,0 +1,137 @@
+#ifndef CHIP8_EMULATION_THREAD_HPP
+#define CHIP8_EMULATION_THREAD_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "constants.hpp"
+#include "frame_pacer.hpp"
+#include "rewind_buffer.hpp"
+#include "scheduler.hpp"
+#include "screen.hpp"
+#include "spsc_queue.hpp"
+#include "tone_generator.hpp"
+#include "triple_buffer.hpp"
+
+class Chip8;
+class ReplayRecorder;
+
+namespace EmulationSpecs
+{
+    // Commands sent by the frontend between two frames
+    constexpr size_t CommandQueueSize {256};
+}
+
+// What the frontend needs to present one frame
+struct VideoFrame
+{
+    Screen screen {};
+    uint64_t frame_count {};
+    // Frames per second achieved by the emulation thread
+    double achieved_rate {};
+    // Commands applied so far, the frame reflects all of them
+    uint64_t applied_commands {};
+    // Blocked in Fx0A, the picture cannot change until a key does
+    bool waiting_for_key {false};
+};
+
+// Sent by the frontend, applied at the start of the next frame
+struct MachineCommand
+{
+    enum class Kind : uint8_t
+    {
+        Key,
+        QuickSave,
+        QuickLoad,
+        // value: 1 while the rewind key is held down
+        Rewind,
+    };
+
+    Kind kind {Kind::Key};
+    uint8_t key {};
+    uint8_t value {};
+};
+
+/*
+    Runs the machine on its own thread, paced at 60 Hz, so
+    that presenting (vsync, compositor stalls) never delays
+    it. Inputs come in through a lock-free queue, finished
+    frames go out through a triple buffer. The machine must
+    not be touched by other threads between Start and Stop
+*/
+
+class EmulationThread
+{
+private:
+    Chip8& system;
+    Scheduler scheduler;
+    FramePacer pacer {SchedulerSpecs::FrameRate};
+    RewindBuffer rewind;
+    size_t rewind_budget {};
+    ReplayRecorder* recorder {nullptr};
+
+    SpscQueue<MachineCommand, EmulationSpecs::CommandQueueSize> commands {};
+    TripleBuffer<VideoFrame> frames {};
+    // XO-CHIP pattern, taken by the audio thread
+    TripleBuffer<AudioPattern> patterns {};
+    AudioPattern published_pattern {};
+
+    // Quick save slot, mirrored to a file when a path is set
+    std::vector<uint8_t> quick_save {};
+    std::string state_path {};
+    bool rewind_held {false};
+    uint64_t applied_commands {};
+
+    // Sound timer running during the last frame, polled by the audio thread
+    std::atomic<bool> sound_active {false};
+
+    std::atomic<bool> running {false};
+    std::thread thread {};
+
+    // Returns true when the machine was replaced by a save state
+    bool apply(const MachineCommand& command);
+    void quickSave();
+    bool quickLoad();
+    void publish();
+    void Loop();
+public:
+    // recorder may be null
+    EmulationThread(Chip8& system, int instructions_per_second,
+                    size_t rewind_budget, ReplayRecorder* recorder);
+    ~EmulationThread();
+
+    EmulationThread(const EmulationThread&) = delete;
+    EmulationThread& operator=(const EmulationThread&) = delete;
+
+    // Set before Start
+    void SetStatePath(const std::string& path);
+
+    void Start();
+    // Waits for the frame in progress to end
+    void Stop();
+
+    // Frames run so far, read after Stop
+    uint64_t getFrameCount();
+
+    // === Frontend thread ===
+    // Returns false if the queue is full, the command is dropped
+    bool Submit(const MachineCommand& command);
+    // Takes the latest finished frame, returns false if
+    // none was finished since the last call
+    bool PollFrame();
+    const VideoFrame& getFrame();
+
+    // === Audio thread ===
+    // Takes the latest pattern, returns false if it did not change
+    bool PollAudioPattern();
+    const AudioPattern& getAudioPattern();
+
+    // === Any thread ===
+    bool isSoundActive();
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef CHIP8_FRAME_PACER_HPP
+#define CHIP8_FRAME_PACER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+/*
+    Paces a loop at a fixed rate by sleeping until each
+    frame deadline instead of spinning on the clock
+*/
+
+class FramePacer
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    int target_rate {};
+    Clock::duration period {};
+    // Frames that may be run back to back to catch up
+    // before the pacer gives up and drops them
+    int max_catch_up_frames {};
+
+    // Deadlines are computed from a base time and a frame
+    // count so that rounding errors do not accumulate
+    Clock::time_point base_time {};
+    uint64_t frame_index {};
+
+    // The OS usually wakes up a bit late, so the pacer sleeps
+    // until slightly before the deadline and spins the rest.
+    // The margin adapts to the oversleep observed
+    Clock::duration spin_margin {};
+
+    // Achieved rate, measured over one second windows
+    Clock::time_point window_start {};
+    uint32_t window_frames {};
+    double achieved_rate {};
+    uint64_t dropped_frames {};
+
+    Clock::time_point deadlineOf(uint64_t frame);
+public:
+    FramePacer(int target_rate, int max_catch_up_frames = 5);
+
+    Clock::time_point getNextDeadline();
+    int getTargetRate();
+    double getAchievedRate();
+    uint64_t getDroppedFrames();
+
+    // Blocks until the next frame deadline. Returns true once
+    // per second, when a new achieved rate is available
+    bool WaitForNextFrame();
+};
+
+#endif
@@ -0,0 +1,420 @@
+#ifndef CHIP8_INSTRUCTIONS_HPP
+#define CHIP8_INSTRUCTIONS_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+#include "constants.hpp"
+#include "masks.hpp"
+#include "quirks.hpp"
+
+// === Header only functions ===
+/*
+    Semantics of the CHIP-8 instructions, written once for every
+    machine stepping instructions one at a time: the Cpu handlers,
+    the inline ops of the threaded engine and the lanes of
+    VectorMachine. Each function takes the decoded operands and an
+    accessor to the state of one machine, providing:
+
+        uint8_t& v(uint8_t index)           registers
+        uint16_t& pc()                      address of the next instruction
+        uint16_t* stack(), uint8_t& sp()
+        uint16_t index(), setIndex(uint16_t)
+        uint8_t read(uint16_t), write(uint16_t, uint8_t)
+        uint8_t delayTimer(), setDelayTimer(uint8_t), setSoundTimer(uint8_t)
+        const uint8_t* keypad()
+        keyWaitPressed(), keyWaitKey()      Fx0A state, as references
+        uint8_t randomByte()
+        uint64_t* video()                   the 64x32 screen, one word per row
+        markVideoDirty(int first_row, int row_count)
+        skipNext()                          moves pc past the next instruction
+        halt()
+
+    The accessors are inlined, a handler compiles to the same
+    code as one written against the fields directly
+*/
+
+namespace Instructions
+{
+    // std::rotr is C++20
+    inline uint64_t rotateRight(uint64_t value, unsigned int shift)
+    {
+        shift &= 63u;
+        return shift ? (value >> shift) | (value << (64u - shift)) : value;
+    }
+
+    // Index register left by Fx55 / Fx65
+    template <QuirkProfile Profile>
+    uint16_t indexAfterTransfer(uint16_t index, uint8_t x)
+    {
+        constexpr IndexQuirk Quirk { QuirkTraits<Profile>::Flags.index };
+
+        if constexpr (Quirk == IndexQuirk::Increment) return index + x + 1;
+        else if constexpr (Quirk == IndexQuirk::IncrementByX) return index + x;
+        else return index;
+    }
+
+    // === Arithmetic and logic ===
+
+    // LD vx, vy
+    template <class Machine>
+    void opc_8xy0(Machine& machine, uint8_t x, uint8_t y)
+    {
+        machine.v(x) = machine.v(y);
+    }
+
+    // OR vx, vy
+    template <QuirkProfile Profile, class Machine>
+    void opc_8xy1(Machine& machine, uint8_t x, uint8_t y)
+    {
+        machine.v(x) |= machine.v(y);
+        if constexpr (QuirkTraits<Profile>::Flags.resets_flag) machine.v(0xF) = 0;
+    }
+
+    // AND vx, vy
+    template <QuirkProfile Profile, class Machine>
+    void opc_8xy2(Machine& machine, uint8_t x, uint8_t y)
+    {
+        machine.v(x) &= machine.v(y);
+        if constexpr (QuirkTraits<Profile>::Flags.resets_flag) machine.v(0xF) = 0;
+    }
+
+    // XOR vx, vy
+    template <QuirkProfile Profile, class Machine>
+    void opc_8xy3(Machine& machine, uint8_t x, uint8_t y)
+    {
+        machine.v(x) ^= machine.v(y);
+        if constexpr (QuirkTraits<Profile>::Flags.resets_flag) machine.v(0xF) = 0;
+    }
+
+    // ADD vx, vy
+    template <class Machine>
+    void opc_8xy4(Machine& machine, uint8_t x, uint8_t y)
+    {
+        uint16_t sum { static_cast<uint16_t>(machine.v(x) + machine.v(y)) };
+
+        machine.v(x) = sum & MASK_LOWER_8BITS;
+
+        // Register vf will carry a flag if the sum overflows 255
+        machine.v(0xF) = (sum > MASK_LOWER_8BITS) ? 1 : 0;
+    }
+
+    // SUB vx, vy
+    template <class Machine>
+    void opc_8xy5(Machine& machine, uint8_t x, uint8_t y)
+    {
+        uint8_t vx { machine.v(x) };
+        uint8_t vy { machine.v(y) };
+
+        machine.v(x) = vx - vy;
+
+        // Register vf is set to 1 if vx >= vy, written last
+        // so that it wins when x is F
+        machine.v(0xF) = (vx >= vy) ? 1 : 0;
+    }
+
+    // SHR vx {, vy}
+    template <QuirkProfile Profile, class Machine>
+    void opc_8xy6(Machine& machine, uint8_t x, uint8_t y)
+    {
+        uint8_t source { machine.v(QuirkTraits<Profile>::Flags.shifts_vx ? x : y) };
+
+        machine.v(x) = source >> 1u;
+
+        // Save the shifted out bit, last so that it wins over vx = vf
+        machine.v(0xF) = source & MASK_LSB;
+    }
+
+    // SUBN vx, vy
+    template <class Machine>
+    void opc_8xy7(Machine& machine, uint8_t x, uint8_t y)
+    {
+        machine.v(x) = machine.v(y) - machine.v(x);
+
+        // Compares against the new vx, as the original handler did
+        machine.v(0xF) = (machine.v(y) >= machine.v(x)) ? 1 : 0;
+    }
+
+    // SHL vx {, vy}
+    template <QuirkProfile Profile, class Machine>
+    void opc_8xyE(Machine& machine, uint8_t x, uint8_t y)
+    {
+        uint8_t source { machine.v(QuirkTraits<Profile>::Flags.shifts_vx ? x : y) };
+
+        machine.v(x) = source << 1u;
+
+        machine.v(0xF) = (source & MASK_MSB) >> 7u;
+    }
+
+    // LD vx, byte
+    template <class Machine>
+    void opc_6xkk(Machine& machine, uint8_t x, uint8_t byte)
+    {
+        machine.v(x) = byte;
+    }
+
+    // ADD vx, byte
+    template <class Machine>
+    void opc_7xkk(Machine& machine, uint8_t x, uint8_t byte)
+    {
+        machine.v(x) += byte;
+    }
+
+    // RND vx, byte
+    template <class Machine>
+    void opc_Cxkk(Machine& machine, uint8_t x, uint8_t byte)
+    {
+        machine.v(x) = machine.randomByte() & byte;
+    }
+
+    // === Flow control ===
+    /*
+        The stack is a ring of StackDepth entries: a call past
+        the last one overwrites the first, a return from an
+        empty stack pops the last one. sp stays below StackDepth
+    */
+
+    // RET
+    template <class Machine>
+    void opc_00EE(Machine& machine)
+    {
+        machine.sp() = (machine.sp() + Chip8Specs::StackDepth - 1) % Chip8Specs::StackDepth;
+        machine.pc() = machine.stack()[machine.sp()];
+    }
+
+    // JP addr
+    template <class Machine>
+    void opc_1nnn(Machine& machine, uint16_t address)
+    {
+        // Jumping onto itself is an infinite loop
+        if (address == machine.pc() - 2) machine.halt();
+
+        machine.pc() = address;
+    }
+
+    // CALL addr
+    template <class Machine>
+    void opc_2nnn(Machine& machine, uint16_t address)
+    {
+        machine.stack()[machine.sp()] = machine.pc();
+        machine.sp() = (machine.sp() + 1) % Chip8Specs::StackDepth;
+        machine.pc() = address;
+    }
+
+    // SE vx, byte
+    template <class Machine>
+    void opc_3xkk(Machine& machine, uint8_t x, uint8_t byte)
+    {
+        if (machine.v(x) == byte) machine.skipNext();
+    }
+
+    // SNE vx, byte
+    template <class Machine>
+    void opc_4xkk(Machine& machine, uint8_t x, uint8_t byte)
+    {
+        if (machine.v(x) != byte) machine.skipNext();
+    }
+
+    // SE vx, vy
+    template <class Machine>
+    void opc_5xy0(Machine& machine, uint8_t x, uint8_t y)
+    {
+        if (machine.v(x) == machine.v(y)) machine.skipNext();
+    }
+
+    // SNE vx, vy
+    template <class Machine>
+    void opc_9xy0(Machine& machine, uint8_t x, uint8_t y)
+    {
+        if (machine.v(x) != machine.v(y)) machine.skipNext();
+    }
+
+    // JP addr, v0 (or JP xnn, vx)
+    template <QuirkProfile Profile, class Machine>
+    void opc_Bnnn(Machine& machine, uint8_t x, uint16_t address)
+    {
+        machine.pc() = machine.v(QuirkTraits<Profile>::Flags.jumps_vx ? x : 0) + address;
+    }
+
+    // === Memory ===
+
+    // LD I, addr
+    template <class Machine>
+    void opc_Annn(Machine& machine, uint16_t address)
+    {
+        machine.setIndex(address);
+    }
+
+    // ADD I, vx
+    template <class Machine>
+    void opc_Fx1E(Machine& machine, uint8_t x)
+    {
+        machine.setIndex(machine.index() + machine.v(x));
+    }
+
+    // LD F, vx
+    // Font characters are 5 bytes long
+    template <class Machine>
+    void opc_Fx29(Machine& machine, uint8_t x)
+    {
+        machine.setIndex(Chip8Specs::FontSetStartAddress + (Chip8Specs::FontCharSize * machine.v(x)));
+    }
+
+    // LD B, vx
+    template <class Machine>
+    void opc_Fx33(Machine& machine, uint8_t x)
+    {
+        uint8_t val { machine.v(x) };
+        uint16_t index { machine.index() };
+
+        // ones, tens then hundreds digit
+        machine.write(index + 2, val % 10);
+        val /= 10;
+        machine.write(index + 1, val % 10);
+        val /= 10;
+        machine.write(index, val % 10);
+    }
+
+    // LD [I], vx
+    template <QuirkProfile Profile, class Machine>
+    void opc_Fx55(Machine& machine, uint8_t x)
+    {
+        for (uint8_t i {} ; i <= x ; ++i)
+            machine.write(machine.index() + i, machine.v(i));
+
+        machine.setIndex(indexAfterTransfer<Profile>(machine.index(), x));
+    }
+
+    // LD vx, [I]
+    template <QuirkProfile Profile, class Machine>
+    void opc_Fx65(Machine& machine, uint8_t x)
+    {
+        for (uint8_t i {} ; i <= x ; ++i)
+            machine.v(i) = machine.read(machine.index() + i);
+
+        machine.setIndex(indexAfterTransfer<Profile>(machine.index(), x));
+    }
+
+    // === Timers and keypad ===
+
+    // LD vx, DT
+    template <class Machine>
+    void opc_Fx07(Machine& machine, uint8_t x)
+    {
+        machine.v(x) = machine.delayTimer();
+    }
+
+    // LD DT, vx
+    template <class Machine>
+    void opc_Fx15(Machine& machine, uint8_t x)
+    {
+        machine.setDelayTimer(machine.v(x));
+    }
+
+    // LD ST, vx
+    template <class Machine>
+    void opc_Fx18(Machine& machine, uint8_t x)
+    {
+        machine.setSoundTimer(machine.v(x));
+    }
+
+    // SKP vx
+    template <class Machine>
+    void opc_Ex9E(Machine& machine, uint8_t x)
+    {
+        uint8_t key { machine.v(x) };
+
+        if (key < Chip8Specs::KeysCount && machine.keypad()[key]) machine.skipNext();
+    }
+
+    // SKNP vx
+    template <class Machine>
+    void opc_ExA1(Machine& machine, uint8_t x)
+    {
+        uint8_t key { machine.v(x) };
+
+        if (key < Chip8Specs::KeysCount && !machine.keypad()[key]) machine.skipNext();
+    }
+
+    // LD vx, K
+    // Waits for a key press, then for its release
+    template <class Machine>
+    void opc_Fx0A(Machine& machine, uint8_t x)
+    {
+        const uint8_t* keypad { machine.keypad() };
+        auto& pressed { machine.keyWaitPressed() };
+        auto& key { machine.keyWaitKey() };
+
+        if (!pressed)
+        {
+            // We look for an eventual pressed key
+            for (uint8_t i {} ; i < Chip8Specs::KeysCount ; ++i)
+            {
+                if (keypad[i])
+                {
+                    key = i;
+                    pressed = true;
+                    break;
+                }
+            }
+
+            // Loop again, either no key is pressed yet
+            // or it still has to be released
+            machine.pc() -= 2;
+        }
+        else if (!keypad[key])
+        {
+            machine.v(x) = key;
+            pressed = false;
+        }
+        else machine.pc() -= 2;
+    }
+
+    // === Display ===
+
+    // DRW vx, vy, nibble
+    // Display a sprite of height n at (vx, vy) on the 64x32
+    // screen, starting at memory location I
+    template <QuirkProfile Profile, class Machine>
+    void opc_Dxyn(Machine& machine, uint8_t x, uint8_t y, uint8_t nibble)
+    {
+        static_assert(Chip8Specs::ScreenWidth == 64, "A screen row must fit in one 64-bit word");
+
+        constexpr bool Clips { QuirkTraits<Profile>::Flags.clips_sprites };
+
+        // The start coordinate always wraps
+        uint8_t x_cord = machine.v(x) % Chip8Specs::ScreenWidth;
+        uint8_t y_cord = machine.v(y) % Chip8Specs::ScreenHeight;
+        uint8_t sprite_height { nibble };
+
+        // Clipped sprites stop at the bottom edge
+        if constexpr (Clips)
+            sprite_height = std::min<uint8_t>(sprite_height, Chip8Specs::ScreenHeight - y_cord);
+
+        machine.v(0xF) = 0;
+
+        if (sprite_height > 0) machine.markVideoDirty(y_cord, sprite_height);
+
+        uint64_t* video { machine.video() };
+        uint16_t index { machine.index() };
+
+        for (unsigned int row {} ; row < sprite_height ; ++row)
+        {
+            uint8_t sprite_byte { machine.read(index + row) };
+
+            // Move the sprite byte to the leftmost pixels, then move it to
+            // x_cord: pixels past the right edge are dropped or wrap around
+            uint64_t sprite_row { Clips ? (uint64_t {sprite_byte} << 56u) >> x_cord
+                                        : rotateRight(uint64_t {sprite_byte} << 56u, x_cord) };
+            uint64_t& screen_row { video[(y_cord + row) % Chip8Specs::ScreenHeight] };
+
+            // sprite pixel and screen pixel are both on
+            // -> there's a collision
+            if (screen_row & sprite_row) machine.v(0xF) = 1;
+
+            screen_row ^= sprite_row;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef CHIP8_KEYMAP_HPP
+#define CHIP8_KEYMAP_HPP
+
+#include <array>
+#include <cstdint>
+#include <SDL.h>
+#include <string>
+
+namespace KeyboardSpecs
+{
+    // Scancode or button bound to no CHIP-8 key
+    constexpr uint8_t Unbound {0xFF};
+
+    // Longest sleep in the event queue while the machine waits
+    // for a key, the frontend still wakes up now and then
+    constexpr int IdleWaitMs {250};
+
+    struct KeyBinding
+    {
+        SDL_Scancode scancode;
+        uint8_t key;
+    };
+
+    struct ButtonBinding
+    {
+        SDL_GameControllerButton button;
+        uint8_t key;
+    };
+
+    // Keys by position, the 4x4 block from 1 to V on a QWERTY
+    // layout, whatever the layout of the host keyboard
+    constexpr KeyBinding DefaultKeys[] {
+        {SDL_SCANCODE_X, 0x0}, {SDL_SCANCODE_1, 0x1}, {SDL_SCANCODE_2, 0x2}, {SDL_SCANCODE_3, 0x3},
+        {SDL_SCANCODE_Q, 0x4}, {SDL_SCANCODE_W, 0x5}, {SDL_SCANCODE_E, 0x6}, {SDL_SCANCODE_A, 0x7},
+        {SDL_SCANCODE_S, 0x8}, {SDL_SCANCODE_D, 0x9}, {SDL_SCANCODE_Z, 0xA}, {SDL_SCANCODE_C, 0xB},
+        {SDL_SCANCODE_4, 0xC}, {SDL_SCANCODE_R, 0xD}, {SDL_SCANCODE_F, 0xE}, {SDL_SCANCODE_V, 0xF},
+    };
+
+    // The directions most ROMs use (2, 4, 6, 8), and 5 to act
+    constexpr ButtonBinding DefaultButtons[] {
+        {SDL_CONTROLLER_BUTTON_DPAD_UP, 0x2}, {SDL_CONTROLLER_BUTTON_DPAD_LEFT, 0x4},
+        {SDL_CONTROLLER_BUTTON_DPAD_RIGHT, 0x6}, {SDL_CONTROLLER_BUTTON_DPAD_DOWN, 0x8},
+        {SDL_CONTROLLER_BUTTON_A, 0x5}, {SDL_CONTROLLER_BUTTON_B, 0x0},
+        {SDL_CONTROLLER_BUTTON_X, 0xA}, {SDL_CONTROLLER_BUTTON_Y, 0xB},
+        {SDL_CONTROLLER_BUTTON_START, 0xF},
+    };
+}
+
+/*
+    Key and controller button bindings, flat tables indexed by
+    scancode and button, built once. A layout file replaces
+    the defaults, one binding per line ('#' starts a comment):
+        5 W
+        2 pad dpup
+    the CHIP-8 key in hexadecimal, then an SDL key name, or
+    "pad" and an SDL controller button name
+*/
+
+class KeyLayout
+{
+private:
+    std::array<uint8_t, SDL_NUM_SCANCODES> keys {};
+    std::array<uint8_t, SDL_CONTROLLER_BUTTON_MAX> buttons {};
+
+public:
+    KeyLayout();
+
+    // Throws if the file cannot be read or a line is invalid
+    void LoadFromFile(const std::string& path);
+
+    // KeyboardSpecs::Unbound if the key or button is not bound
+    uint8_t keyOfScancode(SDL_Scancode scancode) const
+    {
+        return (scancode >= 0 && scancode < SDL_NUM_SCANCODES) ? keys[scancode] : KeyboardSpecs::Unbound;
+    }
+
+    uint8_t keyOfButton(int button) const
+    {
+        return (button >= 0 && button < SDL_CONTROLLER_BUTTON_MAX) ? buttons[button] : KeyboardSpecs::Unbound;
+    }
+};
+
+#endif
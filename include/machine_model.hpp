@@ -0,0 +1,53 @@
+#ifndef CHIP8_MACHINE_MODEL_HPP
+#define CHIP8_MACHINE_MODEL_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "constants.hpp"
+#include "quirks.hpp"
+
+/*
+    Machine models: the instruction set and the hardware the
+    ROM expects. Unlike the quirk profiles, a model adds
+    instructions, memory and display modes:
+      - Chip8: the base instruction set, 4 KB, 64x32
+      - Schip: SUPER-CHIP 1.1 scrolls, 128x64 mode, 16x16
+        sprites, big font and RPL flags
+      - XoChip: SUPER-CHIP plus 64 KB of memory, two bit
+        planes, F000 nnnn and the audio pattern buffer
+*/
+
+enum class MachineModel : uint8_t
+{
+    Chip8,
+    Schip,
+    XoChip,
+};
+
+MachineModel machineModelFromName(const std::string& name);
+const char* machineModelName(MachineModel model);
+
+constexpr int memorySizeOf(MachineModel model)
+{
+    return model == MachineModel::XoChip ? Chip8Specs::MemorySize : Chip8Specs::ClassicMemorySize;
+}
+
+// Bit planes the display instructions can draw to
+constexpr int planeCountOf(MachineModel model)
+{
+    return model == MachineModel::XoChip ? Chip8Specs::PlaneCount : 1;
+}
+
+// Profile a model runs with unless told otherwise
+constexpr QuirkProfile defaultQuirksOf(MachineModel model)
+{
+    switch (model)
+    {
+    case MachineModel::Schip:  return QuirkProfile::Schip;
+    case MachineModel::XoChip: return QuirkProfile::XoChip;
+    default:                   return QuirkProfile::Vip;
+    }
+}
+
+#endif
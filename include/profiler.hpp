@@ -0,0 +1,110 @@
+#ifndef CHIP8_PROFILER_HPP
+#define CHIP8_PROFILER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "constants.hpp"
+
+namespace ProfilerSpecs
+{
+    // The Cpu hooks only exist in builds configured with
+    // -DCHIP8PP_PROFILER=ON, other builds pay nothing
+#ifdef CHIP8PP_PROFILER
+    constexpr bool Enabled {true};
+#else
+    constexpr bool Enabled {false};
+#endif
+    // Calls deeper than the machine stack are not tracked
+    constexpr int MaxCallDepth {Chip8Specs::StackDepth};
+    constexpr size_t DefaultHotAddresses {20};
+}
+
+// Instruction families, named after the Cpu handlers (8xy4, Fx33...)
+constexpr int OpcodeFamilyCount {51};
+int opcodeFamilyOf(uint16_t opcode);
+const char* opcodeFamilyName(int family);
+
+/*
+    Counts the executed instructions and the host time they
+    took, per opcode family and per address. A shadow call
+    stack follows 2nnn / 00EE so the time can be reported
+    per call path, as folded stacks for flame graphs
+*/
+
+class Profiler
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Counter
+    {
+        uint64_t instructions {};
+        uint64_t host_ns {};
+    };
+
+    // One node per distinct call path, the root is the ROM entry
+    struct CallNode
+    {
+        uint32_t parent {};
+        uint16_t address {};
+        Counter self {};
+    };
+
+    Counter families[OpcodeFamilyCount] {};
+    Counter addresses[Chip8Specs::MemorySize] {};
+    // Last opcode executed at each address
+    uint16_t opcodes[Chip8Specs::MemorySize] {};
+
+    std::vector<CallNode> nodes {};
+    // (parent node << 16 | call target) -> node
+    std::unordered_map<uint64_t, uint32_t> children {};
+    uint32_t current_node {};
+    int depth {};
+    // Calls made past MaxCallDepth, their returns are ignored
+    int untracked_calls {};
+
+    // Instruction being timed
+    uint16_t address {};
+    uint16_t opcode {};
+    int family {};
+    Clock::time_point start {};
+
+    void enterCall(uint16_t target);
+    void leaveCall();
+    void add(Counter& counter, uint64_t host_ns);
+public:
+    Profiler();
+
+    // Around the execution of one instruction
+    void Begin(uint16_t instruction_address, uint16_t instruction_opcode)
+    {
+        address = instruction_address % Chip8Specs::MemorySize;
+        opcode = instruction_opcode;
+        family = opcodeFamilyOf(instruction_opcode);
+        start = Clock::now();
+    }
+
+    void End();
+
+    // The machine state was replaced, the calls in progress are unknown
+    void ResetCallStack();
+    void Reset();
+
+    uint64_t getInstructionCount();
+
+    // Families sorted by host time, then the hottest addresses
+    void writeReport(std::ostream& out, size_t hot_addresses = ProfilerSpecs::DefaultHotAddresses);
+    // One line per call path: "rom;sub_02A0;sub_0310 <instructions>"
+    void writeFoldedStacks(std::ostream& out);
+};
+
+// Writes the report and the folded stacks, empty paths are skipped
+void writeProfileFiles(Profiler& profiler, const std::string& report_path, const std::string& folded_path);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef CHIP8_QUIRKS_HPP
+#define CHIP8_QUIRKS_HPP
+
+#include <cstdint>
+#include <string>
+
+/*
+    Quirk profiles: the behaviours that changed between the
+    interpreters of the different eras. The Cpu handlers are
+    instantiated once per profile, the behaviour is a template
+    argument and never tested while running
+*/
+
+enum class QuirkProfile : uint8_t
+{
+    // Original COSMAC VIP interpreter, the default
+    Vip,
+    // HP48 calculators
+    Chip48,
+    // SUPER-CHIP 1.1, as modern interpreters run it
+    Schip,
+    XoChip,
+};
+
+QuirkProfile quirkProfileFromName(const std::string& name);
+const char* quirkProfileName(QuirkProfile profile);
+
+// What Fx55 / Fx65 leave in the index register
+enum class IndexQuirk : uint8_t
+{
+    // I + x + 1, past the last register
+    Increment,
+    // I + x, on the last register
+    IncrementByX,
+    Unchanged,
+};
+
+struct QuirkFlags
+{
+    // 8xy1, 8xy2 and 8xy3 clear VF
+    bool resets_flag {};
+    // 8xy6 and 8xyE shift vx in place instead of loading vy shifted
+    bool shifts_vx {};
+    IndexQuirk index {};
+    // Bxnn jumps to xnn + vx instead of nnn + v0
+    bool jumps_vx {};
+    // Sprites are cut at the screen edges instead of wrapping
+    bool clips_sprites {};
+};
+
+template <QuirkProfile Profile>
+struct QuirkTraits;
+
+template <>
+struct QuirkTraits<QuirkProfile::Vip>
+{
+    static constexpr QuirkFlags Flags { true, false, IndexQuirk::Increment, false, true };
+};
+
+template <>
+struct QuirkTraits<QuirkProfile::Chip48>
+{
+    static constexpr QuirkFlags Flags { false, true, IndexQuirk::IncrementByX, true, true };
+};
+
+template <>
+struct QuirkTraits<QuirkProfile::Schip>
+{
+    static constexpr QuirkFlags Flags { false, true, IndexQuirk::Unchanged, true, true };
+};
+
+template <>
+struct QuirkTraits<QuirkProfile::XoChip>
+{
+    static constexpr QuirkFlags Flags { false, false, IndexQuirk::Increment, false, false };
+};
+
+// Same flags, for the code deciding at translation time
+constexpr QuirkFlags quirkFlagsOf(QuirkProfile profile)
+{
+    switch (profile)
+    {
+    case QuirkProfile::Chip48: return QuirkTraits<QuirkProfile::Chip48>::Flags;
+    case QuirkProfile::Schip:  return QuirkTraits<QuirkProfile::Schip>::Flags;
+    case QuirkProfile::XoChip: return QuirkTraits<QuirkProfile::XoChip>::Flags;
+    default:                   return QuirkTraits<QuirkProfile::Vip>::Flags;
+    }
+}
+
+#endif
@@ -5,32 +5,58 @@
 #include <chrono>
 #include <cstdint>
 
+#include "save_state.hpp"
+
 // === Header only class ===
 /*
     Used to generate an 8-bit random
     number (values from 0 to 255)
+
+    PCG32 (XSH RR variant): 8 bytes of state, cheap to
+    snapshot. Seeded from the clock and the system entropy
+    by default, seed() makes the sequence reproducible
 */
 
 class RandomGenerator
 {
 private:
-    std::mt19937 mt;
-    std::uniform_int_distribution<uint8_t> dist;
+    static constexpr uint64_t Multiplier {6364136223846793005ULL};
+    static constexpr uint64_t Increment {1442695040888963407ULL};
+
+    uint64_t state {};
+
+    uint32_t next()
+    {
+        uint64_t old { state };
+        state = old * Multiplier + Increment;
+
+        uint32_t xorshifted { static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u) };
+        uint32_t rotation { static_cast<uint32_t>(old >> 59u) };
+        return (xorshifted >> rotation) | (xorshifted << ((32u - rotation) & 31u));
+    }
 public:
     RandomGenerator()
     {
         std::random_device rd;
-        std::seed_seq ss {
-            static_cast<std::seed_seq::result_type>(
-                std::chrono::steady_clock::now().time_since_epoch().count()),
-                rd(), rd(), rd(), rd(), rd(), rd(), rd()
-        };
-
-        mt = std::mt19937 { ss };
-        dist = std::uniform_int_distribution<uint8_t> { 0, 255U };
+        uint64_t entropy { (static_cast<uint64_t>(rd()) << 32u) | rd() };
+        seed(entropy ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+    }
+
+    explicit RandomGenerator(uint64_t value) { seed(value); }
+
+    void seed(uint64_t value)
+    {
+        state = 0;
+        next();
+        state += value;
+        next();
     }
 
-    uint8_t get() { return dist(mt); }
+    // High bits are the best distributed ones
+    uint8_t get() { return static_cast<uint8_t>(next() >> 24u); }
+
+    void saveState(StateWriter& writer) { writer.put64(state); }
+    void loadState(StateReader& reader) { state = reader.get64(); }
 };
 
 #endif
@@ -0,0 +1,113 @@
+#ifndef CHIP8_RECOMPILER_HPP
+#define CHIP8_RECOMPILER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "constants.hpp"
+#include "cpu.hpp"
+
+class Chip8;
+
+/*
+    Dynamic recompiler: translates hot blocks of CHIP-8
+    instructions into x86-64 machine code
+
+    Inside compiled code, the register file base pointer lives
+    in rbx, the index register in r12 and the execution context
+    in r13. The program counter is only materialized when a block
+    is left. Register operations are emitted inline, most other
+    instructions call their regular handler, and Dxyn/Fx0A are
+    left to the interpreter. Jumps and skips are chained straight
+    to the compiled target blocks.
+*/
+
+class Recompiler
+{
+private:
+    // Shared with the generated code, offsets are hard-coded
+    // in the emitter (see recompiler.cpp)
+    struct Context
+    {
+        Cpu* cpu {nullptr};
+        uint8_t* registers {nullptr};
+        // Instructions left to run, blocks bail out when
+        // the budget cannot cover them
+        int64_t budget {};
+        uint32_t index_register {};
+        uint32_t pc {};
+    };
+
+    // Instruction executed through its regular handler
+    struct CompiledOp
+    {
+        Cpu::DecodedInstruction decoded {};
+        uint16_t address {};
+    };
+
+    // Jump at the end of a block waiting for its target to be
+    // compiled, so that it can be chained to it directly
+    struct PendingChain
+    {
+        size_t rel32_offset {};
+        uint16_t target {};
+    };
+
+    using EnterFunction = void (*)(Context*, const uint8_t*);
+
+    Cpu* cpu {nullptr};
+    Chip8* system {nullptr};
+    Context context {};
+
+    // Executable code buffer
+    uint8_t* code {nullptr};
+    size_t code_size {};
+    size_t code_used {};
+    // Start of the shared thunks entering and leaving compiled code
+    size_t enter_offset {};
+    size_t exit_offset {};
+
+    // Entry point of the block compiled at each address
+    std::vector<uint8_t*> compiled {};
+    // Execution count of each address before it gets compiled
+    std::vector<uint8_t> hits {};
+    std::vector<PendingChain> pending_chains {};
+    // Stable storage for the ops called from generated code
+    std::deque<CompiledOp> compiled_ops {};
+
+    void emit8(uint8_t value);
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    void emitBytes(std::initializer_list<uint8_t> bytes);
+    void emitJump(size_t target_offset);
+    void emitExit(uint16_t pc);
+    void emitChain(uint16_t target);
+    void emitHandlerCall(const CompiledOp* op);
+    bool emitInline(const Cpu::DecodedInstruction& decoded);
+
+    void emitThunks();
+    uint8_t* Compile(uint16_t start);
+
+    // Runs an instruction through its regular handler. Returns the
+    // block compiled at the next pc, or nullptr to leave compiled code
+    static uint8_t* CallHandler(Context* context, const CompiledOp* op);
+public:
+    Recompiler(Cpu* cpu, Chip8* system);
+    ~Recompiler();
+
+    Recompiler(const Recompiler&) = delete;
+    Recompiler& operator=(const Recompiler&) = delete;
+
+    // False when the platform does not support it or the
+    // executable buffer could not be allocated
+    bool isAvailable();
+
+    // Drops all the compiled code
+    void Flush();
+
+    uint32_t Run(uint32_t max_instructions);
+};
+
+#endif
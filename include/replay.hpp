@@ -0,0 +1,113 @@
+#ifndef CHIP8_REPLAY_HPP
+#define CHIP8_REPLAY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+#include "machine_model.hpp"
+#include "quirks.hpp"
+#include "save_state.hpp"
+
+class Chip8;
+
+namespace ReplaySpecs
+{
+    constexpr uint8_t Magic[4] {'C', '8', 'R', 'P'};
+    // Bumped every time the layout changes
+    constexpr uint16_t Version {3};
+}
+
+/*
+    Replay file: a header, then a stream of records
+
+    Header: magic, version, ROM hash, seed, instruction rate,
+            quirk profile, machine model
+    Record: varint (frame delta << 2 | kind), then
+      - key:   one byte, key index | pressed << 4
+      - frame: varint, instructions executed by the frame
+               (only recorded at unlimited instruction rate)
+      - state: varint size, save state loaded by the player
+               (quick load, rewind)
+      - end:   nothing, last frame of the recording
+
+    Inputs and state loads of a frame are recorded before
+    the frame runs, in the order they have to be applied
+*/
+
+struct ReplayHeader
+{
+    uint64_t rom_hash {};
+    uint64_t seed {};
+    int instructions_per_second {};
+    QuirkProfile quirks {QuirkProfile::Vip};
+    MachineModel model {MachineModel::Chip8};
+};
+
+// FNV-1a of the ROM file, a replay only runs on the ROM it was recorded on
+uint64_t hashRomFile(const std::string& filename);
+
+class ReplayRecorder
+{
+private:
+    std::ofstream file {};
+    ReplayHeader header {};
+    // Records since the last flush
+    std::vector<uint8_t> buffer {};
+    std::vector<uint8_t> state {};
+    uint64_t last_frame {};
+    uint8_t keypad[Chip8Specs::KeysCount] {};
+    bool finished {false};
+
+    void putRecord(uint64_t frame, uint8_t kind);
+    void flush();
+public:
+    ReplayRecorder(const std::string& filename, const ReplayHeader& header);
+    ~ReplayRecorder();
+
+    ReplayRecorder(const ReplayRecorder&) = delete;
+    ReplayRecorder& operator=(const ReplayRecorder&) = delete;
+
+    // Records the keys that changed since the last call,
+    // before the frame runs
+    void RecordInputs(uint64_t frame, Chip8& system);
+    // Records the whole machine after it was replaced by a save state
+    void RecordStateLoad(uint64_t frame, Chip8& system);
+    // Records the instruction count of a frame that just ran.
+    // Ignored when the instruction rate is fixed
+    void RecordFrame(uint64_t frame, uint32_t executed);
+    // Marks the end of the recording, later calls are ignored
+    void Finish(uint64_t frame);
+};
+
+class ReplayPlayer
+{
+private:
+    std::vector<uint8_t> data {};
+    StateReader reader {nullptr, 0};
+    ReplayHeader header {};
+    std::vector<uint8_t> state {};
+
+    // Record read ahead, not applied yet
+    uint8_t kind {};
+    uint64_t record_frame {};
+    bool ended {false};
+
+    void readRecord();
+public:
+    explicit ReplayPlayer(const std::string& filename);
+
+    const ReplayHeader& getHeader();
+
+    // Applies the inputs and state loads recorded for the given frame.
+    // Returns false once the recording is over
+    bool ApplyInputs(uint64_t frame, Chip8& system);
+    // Instructions executed by the given frame, at unlimited
+    // instruction rate only
+    uint32_t getFrameLength(uint64_t frame);
+};
+
+#endif
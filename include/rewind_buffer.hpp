@@ -0,0 +1,72 @@
+#ifndef CHIP8_REWIND_BUFFER_HPP
+#define CHIP8_REWIND_BUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class Chip8;
+
+namespace RewindSpecs
+{
+    // One full snapshot per second at 60 snapshots per second
+    constexpr int DefaultKeyframeInterval {60};
+    constexpr size_t DefaultMemoryBudget {16 * 1024 * 1024};
+}
+
+/*
+    History of save states, one per frame, in bounded memory
+
+    Every keyframe_interval snapshots a full save state is kept
+    (keyframe), the ones in between are stored as the XOR against
+    their keyframe, run-length encoded: most of the machine does
+    not change from one frame to the next, so the deltas are
+    mostly zeros. The oldest keyframes are dropped, with their
+    deltas, when the memory budget is exceeded
+*/
+
+class RewindBuffer
+{
+private:
+    struct Snapshot
+    {
+        bool keyframe {false};
+        // Full save state, or encoded delta against the keyframe
+        std::vector<uint8_t> data {};
+    };
+
+    std::deque<Snapshot> snapshots {};
+    size_t memory_budget {};
+    size_t memory_usage {};
+    int keyframe_interval {};
+    size_t keyframe_count {};
+    // Snapshots pushed since the last keyframe
+    int deltas_since_keyframe {};
+
+    // Scratch buffers, reused between frames
+    std::vector<uint8_t> state {};
+    std::vector<uint8_t> restored {};
+
+    size_t footprintOf(const Snapshot& snapshot);
+    const Snapshot& keyframeOf(size_t index);
+    void decode(size_t index, std::vector<uint8_t>& out);
+    void dropOldest();
+public:
+    explicit RewindBuffer(size_t memory_budget = RewindSpecs::DefaultMemoryBudget,
+                          int keyframe_interval = RewindSpecs::DefaultKeyframeInterval);
+
+    size_t getSnapshotCount();
+    size_t getMemoryUsage();
+    size_t getMemoryBudget();
+
+    // Records the current state of the machine, called once per frame
+    void Push(Chip8& system);
+    // Drops the newest snapshot and restores the one before it.
+    // Live inputs (keypad) are kept. Returns false when there is
+    // no earlier snapshot
+    bool StepBack(Chip8& system);
+    void Clear();
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef CHIP8_ROM_IMAGE_HPP
+#define CHIP8_ROM_IMAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    Read-only view of a ROM file. On POSIX systems the file
+    is mapped: nothing is read nor copied until a machine
+    loads it, and every machine loading the same image shares
+    the pages. Other systems read it once into a buffer
+*/
+
+class RomImage
+{
+private:
+    const uint8_t* bytes {nullptr};
+    size_t length {};
+    // Released on destruction, null when read into the buffer
+    void* mapping {nullptr};
+    std::vector<uint8_t> buffer {};
+
+public:
+    // Throws if the file cannot be opened or mapped
+    explicit RomImage(const std::string& filename);
+    ~RomImage();
+
+    RomImage(const RomImage&) = delete;
+    RomImage& operator=(const RomImage&) = delete;
+
+    const uint8_t* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+#endif
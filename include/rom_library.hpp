@@ -0,0 +1,100 @@
+#ifndef CHIP8_ROM_LIBRARY_HPP
+#define CHIP8_ROM_LIBRARY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "machine_model.hpp"
+#include "quirks.hpp"
+
+namespace RomLibrarySpecs
+{
+    // First line of an index file, bumped every time the layout changes
+    constexpr const char* IndexHeader {"# chip8-index 1"};
+    // Files taken as ROMs when scanning a directory
+    constexpr const char* Extensions[] {".ch8", ".c8", ".sc8", ".xo8"};
+}
+
+// XXH64 of the ROM content, identifies a ROM whatever its file name
+uint64_t hashRom(const uint8_t* data, size_t size);
+
+// Model whose instructions the ROM uses. Code is followed from the
+// program start (jumps, calls and skips), so that sprite data is not
+// mistaken for instructions
+MachineModel detectMachineModel(const uint8_t* data, size_t size);
+
+/*
+    Known ROMs by hash, a text file, one ROM per line ('#'
+    starts a comment):
+        <XXH64 (hex)> <chip8|schip|xochip> <vip|chip48|schip|xochip> [Title]
+*/
+
+class RomDatabase
+{
+public:
+    struct Entry
+    {
+        MachineModel model {MachineModel::Chip8};
+        QuirkProfile quirks {QuirkProfile::Vip};
+        std::string title {};
+    };
+
+private:
+    std::unordered_map<uint64_t, Entry> entries {};
+
+public:
+    // Throws if the file cannot be read or a line is invalid
+    void LoadFromFile(const std::string& path);
+    // nullptr if the ROM is unknown
+    const Entry* find(uint64_t hash) const;
+};
+
+struct RomInfo
+{
+    std::string path {};
+    uint64_t size {};
+    // Modification time, in file clock ticks
+    int64_t modified {};
+    uint64_t hash {};
+    MachineModel model {MachineModel::Chip8};
+    QuirkProfile quirks {QuirkProfile::Vip};
+    // Found in the database, detected from the code otherwise
+    bool known {false};
+    std::string title {};
+};
+
+/*
+    Index of a ROM directory, cached on disk as a tab-separated
+    file. A rescan only reads the ROMs whose size or modification
+    time changed since they were indexed
+*/
+
+class RomIndex
+{
+private:
+    // Sorted by path
+    std::vector<RomInfo> entries {};
+    // Position of each content in entries, the first one for duplicates
+    std::unordered_map<uint64_t, size_t> by_hash {};
+
+    void rebuildHashes();
+
+public:
+    // A missing file gives an empty index. Throws if the file
+    // is not an index
+    void LoadFromFile(const std::string& path);
+    void SaveToFile(const std::string& path);
+
+    // Indexes every ROM under directory, entries of files that
+    // are gone are dropped. Returns the number of ROMs read
+    size_t Scan(const std::string& directory, const RomDatabase& database);
+
+    const std::vector<RomInfo>& getEntries();
+    // nullptr if no indexed ROM has this content
+    const RomInfo* findByHash(uint64_t hash);
+};
+
+#endif
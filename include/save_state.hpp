@@ -0,0 +1,149 @@
+#ifndef CHIP8_SAVE_STATE_HPP
+#define CHIP8_SAVE_STATE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// === Header only classes ===
+/*
+    Helpers for the binary save state format: fixed-size
+    little-endian fields appended to a byte buffer, read
+    back in the same order
+*/
+
+namespace SaveStateSpecs
+{
+    constexpr uint8_t Magic[4] {'C', '8', 'S', 'S'};
+    // Bumped every time the layout changes
+    constexpr uint16_t Version {5};
+}
+
+class StateWriter
+{
+private:
+    std::vector<uint8_t>& buffer;
+public:
+    explicit StateWriter(std::vector<uint8_t>& buffer) : buffer {buffer} {}
+
+    void put8(uint8_t value) { buffer.push_back(value); }
+
+    void put16(uint16_t value)
+    {
+        put8(value & 0xFFu);
+        put8(value >> 8u);
+    }
+
+    void put32(uint32_t value)
+    {
+        put16(value & 0xFFFFu);
+        put16(value >> 16u);
+    }
+
+    void put64(uint64_t value)
+    {
+        put32(value & 0xFFFFFFFFu);
+        put32(value >> 32u);
+    }
+
+    // LEB128, for values that are usually small
+    void putVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            put8(static_cast<uint8_t>(value | 0x80u));
+            value >>= 7u;
+        }
+        put8(static_cast<uint8_t>(value));
+    }
+
+    void putBytes(const uint8_t* data, size_t size) { buffer.insert(buffer.end(), data, data + size); }
+};
+
+class StateReader
+{
+private:
+    const uint8_t* data {nullptr};
+    size_t size {};
+    size_t offset {};
+
+    void require(size_t count)
+    {
+        if (size - offset < count)
+            throw std::runtime_error("Error: truncated save state");
+    }
+public:
+    StateReader(const uint8_t* data, size_t size) : data {data}, size {size} {}
+
+    uint8_t get8()
+    {
+        require(1);
+        return data[offset++];
+    }
+
+    uint16_t get16()
+    {
+        uint16_t low { get8() };
+        return low | static_cast<uint16_t>(get8() << 8u);
+    }
+
+    uint32_t get32()
+    {
+        uint32_t low { get16() };
+        return low | (static_cast<uint32_t>(get16()) << 16u);
+    }
+
+    uint64_t get64()
+    {
+        uint64_t low { get32() };
+        return low | (static_cast<uint64_t>(get32()) << 32u);
+    }
+
+    uint64_t getVarint()
+    {
+        uint64_t value {};
+
+        for (unsigned int shift {} ; shift < 64 ; shift += 7)
+        {
+            uint8_t byte { get8() };
+            value |= static_cast<uint64_t>(byte & 0x7Fu) << shift;
+            if (!(byte & 0x80u)) return value;
+        }
+
+        throw std::runtime_error("Error: invalid varint in save state");
+    }
+
+    void getBytes(uint8_t* out, size_t count)
+    {
+        require(count);
+        for (size_t i {} ; i < count ; ++i) out[i] = data[offset + i];
+        offset += count;
+    }
+
+    bool atEnd() { return offset == size; }
+};
+
+// Save states on disk are the raw blob
+inline void writeStateFile(const std::string& filename, const std::vector<uint8_t>& state)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Error: failed to open save state : " + filename);
+
+    file.write(reinterpret_cast<const char*>(state.data()), static_cast<std::streamsize>(state.size()));
+}
+
+inline std::vector<uint8_t> readStateFile(const std::string& filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Error: failed to open save state : " + filename);
+
+    return std::vector<uint8_t> { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef CHIP8_SCHEDULER_HPP
+#define CHIP8_SCHEDULER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+class Chip8;
+
+namespace SchedulerSpecs
+{
+    // Timers and display both run at 60 Hz
+    constexpr int FrameRate {60};
+    // Used when the instruction rate is not specified
+    constexpr int DefaultInstructionsPerSecond {1000};
+    // Instruction rate meaning "as fast as the host allows"
+    constexpr int Unlimited {0};
+}
+
+/*
+    Drives the machine frame by frame: each 60 Hz frame
+    runs the instruction budget of that frame, then ticks
+    the delay and sound timers exactly once
+*/
+
+class Scheduler
+{
+private:
+    Chip8* system {nullptr};
+    int instructions_per_second {};
+    // Instructions per second that did not fit in a whole
+    // number of instructions per frame, carried over so
+    // that the long-term rate is exact
+    int budget_remainder {};
+    uint64_t frame_count {};
+
+    uint32_t nextFrameBudget();
+public:
+    Scheduler(Chip8* system, int instructions_per_second);
+
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t getFrameCount();
+    int getInstructionsPerSecond();
+
+    // Runs one frame and returns the number of executed instructions.
+    // In unlimited mode, instructions run until the frame deadline or
+    // max_instructions, the frame length of a replay, and the timers
+    // tick either way. At a fixed instruction rate, a frame cut short
+    // by max_instructions does not tick the timers. Without a
+    // deadline, an unlimited frame lasts one frame period from now
+    uint32_t RunFrame(uint32_t max_instructions = UINT32_MAX,
+                      Clock::time_point deadline = Clock::time_point {});
+};
+
+#endif
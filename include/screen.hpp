@@ -0,0 +1,60 @@
+#ifndef CHIP8_SCREEN_HPP
+#define CHIP8_SCREEN_HPP
+
+#include <algorithm>
+#include <cstdint>
+
+#include "constants.hpp"
+
+// === Header only struct ===
+/*
+    Bit-packed framebuffer of every machine model. Each plane
+    holds two 64-bit words per row: the left half (columns 0 to
+    63) in the first HiresScreenHeight words, the right half
+    (columns 64 to 127) in the next ones. The most significant
+    bit is the leftmost pixel.
+
+    A low resolution screen (64x32) only uses the first 32
+    words of each plane, the layout CHIP-8 always had, so that
+    plane 0 can be handed out as Chip8::getVideo. Scrolls and
+    sprites work on whole words, never on single pixels
+*/
+
+struct Screen
+{
+    uint64_t planes[Chip8Specs::PlaneCount][2 * Chip8Specs::HiresScreenHeight] {};
+    // 128x64 instead of 64x32
+    bool hires {false};
+
+    int width() const { return hires ? Chip8Specs::HiresScreenWidth : Chip8Specs::ScreenWidth; }
+    int height() const { return hires ? Chip8Specs::HiresScreenHeight : Chip8Specs::ScreenHeight; }
+
+    uint64_t* left(int plane) { return planes[plane]; }
+    uint64_t* right(int plane) { return planes[plane] + Chip8Specs::HiresScreenHeight; }
+    const uint64_t* left(int plane) const { return planes[plane]; }
+    const uint64_t* right(int plane) const { return planes[plane] + Chip8Specs::HiresScreenHeight; }
+
+    // Bit p set when the pixel is on in plane p (0 to 3)
+    uint8_t pixelAt(int x, int y) const
+    {
+        uint8_t value {};
+
+        for (int plane {} ; plane < Chip8Specs::PlaneCount ; ++plane)
+        {
+            uint64_t word { x < 64 ? left(plane)[y] : right(plane)[y] };
+            value |= static_cast<uint8_t>(((word >> (63 - (x % 64))) & 1u) << plane);
+        }
+
+        return value;
+    }
+
+    bool operator==(const Screen& other) const
+    {
+        return hires == other.hires
+            && std::equal(&planes[0][0], &planes[0][0] + sizeof(planes) / sizeof(uint64_t), &other.planes[0][0]);
+    }
+
+    bool operator!=(const Screen& other) const { return !(*this == other); }
+};
+
+#endif
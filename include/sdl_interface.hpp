@@ -2,32 +2,98 @@
 #define CHIP8_SDL_INTERFACE
 
 #include <SDL.h>
-#include "chip8.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "constants.hpp"
+#include "emulation_thread.hpp"
+#include "keymap.hpp"
+#include "screen.hpp"
+#include "sound_related.hpp"
+#include "tone_generator.hpp"
+
+// Optional effects, applied by the renderer when presenting
+struct DisplayEffects
+{
+    // Share of the previous picture kept at each frame, in
+    // percent, like the slow phosphor of the original screens
+    int ghosting_percent {0};
+    // Darkens the bottom line of every pixel row
+    bool scanlines {false};
+};
 
 class SdlInterface
 {
 private:
     SDL_Window* window      {nullptr};
     SDL_Renderer* renderer  {nullptr};
-    SDL_Texture* texture    {nullptr};
-    Chip8* system           {nullptr};
+    // Streaming textures of the two resolutions, only the
+    // one of the presented resolution is written and drawn
+    SDL_Texture* lores_texture {nullptr};
+    SDL_Texture* hires_texture {nullptr};
+    // Render target accumulating the frames, ghosting only
+    SDL_Texture* phosphor   {nullptr};
+    // Drawn over the picture, scanlines only
+    SDL_Texture* scanline_mask {nullptr};
+    // Inputs are sent to the machine through it
+    EmulationThread* emulation {nullptr};
+    // Commands accepted by the queue so far
+    uint64_t submitted_commands {};
+
+    KeyLayout layout;
+    std::vector<SDL_GameController*> controllers {};
 
     SDL_AudioDeviceID audio_device  {};
-    uint8_t* audio_buffer           {};
-    uint32_t audio_length           {};
+    // Toggled by the M key, read by the audio thread
+    std::atomic<bool> is_muted {false};
+
+    // Used by the audio thread only
+    ToneGenerator tone {SoundSpecs::device_frequency};
+
+    static void SDLCALL AudioCallback(void* userdata, Uint8* stream, int length);
+    void FillAudio(int16_t* samples, int count);
+
+    // Last presented frame, only the rows that differ
+    // are uploaded, nothing is presented if none does
+    Screen presented_screen {};
+    // Set when the window content was lost (exposed, resized)
+    bool needs_redraw {true};
+
+    // Alpha the new frame is blended with over the phosphor
+    Uint8 ghosting_alpha {255};
+    // Presents left until the picture stops fading
+    int fade_frames_left {};
+    int fade_frames {};
 
-    bool is_muted {false};
+    void Submit(const MachineCommand& command);
+    void InitEffects(const DisplayEffects& effects);
+    SDL_Texture* textureOf(bool hires);
+    // Expands the rows into the locked texture, no copy is kept
+    void UploadRows(const Screen& screen, int first_row, int last_row);
+    void Present();
 
 public:
     SdlInterface(const char* window_title,
-                int window_width, int window_height,
-                int texture_width, int texture_height, Chip8* system);
+                int window_width, int window_height, EmulationThread* emulation,
+                int audio_buffer_samples = SoundSpecs::device_samples,
+                const DisplayEffects& effects = {}, const KeyLayout& layout = KeyLayout {});
     ~SdlInterface();
 
-    bool HandleKeyInput();
-    void Update(int pitch);
-    void InitSound();
-    void PlaySound();
+    // Returns true when the window was closed. With a wait,
+    // blocks up to wait_ms milliseconds for the first event
+    bool HandleKeyInput(int wait_ms = 0);
+    // Nothing can change on screen before the next input:
+    // the machine waits for a key and every input was applied
+    bool isIdle(const VideoFrame& frame) const;
+    void SetTitle(const char* title);
+    // Writes the changed rows into the texture of the screen
+    // resolution, one texel per pixel. Scaling to the window
+    // and the effects are left to the renderer
+    void Update(const VideoFrame& frame);
+    // The tone is synthesized by the audio callback for as
+    // long as the sound timer of the machine runs
+    void InitSound(int buffer_samples);
 };
 
 #endif
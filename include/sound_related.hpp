@@ -7,13 +7,13 @@ namespace SoundSpecs
 {
     // frequency in Hz
     constexpr int device_frequency { 44100 };
-    // 8 unsigned bits audio
-    SDL_AudioFormat device_format { AUDIO_U8 };
-    // audio buffer size
-    constexpr int device_samples { 1024 };
-
-    constexpr int sound_frequency { 1000 };
-    constexpr int sound_duration_ms { 100 }; 
+    // signed 16 bits audio, silence is 0
+    constexpr SDL_AudioFormat device_format { AUDIO_S16SYS };
+    // audio buffer size in samples, 512 is about 12 ms:
+    // less than a 60 Hz frame, so the tone follows the timer
+    constexpr int device_samples { 512 };
+    constexpr int min_device_samples { 64 };
+    constexpr int max_device_samples { 8192 };
 }
 
 #endif
@@ -0,0 +1,50 @@
+#ifndef CHIP8_SPSC_QUEUE_HPP
+#define CHIP8_SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+// === Header only class ===
+/*
+    Bounded lock-free queue between exactly one producer
+    thread and one consumer thread
+*/
+
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+private:
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    T items[Capacity] {};
+    // Next item to pop, written by the consumer
+    alignas(64) std::atomic<size_t> head {0};
+    // Next free slot, written by the producer
+    alignas(64) std::atomic<size_t> tail {0};
+public:
+    // Returns false when the queue is full
+    bool Push(const T& item)
+    {
+        size_t position { tail.load(std::memory_order_relaxed) };
+        if (position - head.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        items[position & (Capacity - 1)] = item;
+        tail.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false when the queue is empty
+    bool Pop(T& item)
+    {
+        size_t position { head.load(std::memory_order_relaxed) };
+        if (position == tail.load(std::memory_order_acquire))
+            return false;
+
+        item = items[position & (Capacity - 1)];
+        head.store(position + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif
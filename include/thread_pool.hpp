@@ -0,0 +1,64 @@
+#ifndef CHIP8_THREAD_POOL_HPP
+#define CHIP8_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    Work-stealing thread pool: every worker owns a queue
+    and runs its own tasks first (newest first), then steals
+    the oldest tasks of the other workers when it runs dry
+*/
+
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+private:
+    struct WorkerQueue
+    {
+        std::mutex lock {};
+        std::deque<Task> tasks {};
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues {};
+    std::vector<std::thread> workers {};
+
+    // Guards the sleeping workers and the waiting caller
+    std::mutex state_lock {};
+    std::condition_variable work_available {};
+    std::condition_variable all_done {};
+    bool stopping {false};
+    // Tasks sitting in a queue
+    std::atomic<size_t> queued {};
+    // Tasks submitted and not finished yet
+    std::atomic<size_t> unfinished {};
+    // Round-robin target of the next submitted task
+    std::atomic<size_t> next_queue {};
+
+    bool popLocal(size_t worker, Task& task);
+    bool steal(size_t worker, Task& task);
+    void workerLoop(size_t worker);
+public:
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t getThreadCount();
+
+    void Submit(Task task);
+    // Blocks until every submitted task has finished
+    void Wait();
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef CHIP8_TONE_GENERATOR_HPP
+#define CHIP8_TONE_GENERATOR_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+
+#include "constants.hpp"
+
+namespace ToneSpecs
+{
+    // frequency in Hz
+    constexpr int Frequency {1000};
+    // Peak of the signed 16 bits samples
+    constexpr int Volume {3000};
+    // The volume ramps up and down over ~2 ms at 44.1 kHz,
+    // a square wave cut abruptly clicks
+    constexpr int RampSamples {88};
+    // Bits of an XO-CHIP pattern played per second at the default pitch
+    constexpr double PatternRate {4000.0};
+}
+
+// XO-CHIP sound: a loop of 128 one-bit samples (F002) replacing
+// the tone, played at a rate set by the pitch register (Fx3A)
+struct AudioPattern
+{
+    uint8_t bits[Chip8Specs::AudioPatternSize] {};
+    uint8_t pitch {Chip8Specs::DefaultPitch};
+    // Nothing loaded yet, the tone is played
+    bool enabled {false};
+
+    bool operator==(const AudioPattern& other) const
+    {
+        return enabled == other.enabled && pitch == other.pitch
+            && std::equal(std::begin(bits), std::end(bits), std::begin(other.bits));
+    }
+
+    bool operator!=(const AudioPattern& other) const { return !(*this == other); }
+};
+
+// === Header only class ===
+/*
+    Square wave played while the sound timer runs, or the
+    XO-CHIP pattern once one was loaded. The phase
+    keeps running while silent, so the wave never restarts in
+    the middle of a period from one buffer to the next
+*/
+
+class ToneGenerator
+{
+private:
+    // A full turn is 2^32
+    uint32_t phase {};
+    uint32_t step {};
+    int volume {};
+    int sample_rate {};
+
+    AudioPattern pattern {};
+    // A full turn of the pattern is 2^32 as well
+    uint32_t pattern_phase {};
+    uint32_t pattern_step {};
+public:
+    explicit ToneGenerator(int sample_rate = 44100)
+        : step { static_cast<uint32_t>((uint64_t {ToneSpecs::Frequency} << 32u) / static_cast<uint64_t>(sample_rate)) },
+          sample_rate {sample_rate}
+    {
+    }
+
+    void SetPattern(const AudioPattern& value)
+    {
+        pattern = value;
+
+        // 4000 * 2^((pitch - 64) / 48) bits per second
+        double rate { ToneSpecs::PatternRate * std::pow(2.0, (pattern.pitch - 64) / 48.0) };
+        double bits_per_sample { rate / sample_rate };
+        pattern_step = static_cast<uint32_t>(bits_per_sample / (Chip8Specs::AudioPatternSize * 8) * 4294967296.0);
+    }
+
+    void Generate(int16_t* samples, int count, bool audible)
+    {
+        int target { audible ? ToneSpecs::Volume : 0 };
+        int ramp_step { std::max(ToneSpecs::Volume / ToneSpecs::RampSamples, 1) };
+
+        for (int i {} ; i < count ; ++i)
+        {
+            if (volume < target) volume = std::min(volume + ramp_step, target);
+            else if (volume > target) volume = std::max(volume - ramp_step, target);
+
+            bool high { phase < 0x80000000u };
+
+            if (pattern.enabled)
+            {
+                // 7 high bits of the phase: position in the 128 bits
+                uint32_t bit { pattern_phase >> 25u };
+                high = (pattern.bits[bit / 8] >> (7 - bit % 8)) & 1u;
+                pattern_phase += pattern_step;
+            }
+
+            samples[i] = static_cast<int16_t>(high ? volume : -volume);
+            phase += step;
+        }
+    }
+};
+
+#endif
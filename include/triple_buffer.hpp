@@ -0,0 +1,53 @@
+#ifndef CHIP8_TRIPLE_BUFFER_HPP
+#define CHIP8_TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// === Header only class ===
+/*
+    Lock-free triple buffer between one writer and one reader
+    thread. The writer fills the back slot and publishes it,
+    the reader takes the latest published slot. Neither side
+    ever waits, frames the reader did not take are dropped
+*/
+
+template <typename T>
+class TripleBuffer
+{
+private:
+    // Set on the middle index while it holds an unread slot
+    static constexpr uint8_t FreshBit {4};
+
+    T slots[3] {};
+    // Slot exchanged between the two threads
+    alignas(64) std::atomic<uint8_t> middle {1};
+    // Owned by the writer
+    alignas(64) uint8_t back {0};
+    // Owned by the reader
+    alignas(64) uint8_t front {2};
+public:
+    // === Writer side ===
+    T& Back() { return slots[back]; }
+
+    void Publish()
+    {
+        back = middle.exchange(back | FreshBit, std::memory_order_acq_rel) & ~FreshBit;
+    }
+
+    // === Reader side ===
+    // Takes the latest published slot, returns false if
+    // nothing was published since the last call
+    bool Update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FreshBit))
+            return false;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~FreshBit;
+        return true;
+    }
+
+    const T& Front() { return slots[front]; }
+};
+
+#endif
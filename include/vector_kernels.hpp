@@ -0,0 +1,302 @@
+#ifndef CHIP8_VECTOR_KERNELS_HPP
+#define CHIP8_VECTOR_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "constants.hpp"
+#include "masks.hpp"
+#include "vector_machine.hpp"
+
+/*
+    Kernels of the vector machine, written once against a SIMD
+    traits type and instantiated by each instruction set file
+    (vector_kernels_*.cpp), which are built with their own flags.
+    Everything here has internal linkage so that the instances
+    compiled for different instruction sets never get mixed
+
+    The traits type V provides:
+        Width                           lanes per byte vector
+        Vec                             vector type
+        zero, ones, set8, set16
+        load8/store8                    Width bytes
+        load16/store16                  Width / 2 words
+        add8, sub8, add16, slli16_2
+        and_, or_, andnot (~a & b)
+        cmpeq8, cmpeq16, max8u, subs8u
+        blend(old, new, mask)
+        widenLo/widenHi                 zero extend bytes to words
+        widenMaskLo/widenMaskHi         sign extend byte masks
+        packMask(lo, hi)                word masks back to bytes
+        movemask                        one bit per byte
+*/
+
+namespace
+{
+    // Instructions with a kernel, everything else runs lane by lane
+    enum class GroupOp
+    {
+        None,
+        LoadByte, AddByte,
+        Move, Or, And, Xor, Add, Sub, SubN,
+        SkipEqualByte, SkipNotEqualByte, SkipEqual, SkipNotEqual,
+        Jump, LoadIndex, AddIndex, LoadFont,
+        LoadDelay, SetDelay, SetSound,
+    };
+
+    GroupOp classifyGroupOp(uint16_t opcode)
+    {
+        switch ((opcode & 0xF000u) >> 12u)
+        {
+        case 0x1: return GroupOp::Jump;
+        case 0x3: return GroupOp::SkipEqualByte;
+        case 0x4: return GroupOp::SkipNotEqualByte;
+        case 0x5: return GroupOp::SkipEqual;
+        case 0x6: return GroupOp::LoadByte;
+        case 0x7: return GroupOp::AddByte;
+        case 0x9: return GroupOp::SkipNotEqual;
+        case 0xA: return GroupOp::LoadIndex;
+        case 0x8:
+            switch (opcode & MASK_OPC_NIBBLE)
+            {
+            case 0x0: return GroupOp::Move;
+            case 0x1: return GroupOp::Or;
+            case 0x2: return GroupOp::And;
+            case 0x3: return GroupOp::Xor;
+            case 0x4: return GroupOp::Add;
+            case 0x5: return GroupOp::Sub;
+            case 0x7: return GroupOp::SubN;
+            default:  return GroupOp::None;
+            }
+        case 0xF:
+            switch (opcode & MASK_OPC_BYTE)
+            {
+            case 0x07: return GroupOp::LoadDelay;
+            case 0x15: return GroupOp::SetDelay;
+            case 0x18: return GroupOp::SetSound;
+            case 0x1E: return GroupOp::AddIndex;
+            case 0x29: return GroupOp::LoadFont;
+            default:   return GroupOp::None;
+            }
+        default:
+            return GroupOp::None;
+        }
+    }
+
+    template <class V>
+    size_t selectGroup(VectorLanes& lanes, uint16_t leader_pc)
+    {
+        using Vec = typename V::Vec;
+        constexpr size_t Half {V::Width / 2};
+
+        const Vec target { V::set16(leader_pc) };
+        size_t first_pending {lanes.lane_count};
+
+        for (size_t i {} ; i < lanes.lane_count ; i += V::Width)
+        {
+            Vec pending_lo { V::load16(lanes.pending + i) };
+            Vec pending_hi { V::load16(lanes.pending + i + Half) };
+            Vec mask_lo { V::and_(V::cmpeq16(V::load16(lanes.pc + i), target), pending_lo) };
+            Vec mask_hi { V::and_(V::cmpeq16(V::load16(lanes.pc + i + Half), target), pending_hi) };
+
+            pending_lo = V::andnot(mask_lo, pending_lo);
+            pending_hi = V::andnot(mask_hi, pending_hi);
+
+            V::store16(lanes.group_mask16 + i, mask_lo);
+            V::store16(lanes.group_mask16 + i + Half, mask_hi);
+            V::store8(lanes.group_mask8 + i, V::packMask(mask_lo, mask_hi));
+            V::store16(lanes.pending + i, pending_lo);
+            V::store16(lanes.pending + i + Half, pending_hi);
+
+            if (first_pending == lanes.lane_count)
+            {
+                uint32_t bits { V::movemask(V::packMask(pending_lo, pending_hi)) };
+                if (bits) first_pending = i + __builtin_ctz(bits);
+            }
+        }
+
+        return first_pending;
+    }
+
+    template <class V>
+    bool executeGroup(VectorLanes& lanes, uint16_t opcode, uint16_t leader_pc)
+    {
+        using Vec = typename V::Vec;
+        constexpr size_t Half {V::Width / 2};
+
+        GroupOp op { classifyGroupOp(opcode) };
+        if (op == GroupOp::None) return false;
+
+        uint8_t* vx { lanes.registers + ((opcode & MASK_OPC_VX) >> 8u) * lanes.lane_count };
+        uint8_t* vy { lanes.registers + ((opcode & MASK_OPC_VY) >> 4u) * lanes.lane_count };
+        uint8_t* vf { lanes.registers + 0xF * lanes.lane_count };
+
+        const Vec byte { V::set8(static_cast<uint8_t>(opcode & MASK_OPC_BYTE)) };
+        const Vec one { V::set8(1) };
+        const Vec two { V::set16(2) };
+        const Vec next_pc { V::set16(static_cast<uint16_t>((op == GroupOp::Jump) ? (opcode & MASK_OPC_ADDR) : leader_pc + 2)) };
+
+        for (size_t i {} ; i < lanes.lane_count ; i += V::Width)
+        {
+            Vec mask { V::load8(lanes.group_mask8 + i) };
+            if (!V::movemask(mask)) continue;
+
+            Vec mask_lo { V::load16(lanes.group_mask16 + i) };
+            Vec mask_hi { V::load16(lanes.group_mask16 + i + Half) };
+            // Lanes skipping the next instruction
+            Vec skip { V::zero() };
+
+            switch (op)
+            {
+            case GroupOp::LoadByte:
+                V::store8(vx + i, V::blend(V::load8(vx + i), byte, mask));
+                break;
+            case GroupOp::AddByte:
+            {
+                Vec a { V::load8(vx + i) };
+                V::store8(vx + i, V::blend(a, V::add8(a, byte), mask));
+                break;
+            }
+            case GroupOp::Move:
+                V::store8(vx + i, V::blend(V::load8(vx + i), V::load8(vy + i), mask));
+                break;
+            case GroupOp::Or:
+            case GroupOp::And:
+            case GroupOp::Xor:
+            {
+                Vec a { V::load8(vx + i) };
+                Vec b { V::load8(vy + i) };
+                Vec result { (op == GroupOp::Or) ? V::or_(a, b) : (op == GroupOp::And) ? V::and_(a, b) : V::xor_(a, b) };
+
+                // vf is written last, it may be vx itself
+                V::store8(vx + i, V::blend(a, result, mask));
+                V::store8(vf + i, V::blend(V::load8(vf + i), V::zero(), mask));
+                break;
+            }
+            case GroupOp::Add:
+            {
+                Vec a { V::load8(vx + i) };
+                Vec sum { V::add8(a, V::load8(vy + i)) };
+                // No carry when the wrapped sum did not go below vx
+                Vec no_carry { V::cmpeq8(V::max8u(sum, a), sum) };
+
+                V::store8(vx + i, V::blend(a, sum, mask));
+                V::store8(vf + i, V::blend(V::load8(vf + i), V::andnot(no_carry, one), mask));
+                break;
+            }
+            case GroupOp::Sub:
+            {
+                // Same as Instructions::opc_8xy5: both operands are
+                // read once, before vx changes, and vf is written last
+                Vec a { V::load8(vx + i) };
+                Vec b { V::load8(vy + i) };
+                V::store8(vx + i, V::blend(a, V::sub8(a, b), mask));
+
+                Vec not_borrow { V::cmpeq8(V::max8u(a, b), a) };
+                V::store8(vf + i, V::blend(V::load8(vf + i), V::and_(not_borrow, one), mask));
+                break;
+            }
+            case GroupOp::SubN:
+            {
+                Vec a { V::load8(vx + i) };
+                V::store8(vx + i, V::blend(a, V::sub8(V::load8(vy + i), a), mask));
+
+                // Same as the handler: compares against the new vx
+                Vec b { V::load8(vy + i) };
+                Vec not_borrow { V::cmpeq8(V::max8u(b, V::load8(vx + i)), b) };
+                V::store8(vf + i, V::blend(V::load8(vf + i), V::and_(not_borrow, one), mask));
+                break;
+            }
+            case GroupOp::SkipEqualByte:
+                skip = V::cmpeq8(V::load8(vx + i), byte);
+                break;
+            case GroupOp::SkipNotEqualByte:
+                skip = V::andnot(V::cmpeq8(V::load8(vx + i), byte), V::ones());
+                break;
+            case GroupOp::SkipEqual:
+                skip = V::cmpeq8(V::load8(vx + i), V::load8(vy + i));
+                break;
+            case GroupOp::SkipNotEqual:
+                skip = V::andnot(V::cmpeq8(V::load8(vx + i), V::load8(vy + i)), V::ones());
+                break;
+            case GroupOp::LoadIndex:
+            {
+                Vec address { V::set16(opcode & MASK_OPC_ADDR) };
+                V::store16(lanes.index_register + i, V::blend(V::load16(lanes.index_register + i), address, mask_lo));
+                V::store16(lanes.index_register + i + Half, V::blend(V::load16(lanes.index_register + i + Half), address, mask_hi));
+                break;
+            }
+            case GroupOp::AddIndex:
+            case GroupOp::LoadFont:
+            {
+                Vec a { V::load8(vx + i) };
+                Vec value_lo { V::widenLo(a) };
+                Vec value_hi { V::widenHi(a) };
+                Vec index_lo { V::load16(lanes.index_register + i) };
+                Vec index_hi { V::load16(lanes.index_register + i + Half) };
+
+                if (op == GroupOp::AddIndex)
+                {
+                    value_lo = V::add16(index_lo, value_lo);
+                    value_hi = V::add16(index_hi, value_hi);
+                }
+                else
+                {
+                    // Font characters are 5 bytes long
+                    static_assert(Chip8Specs::FontCharSize == 5, "Font offsets are computed as (v << 2) + v");
+                    const Vec font { V::set16(Chip8Specs::FontSetStartAddress) };
+                    value_lo = V::add16(font, V::add16(V::slli16_2(value_lo), value_lo));
+                    value_hi = V::add16(font, V::add16(V::slli16_2(value_hi), value_hi));
+                }
+
+                V::store16(lanes.index_register + i, V::blend(index_lo, value_lo, mask_lo));
+                V::store16(lanes.index_register + i + Half, V::blend(index_hi, value_hi, mask_hi));
+                break;
+            }
+            case GroupOp::LoadDelay:
+                V::store8(vx + i, V::blend(V::load8(vx + i), V::load8(lanes.delay_timer + i), mask));
+                break;
+            case GroupOp::SetDelay:
+                V::store8(lanes.delay_timer + i, V::blend(V::load8(lanes.delay_timer + i), V::load8(vx + i), mask));
+                break;
+            case GroupOp::SetSound:
+                V::store8(lanes.sound_timer + i, V::blend(V::load8(lanes.sound_timer + i), V::load8(vx + i), mask));
+                break;
+            case GroupOp::Jump:
+            case GroupOp::None:
+                break;
+            }
+
+            Vec pc_lo { V::add16(next_pc, V::and_(V::widenMaskLo(skip), two)) };
+            Vec pc_hi { V::add16(next_pc, V::and_(V::widenMaskHi(skip), two)) };
+
+            V::store16(lanes.pc + i, V::blend(V::load16(lanes.pc + i), pc_lo, mask_lo));
+            V::store16(lanes.pc + i + Half, V::blend(V::load16(lanes.pc + i + Half), pc_hi, mask_hi));
+        }
+
+        return true;
+    }
+
+    template <class V>
+    void tickTimers(VectorLanes& lanes)
+    {
+        const typename V::Vec one { V::set8(1) };
+
+        for (size_t i {} ; i < lanes.lane_count ; i += V::Width)
+        {
+            V::store8(lanes.delay_timer + i, V::subs8u(V::load8(lanes.delay_timer + i), one));
+            V::store8(lanes.sound_timer + i, V::subs8u(V::load8(lanes.sound_timer + i), one));
+        }
+    }
+
+    template <class V>
+    const VectorKernels* makeKernels(const char* name)
+    {
+        static_assert(VectorSpecs::LaneAlignment % V::Width == 0, "Lane arrays must be padded to whole vectors");
+
+        static const VectorKernels kernels { name, &selectGroup<V>, &executeGroup<V>, &tickTimers<V> };
+        return &kernels;
+    }
+}
+
+#endif
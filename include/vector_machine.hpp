@@ -0,0 +1,175 @@
+#ifndef CHIP8_VECTOR_MACHINE_HPP
+#define CHIP8_VECTOR_MACHINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.hpp"
+#include "quirks.hpp"
+#include "random.hpp"
+
+/*
+    Vector machine: many CHIP-8 machines running the same ROM
+    in lockstep, typically fed with different inputs
+
+    Registers, program counters, index registers and timers are
+    stored as structure of arrays (one array per register, one
+    entry per lane) so that lanes sitting at the same address
+    execute together, through SIMD kernels working on a lane mask.
+    Memory, stack and framebuffer stay per lane. Lanes that
+    diverge too much are stepped one at a time, through the
+    instruction semantics Cpu runs (instructions.hpp). Only
+    the CHIP-8 machine model (4 KB, 64x32) is supported
+*/
+
+// Views of the lane arrays handed to the kernels. Arrays are
+// padded to a multiple of VectorSpecs::LaneAlignment lanes
+struct VectorLanes
+{
+    size_t lane_count {};
+    // V0 to VF, register i of lane l at registers[i * lane_count + l]
+    uint8_t* registers {nullptr};
+    uint16_t* pc {nullptr};
+    uint16_t* index_register {nullptr};
+    uint8_t* delay_timer {nullptr};
+    uint8_t* sound_timer {nullptr};
+    // 0xFFFF for the lanes that did not execute the current step yet
+    uint16_t* pending {nullptr};
+    // Lanes of the group being executed, 0xFF / 0xFFFF when selected
+    uint8_t* group_mask8 {nullptr};
+    uint16_t* group_mask16 {nullptr};
+};
+
+// One set of kernels per instruction set
+struct VectorKernels
+{
+    const char* name {nullptr};
+    // Moves the pending lanes sitting at leader_pc into the group
+    // masks. Returns the first lane still pending, or lane_count
+    size_t (*selectGroup)(VectorLanes& lanes, uint16_t leader_pc) {nullptr};
+    // Executes opcode on the group and moves its pc, returns false
+    // when the instruction has no kernel and must run lane by lane
+    bool (*executeGroup)(VectorLanes& lanes, uint16_t opcode, uint16_t leader_pc) {nullptr};
+    void (*tickTimers)(VectorLanes& lanes) {nullptr};
+};
+
+// Kernels available on this build, nullptr when not supported
+const VectorKernels* vectorKernelsSse2();
+const VectorKernels* vectorKernelsAvx2();
+
+namespace VectorSpecs
+{
+    // Widest kernel, in lanes
+    constexpr size_t LaneAlignment {32};
+}
+
+class VectorMachine
+{
+private:
+    // Lanes requested, the arrays hold padded_lanes entries
+    size_t lane_count {};
+    size_t padded_lanes {};
+
+    // === Structure of arrays ===
+    std::vector<uint8_t> registers {};
+    std::vector<uint16_t> pc {};
+    std::vector<uint16_t> index_register {};
+    std::vector<uint8_t> delay_timer {};
+    std::vector<uint8_t> sound_timer {};
+    std::vector<uint8_t> sp {};
+    // 0xFFFF while the lane runs, 0 once halted (and for padding)
+    std::vector<uint16_t> active {};
+    size_t running_lanes {};
+    std::vector<uint16_t> pending {};
+    std::vector<uint8_t> group_mask8 {};
+    std::vector<uint16_t> group_mask16 {};
+
+    // === Per lane state ===
+    std::vector<uint8_t> memory {};
+    std::vector<uint16_t> stack {};
+    std::vector<uint64_t> video {};
+    std::vector<uint8_t> keypad {};
+    std::vector<uint8_t> key_wait_pressed {};
+    std::vector<uint8_t> key_wait_key {};
+    std::vector<RandomGenerator> random_devices {};
+
+    // Addresses written by any lane since the ROM was loaded.
+    // Lanes can only disagree on the code found there
+    uint8_t memory_written[Chip8Specs::ClassicMemorySize] {};
+
+    const VectorKernels* kernels {nullptr};
+    VectorLanes views {};
+    // Too many groups in the last step, lanes run one at a time
+    bool diverged {false};
+    // Group count above which the lanes are considered diverged
+    size_t max_groups {};
+    // Scratch used to count the distinct addresses of the lanes
+    std::vector<uint32_t> address_stamps {};
+    uint32_t stamp {};
+
+    uint8_t& registerOf(size_t lane, uint8_t index);
+    uint8_t readMemory(size_t lane, uint16_t address);
+    void writeMemory(size_t lane, uint16_t address, uint8_t value);
+    uint16_t fetch(size_t lane);
+    void halt(size_t lane);
+
+    QuirkProfile quirks {QuirkProfile::Vip};
+    // executeLane instantiated for the quirk profile
+    void (VectorMachine::*execute_lane)(size_t, uint16_t) {&VectorMachine::executeLane<QuirkProfile::Vip>};
+
+    // State of one lane for the shared instruction semantics
+    class LaneAccess;
+
+    // Executes one already fetched instruction on one lane, pc
+    // pointing after it. Runs the same semantics as Cpu
+    template <QuirkProfile Profile>
+    void executeLane(size_t lane, uint16_t opcode);
+    void executeGroupLanes(uint16_t opcode, uint16_t leader_pc);
+
+    size_t countGroups();
+    void StepMasked();
+    void StepLanes();
+public:
+    explicit VectorMachine(size_t lane_count);
+
+    VectorMachine(const VectorMachine&) = delete;
+    VectorMachine& operator=(const VectorMachine&) = delete;
+
+    // Loads the same ROM into every lane, both throw if
+    // it does not fit in the memory
+    void loadRomIntoMemory(const std::string& filename);
+    void loadRom(const uint8_t* data, size_t size);
+
+    size_t getLaneCount();
+    // Name of the kernels in use ("scalar" without SIMD support)
+    const char* getKernelName();
+    bool isHalted(size_t lane);
+    uint8_t getRegister(size_t lane, uint8_t index);
+    uint16_t getPC(size_t lane);
+    uint16_t getIndexRegister(size_t lane);
+    uint8_t getSP(size_t lane);
+    uint8_t getDelayTimer(size_t lane);
+    uint8_t getSoundTimer(size_t lane);
+    uint8_t getMemoryAt(size_t lane, uint16_t address);
+    // Same layout as Chip8::getVideo
+    uint64_t* getVideo(size_t lane);
+
+    void setKeypad(size_t lane, int index, uint8_t value);
+    // Same sequence as a Chip8 given the same seed
+    void setSeed(size_t lane, uint64_t seed);
+    // Disables the SIMD kernels, every lane runs on its own
+    void setScalar(bool value);
+    // Same profiles as Cpu::setQuirks, for every lane
+    void setQuirks(QuirkProfile value);
+    QuirkProfile getQuirks();
+
+    // Executes up to max_steps instructions on every running lane,
+    // stops early once all of them halted. Returns the step count
+    uint32_t Run(uint32_t max_steps);
+    // Decrements the delay and sound timers of every lane
+    void TickTimers();
+};
+
+#endif
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "cpu.hpp"
+#include "constants.hpp"
+#include "rom_image.hpp"
+#include "rom_library.hpp"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+
+/*
+    Batch runner: executes every job of a manifest on a
+    thread pool, one machine per job, and reports the final
+    state of each of them
+
+    Manifest, one job per line ('#' starts a comment):
+        <ROM> <Cycles> [InputScript]
+
+    Input script, one key event per line:
+        <Frame> <Key (hex)> <down|up>
+
+    Relative paths are resolved from the file referencing them
+*/
+
+namespace
+{
+    struct InputEvent
+    {
+        uint64_t frame {};
+        uint8_t key {};
+        uint8_t pressed {};
+    };
+
+    struct Job
+    {
+        std::string rom_path {};
+        uint64_t max_cycles {};
+        std::string input_path {};
+        // Resolved before the jobs start, see prepareRoms
+        const RomImage* rom {nullptr};
+        std::string rom_error {};
+        MachineModel model {MachineModel::Chip8};
+        std::optional<QuirkProfile> quirks {};
+    };
+
+    // One per ROM path, shared by all the jobs running it
+    struct LoadedRom
+    {
+        std::unique_ptr<RomImage> image {};
+        std::string error {};
+        MachineModel model {MachineModel::Chip8};
+        std::optional<QuirkProfile> quirks {};
+    };
+
+    struct JobResult
+    {
+        bool failed {false};
+        std::string error {};
+        bool halted {false};
+        uint64_t executed_cycles {};
+        uint64_t framebuffer_hash {};
+        uint16_t pc {};
+        uint16_t index_register {};
+        uint8_t registers[Chip8Specs::RegisterCount] {};
+        uint64_t out_of_bounds {};
+        double wall_ms {};
+    };
+
+    std::string resolvePath(const std::filesystem::path& base_dir, const std::string& path)
+    {
+        std::filesystem::path resolved {path};
+        if (resolved.is_relative()) resolved = base_dir / resolved;
+        return resolved.string();
+    }
+
+    std::vector<Job> loadManifest(const std::string& manifest_path)
+    {
+        std::ifstream manifest(manifest_path);
+        if (!manifest.is_open())
+            throw std::runtime_error("Error: failed to open manifest : " + manifest_path);
+
+        std::filesystem::path base_dir { std::filesystem::path(manifest_path).parent_path() };
+        std::vector<Job> jobs {};
+        std::string line {};
+        int line_number {};
+
+        while (std::getline(manifest, line))
+        {
+            ++line_number;
+            line = line.substr(0, line.find('#'));
+
+            std::istringstream fields(line);
+            Job job {};
+            std::string rom {};
+
+            if (!(fields >> rom)) continue;
+
+            if (!(fields >> job.max_cycles))
+                throw std::invalid_argument("Error: missing cycle budget at manifest line " + std::to_string(line_number));
+
+            job.rom_path = resolvePath(base_dir, rom);
+
+            std::string input {};
+            if (fields >> input) job.input_path = resolvePath(base_dir, input);
+
+            jobs.push_back(job);
+        }
+
+        return jobs;
+    }
+
+    std::vector<InputEvent> loadInputScript(const std::string& script_path)
+    {
+        std::ifstream script(script_path);
+        if (!script.is_open())
+            throw std::runtime_error("Error: failed to open input script : " + script_path);
+
+        std::vector<InputEvent> events {};
+        std::string line {};
+
+        while (std::getline(script, line))
+        {
+            line = line.substr(0, line.find('#'));
+
+            std::istringstream fields(line);
+            InputEvent event {};
+            int key {};
+            std::string state {};
+
+            if (!(fields >> event.frame)) continue;
+
+            if (!(fields >> std::hex >> key >> state) || key < 0 || key >= Chip8Specs::KeysCount
+                || (state != "down" && state != "up"))
+                throw std::invalid_argument("Error: invalid input event : " + line);
+
+            event.key = static_cast<uint8_t>(key);
+            event.pressed = (state == "down") ? 1 : 0;
+            events.push_back(event);
+        }
+
+        std::stable_sort(events.begin(), events.end(),
+            [](const InputEvent& a, const InputEvent& b) { return a.frame < b.frame; });
+
+        return events;
+    }
+
+    void hashWords(uint64_t& hash, const uint64_t* words, int count)
+    {
+        for (int y {} ; y < count ; ++y)
+            for (int shift {56} ; shift >= 0 ; shift -= 8)
+            {
+                hash ^= (words[y] >> shift) & 0xFFu;
+                hash *= 0x100000001B3u;
+            }
+    }
+
+    // FNV-1a over the packed rows in use, a CHIP-8
+    // screen only hashes its 32 rows
+    uint64_t hashFramebuffer(const Screen& screen, int plane_count)
+    {
+        uint64_t hash {0xCBF29CE484222325u};
+
+        for (int plane {} ; plane < plane_count ; ++plane)
+        {
+            hashWords(hash, screen.left(plane), screen.height());
+            if (screen.hires) hashWords(hash, screen.right(plane), screen.height());
+        }
+
+        return hash;
+    }
+
+    // Maps every ROM once, however many jobs run it, and picks its
+    // model: the given one, else the index's, else CHIP-8
+    void prepareRoms(std::vector<Job>& jobs, std::map<std::string, LoadedRom>& roms, RomIndex* index,
+                     std::optional<MachineModel> model, std::optional<QuirkProfile> quirks)
+    {
+        for (Job& job : jobs)
+        {
+            auto it { roms.find(job.rom_path) };
+
+            if (it == roms.end())
+            {
+                LoadedRom rom {};
+
+                try {
+                    rom.image = std::make_unique<RomImage>(job.rom_path);
+                } catch (const std::exception& e) {
+                    rom.error = e.what();
+                }
+
+                const RomInfo* info { (index && rom.image) ? index->findByHash(hashRom(rom.image->data(), rom.image->size())) : nullptr };
+
+                rom.model = model ? *model : info ? info->model : MachineModel::Chip8;
+                rom.quirks = quirks ? quirks : (info && !model) ? std::optional<QuirkProfile> {info->quirks} : std::nullopt;
+
+                it = roms.emplace(job.rom_path, std::move(rom)).first;
+            }
+
+            job.rom = it->second.image.get();
+            job.rom_error = it->second.error;
+            job.model = it->second.model;
+            job.quirks = it->second.quirks;
+        }
+    }
+
+    void runJob(const Job& job, CpuEngine engine, std::optional<uint64_t> seed, JobResult& result)
+    {
+        auto start { std::chrono::steady_clock::now() };
+
+        try {
+            std::vector<InputEvent> events {};
+            if (!job.input_path.empty()) events = loadInputScript(job.input_path);
+
+            // Too big for the thread stacks
+            auto chip8 { std::make_unique<Chip8>() };
+            Cpu* cpu { chip8->getCpu() };
+
+            if (!cpu->setEngine(engine))
+                throw std::runtime_error("Error: engine not available on this build");
+
+            if (!job.rom) throw std::runtime_error(job.rom_error);
+
+            chip8->setModel(job.model);
+            if (job.quirks) cpu->setQuirks(*job.quirks);
+            if (seed) chip8->setSeed(*seed);
+            // Straight from the shared mapping
+            chip8->loadRom(job.rom->data(), job.rom->size());
+
+            Scheduler scheduler(chip8.get(), SchedulerSpecs::DefaultInstructionsPerSecond);
+            size_t next_event {};
+
+            while (result.executed_cycles < job.max_cycles && !cpu->isHalted())
+            {
+                // Key events apply at the start of their frame
+                while (next_event < events.size() && events[next_event].frame <= scheduler.getFrameCount())
+                {
+                    chip8->setKeypad(events[next_event].key, events[next_event].pressed);
+                    ++next_event;
+                }
+
+                uint64_t remaining { job.max_cycles - result.executed_cycles };
+                result.executed_cycles += scheduler.RunFrame(
+                    static_cast<uint32_t>(std::min<uint64_t>(remaining, UINT32_MAX)));
+            }
+
+            result.halted = cpu->isHalted();
+            result.framebuffer_hash = hashFramebuffer(chip8->getScreen(), planeCountOf(job.model));
+            result.pc = cpu->getPC();
+            result.index_register = chip8->getIndexRegister();
+
+            for (uint8_t i {} ; i < Chip8Specs::RegisterCount ; ++i)
+                result.registers[i] = cpu->getRegister(i);
+
+            result.out_of_bounds = chip8->getOutOfBoundsAccesses();
+        } catch (const std::exception& e) {
+            result.failed = true;
+            result.error = e.what();
+        }
+
+        result.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // One tab-separated line per job, in manifest order
+    void writeResults(const std::vector<Job>& jobs, const std::vector<JobResult>& results, std::ostream& out)
+    {
+        out << "rom\tstatus\tcycles\tframebuffer\tpc\ti\tregisters\toob\twall_ms\n";
+
+        for (size_t i {} ; i < jobs.size() ; ++i)
+        {
+            const JobResult& result { results[i] };
+            out << jobs[i].rom_path << '\t';
+
+            if (result.failed)
+            {
+                out << "error\t" << result.error << '\n';
+                continue;
+            }
+
+            out << (result.halted ? "halted" : "budget") << '\t'
+                << std::dec << result.executed_cycles << '\t'
+                << std::hex << std::uppercase << std::setfill('0')
+                << std::setw(16) << result.framebuffer_hash << '\t'
+                << std::setw(4) << result.pc << '\t'
+                << std::setw(4) << result.index_register << '\t';
+
+            for (uint8_t value : result.registers)
+                out << std::setw(2) << static_cast<int>(value);
+
+            out << '\t' << std::dec << result.out_of_bounds
+                << '\t' << std::fixed << std::setprecision(3) << result.wall_ms << '\n';
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Batch Usage: " << argv[0] << " <Manifest> [Output] [Options]" << '\n'
+                  << "Options:" << '\n'
+                  << "  --threads <N>                                Worker threads (default: one per core)" << '\n'
+                  << "  --engine <interpreter|threaded|recompiler>   Cpu execution engine" << '\n'
+                  << "  --model <chip8|schip|xochip>                 Machine model, instruction set and display (default: the index's, or chip8)" << '\n'
+                  << "  --quirks <vip|chip48|schip|xochip>           Instruction behaviours of an interpreter era (default: the model's)" << '\n'
+                  << "  --seed <Number>                              Same random generator seed for every job" << '\n'
+                  << "  --index <File>                               ROM index (chip8-index), gives each ROM its model and quirks" << '\n';
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::string output_path {};
+    size_t thread_count {};
+    CpuEngine engine {CpuEngine::Interpreter};
+    std::optional<MachineModel> model {};
+    std::optional<QuirkProfile> quirks {};
+    std::optional<uint64_t> seed {};
+    std::unique_ptr<RomIndex> index {};
+    std::vector<Job> jobs {};
+    std::map<std::string, LoadedRom> roms {};
+
+    try {
+        for (int i {2} ; i < argc ; ++i)
+        {
+            std::string arg { argv[i] };
+
+            if (arg == "--threads" && i + 1 < argc) thread_count = std::stoul(argv[++i]);
+            else if (arg == "--engine" && i + 1 < argc) engine = engineFromName(argv[++i]);
+            else if (arg == "--model" && i + 1 < argc) model = machineModelFromName(argv[++i]);
+            else if (arg == "--quirks" && i + 1 < argc) quirks = quirkProfileFromName(argv[++i]);
+            else if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i], nullptr, 0);
+            else if (arg == "--index" && i + 1 < argc)
+            {
+                std::string index_path { argv[++i] };
+                if (!std::filesystem::exists(index_path))
+                    throw std::runtime_error("Error: failed to open ROM index : " + index_path);
+
+                index = std::make_unique<RomIndex>();
+                index->LoadFromFile(index_path);
+            }
+            else if (output_path.empty() && arg.rfind("--", 0) != 0) output_path = arg;
+            else throw std::invalid_argument("Error: unexpected argument : " + arg);
+        }
+
+        jobs = loadManifest(argv[1]);
+        prepareRoms(jobs, roms, index.get(), model, quirks);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<JobResult> results(jobs.size());
+    auto start { std::chrono::steady_clock::now() };
+
+    {
+        ThreadPool pool {thread_count};
+
+        for (size_t i {} ; i < jobs.size() ; ++i)
+            pool.Submit([&jobs, &results, engine, seed, i] {
+                runJob(jobs[i], engine, seed, results[i]);
+            });
+
+        pool.Wait();
+        thread_count = pool.getThreadCount();
+    }
+
+    double wall_seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+    size_t failed_jobs { static_cast<size_t>(std::count_if(results.begin(), results.end(),
+        [](const JobResult& result) { return result.failed; })) };
+
+    if (!output_path.empty())
+    {
+        std::ofstream output(output_path);
+        if (!output.is_open())
+        {
+            std::cerr << "Error: failed to open output : " << output_path << "\n";
+            return EXIT_FAILURE;
+        }
+
+        writeResults(jobs, results, output);
+    }
+    else writeResults(jobs, results, std::cout);
+
+    std::cerr << jobs.size() << " jobs on " << thread_count << " threads in "
+              << std::fixed << std::setprecision(2) << wall_seconds << " s"
+              << " (" << failed_jobs << " failed)\n";
+
+    return failed_jobs == 0 ? 0 : EXIT_FAILURE;
+}
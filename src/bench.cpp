@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "cpu.hpp"
+#include "constants.hpp"
+#include "profiler.hpp"
+
+/*
+    Benchmark harness: runs bundled synthetic workloads for a
+    fixed instruction count on each engine, without display nor
+    timers, and reports the instruction rate. The opcode mix of
+    each workload is measured by a separate interpreted pass so
+    that the timed runs are not slowed down by the counting
+*/
+
+namespace
+{
+    struct Workload
+    {
+        const char* name {};
+        const char* description {};
+        std::vector<uint16_t> program {};
+    };
+
+    struct BenchResult
+    {
+        std::string workload {};
+        std::string engine {};
+        uint64_t instructions {};
+        // Best of the repetitions
+        double seconds {};
+        // Opcode mnemonic -> share of the executed instructions
+        std::map<std::string, double> opcode_mix {};
+    };
+
+    // Every workload loops forever, none of them halts
+    const std::vector<Workload>& workloads()
+    {
+        static const std::vector<Workload> list {
+            { "arith", "ALU loop (7xkk, 8xy_, 3xkk, 1nnn)", {
+                0x6001, 0x6103,                         // 200: V0 = 1, V1 = 3
+                0x8014, 0x8105, 0x820E, 0x8213,         // 204: add, sub, shift, xor
+                0x8312, 0x8421, 0x7501, 0x3500,         // 20C: and, or, V5++, skip if V5 == 0
+                0x1204, 0x1200,                         // 214: loop
+            } },
+            { "sprites", "Sprite draw storm (Fx29, Dxyn, 00E0)", {
+                0x6000, 0x6100,                         // 200: x = 0, y = 0
+                0xF229, 0xD015, 0x7005, 0x7103,         // 204: font of V2, draw, move
+                0x7201, 0x3200, 0x1204, 0x00E0,         // 20C: next digit, clear every 256 draws
+                0x1204,
+            } },
+            { "bcd", "BCD conversions (Fx33, Fx65)", {
+                0xA300,                                 // 200: I = 0x300, Fx65 moves it
+                0xF533, 0xF265, 0x7507, 0x8014,         // 202: BCD of V5, load digits
+                0x1200,
+            } },
+            { "memcopy", "Register block copies (Fx65, Fx55)", {
+                0xA300, 0xFF65, 0xA400, 0xFF55,         // 200: copy 0x300 to 0x400
+                0x7001, 0x1200,
+            } },
+            { "calls", "Nested call/return (2nnn, 00EE)", {
+                0x2210, 0x2210, 0x1200, 0x0000,         // 200: two calls per loop
+                0x0000, 0x0000, 0x0000, 0x0000,
+                0x2220, 0x00EE, 0x0000, 0x0000,         // 210: depth 1
+                0x0000, 0x0000, 0x0000, 0x0000,
+                0x2230, 0x00EE, 0x0000, 0x0000,         // 220: depth 2
+                0x0000, 0x0000, 0x0000, 0x0000,
+                0x7001, 0x00EE,                         // 230: depth 3
+            } },
+        };
+
+        return list;
+    }
+
+    const char* engineName(CpuEngine engine)
+    {
+        switch (engine)
+        {
+        case CpuEngine::Threaded:   return "threaded";
+        case CpuEngine::Recompiler: return "recompiler";
+        default:                    return "interpreter";
+        }
+    }
+
+    std::unique_ptr<Chip8> makeMachine(const Workload& workload, CpuEngine engine)
+    {
+        // Too big for the stack
+        auto chip8 { std::make_unique<Chip8>() };
+
+        if (!chip8->getCpu()->setEngine(engine))
+            return nullptr;
+
+        uint16_t address {Chip8Specs::ProgramStartAddress};
+        for (uint16_t word : workload.program)
+        {
+            chip8->writeMemory(address++, static_cast<uint8_t>(word >> 8u));
+            chip8->writeMemory(address++, static_cast<uint8_t>(word & 0xFFu));
+        }
+
+        return chip8;
+    }
+
+    std::map<std::string, double> measureOpcodeMix(const Workload& workload, uint64_t instructions)
+    {
+        auto chip8 { makeMachine(workload, CpuEngine::Interpreter) };
+        Cpu* cpu { chip8->getCpu() };
+        std::map<std::string, uint64_t> counts {};
+
+        for (uint64_t i {} ; i < instructions ; ++i)
+        {
+            uint16_t pc { cpu->getPC() };
+            uint16_t opcode { static_cast<uint16_t>((chip8->getMemoryAt(pc) << 8u) | chip8->getMemoryAt(pc + 1)) };
+
+            ++counts[opcodeFamilyName(opcodeFamilyOf(opcode))];
+            chip8->Cycle();
+        }
+
+        std::map<std::string, double> mix {};
+        for (const auto& [mnemonic, count] : counts)
+            mix[mnemonic] = static_cast<double>(count) / static_cast<double>(instructions);
+
+        return mix;
+    }
+
+    // Returns the best wall time of the repetitions, a negative
+    // value when the engine is not available on this build
+    double timeWorkload(const Workload& workload, CpuEngine engine, uint64_t instructions, int repeat)
+    {
+        double best {-1.0};
+
+        for (int run {} ; run < repeat ; ++run)
+        {
+            auto chip8 { makeMachine(workload, engine) };
+            if (!chip8) return -1.0;
+
+            uint64_t executed {};
+            auto start { std::chrono::steady_clock::now() };
+
+            while (executed < instructions)
+            {
+                uint32_t chunk { static_cast<uint32_t>(std::min<uint64_t>(instructions - executed, 1u << 20u)) };
+                uint32_t ran { chip8->Run(chunk) };
+                if (ran == 0) throw std::runtime_error("Error: workload halted : " + std::string(workload.name));
+                executed += ran;
+            }
+
+            double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+            if (best < 0.0 || seconds < best) best = seconds;
+        }
+
+        return best;
+    }
+
+    double mipsOf(const BenchResult& result)
+    {
+        return static_cast<double>(result.instructions) / result.seconds / 1e6;
+    }
+
+    double nsPerInstructionOf(const BenchResult& result)
+    {
+        return result.seconds * 1e9 / static_cast<double>(result.instructions);
+    }
+
+    void writeReport(const std::vector<BenchResult>& results, std::ostream& out)
+    {
+        out << std::left << std::setw(10) << "workload" << std::setw(13) << "engine"
+            << std::right << std::setw(14) << "instructions" << std::setw(11) << "seconds"
+            << std::setw(10) << "MIPS" << std::setw(11) << "ns/instr" << '\n';
+
+        for (const BenchResult& result : results)
+        {
+            out << std::left << std::setw(10) << result.workload << std::setw(13) << result.engine
+                << std::right << std::setw(14) << result.instructions
+                << std::fixed << std::setprecision(4) << std::setw(11) << result.seconds
+                << std::setprecision(1) << std::setw(10) << mipsOf(result)
+                << std::setprecision(2) << std::setw(11) << nsPerInstructionOf(result) << '\n';
+        }
+
+        // The mix does not depend on the engine, shown once per workload
+        out << "\nOpcode mix\n";
+        std::string last_workload {};
+
+        for (const BenchResult& result : results)
+        {
+            if (result.workload == last_workload) continue;
+            last_workload = result.workload;
+
+            std::vector<std::pair<std::string, double>> mix { result.opcode_mix.begin(), result.opcode_mix.end() };
+            std::sort(mix.begin(), mix.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+
+            out << std::left << std::setw(10) << result.workload;
+            for (const auto& [mnemonic, share] : mix)
+                out << ' ' << mnemonic << ' ' << std::fixed << std::setprecision(1) << share * 100.0 << '%';
+            out << '\n';
+        }
+    }
+
+    void writeJson(const std::vector<BenchResult>& results, uint64_t instructions, int repeat, std::ostream& out)
+    {
+        out << "{\n"
+            << "  \"instructions\": " << instructions << ",\n"
+            << "  \"repeat\": " << repeat << ",\n"
+#ifdef NDEBUG
+            << "  \"optimized\": true,\n"
+#else
+            << "  \"optimized\": false,\n"
+#endif
+            << "  \"results\": [\n";
+
+        for (size_t i {} ; i < results.size() ; ++i)
+        {
+            const BenchResult& result { results[i] };
+
+            out << "    {\n"
+                << "      \"workload\": \"" << result.workload << "\",\n"
+                << "      \"engine\": \"" << result.engine << "\",\n"
+                << "      \"instructions\": " << result.instructions << ",\n"
+                << std::setprecision(9) << std::defaultfloat
+                << "      \"seconds\": " << result.seconds << ",\n"
+                << "      \"mips\": " << mipsOf(result) << ",\n"
+                << "      \"ns_per_instruction\": " << nsPerInstructionOf(result) << ",\n"
+                << "      \"opcode_mix\": {";
+
+            size_t entry {};
+            for (const auto& [mnemonic, share] : result.opcode_mix)
+                out << (entry++ ? ", " : " ") << '"' << mnemonic << "\": " << share;
+
+            out << " }\n"
+                << "    }" << (i + 1 < results.size() ? "," : "") << '\n';
+        }
+
+        out << "  ]\n}\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t instructions {50'000'000};
+    int repeat {3};
+    std::vector<CpuEngine> engines {CpuEngine::Interpreter, CpuEngine::Threaded, CpuEngine::Recompiler};
+    std::string only_workload {};
+    std::string json_path {};
+
+    try {
+        for (int i {1} ; i < argc ; ++i)
+        {
+            std::string arg { argv[i] };
+
+            if (arg == "--instructions" && i + 1 < argc) instructions = std::stoull(argv[++i]);
+            else if (arg == "--repeat" && i + 1 < argc) repeat = std::max(std::stoi(argv[++i]), 1);
+            else if (arg == "--engine" && i + 1 < argc) engines = { engineFromName(argv[++i]) };
+            else if (arg == "--workload" && i + 1 < argc) only_workload = argv[++i];
+            else if (arg == "--json" && i + 1 < argc) json_path = argv[++i];
+            else
+            {
+                std::cerr << "Bench Usage: " << argv[0] << " [Options]" << '\n'
+                          << "Options:" << '\n'
+                          << "  --instructions <N>                           Instructions per run (default: 50000000)" << '\n'
+                          << "  --repeat <N>                                 Runs per measure, the best one is kept (default: 3)" << '\n'
+                          << "  --engine <interpreter|threaded|recompiler>   Only this engine (default: all available)" << '\n'
+                          << "  --workload <Name>                            Only this workload" << '\n'
+                          << "  --json <File>                                Also write the results as JSON" << '\n'
+                          << "Workloads:" << '\n';
+                for (const Workload& workload : workloads())
+                    std::cerr << "  " << std::left << std::setw(10) << workload.name << workload.description << '\n';
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (instructions == 0)
+            throw std::invalid_argument("Error: the instruction count must be positive");
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+#ifndef NDEBUG
+    std::cerr << "Warning: unoptimized build, configure with -DCMAKE_BUILD_TYPE=Release for meaningful numbers\n";
+#endif
+
+    // Engines missing from this build are left out
+    {
+        auto probe { std::make_unique<Chip8>() };
+        auto unavailable { [&probe](CpuEngine engine) {
+            if (probe->getCpu()->setEngine(engine)) return false;
+            std::cerr << "Skipping " << engineName(engine) << ": not available on this build\n";
+            return true;
+        } };
+        engines.erase(std::remove_if(engines.begin(), engines.end(), unavailable), engines.end());
+    }
+
+    std::vector<BenchResult> results {};
+
+    try {
+        for (const Workload& workload : workloads())
+        {
+            if (!only_workload.empty() && only_workload != workload.name) continue;
+
+            std::map<std::string, double> mix { measureOpcodeMix(workload, std::min<uint64_t>(instructions, 1'000'000)) };
+
+            for (CpuEngine engine : engines)
+            {
+                double seconds { timeWorkload(workload, engine, instructions, repeat) };
+                if (seconds < 0.0) continue;
+
+                results.push_back({ workload.name, engineName(engine), instructions, seconds, mix });
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (results.empty())
+    {
+        std::cerr << "Error: nothing to run\n";
+        return EXIT_FAILURE;
+    }
+
+    writeReport(results, std::cout);
+
+    if (!json_path.empty())
+    {
+        std::ofstream output(json_path);
+        if (!output.is_open())
+        {
+            std::cerr << "Error: failed to open output : " << json_path << "\n";
+            return EXIT_FAILURE;
+        }
+
+        writeJson(results, instructions, repeat, output);
+    }
+
+    return 0;
+}
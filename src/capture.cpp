@@ -0,0 +1,368 @@
+#include "capture.hpp"
+#include "save_state.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    // Gray levels of the 4 plane combinations
+    constexpr uint8_t PixelLevels[] {0, 255, 85, 170};
+    // Same levels, 2 bits per PNG pixel
+    constexpr uint8_t PngLevels[] {0, 3, 1, 2};
+
+    bool endsWith(const std::string& text, const std::string& suffix)
+    {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    // Screen pixel shown at (x, y) of a picture of scale size pixels
+    uint8_t pixelAt(const Screen& screen, int x, int y, int scale)
+    {
+        int pixel_size { scale * Chip8Specs::ScreenWidth / screen.width() };
+        return screen.pixelAt(x / pixel_size, y / pixel_size);
+    }
+
+    void putBigEndian32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        for (int shift {24} ; shift >= 0 ; shift -= 8)
+            out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+
+    uint32_t crc32(const uint8_t* data, size_t size)
+    {
+        static const std::array<uint32_t, 256> table { [] {
+            std::array<uint32_t, 256> values {};
+            for (uint32_t i {} ; i < 256 ; ++i)
+            {
+                uint32_t crc {i};
+                for (int bit {} ; bit < 8 ; ++bit)
+                    crc = (crc & 1u) ? 0xEDB88320u ^ (crc >> 1u) : crc >> 1u;
+                values[i] = crc;
+            }
+            return values;
+        }() };
+
+        uint32_t crc {0xFFFFFFFFu};
+        for (size_t i {} ; i < size ; ++i)
+            crc = table[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8u);
+
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    void putPngChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+    {
+        putBigEndian32(out, static_cast<uint32_t>(data.size()));
+
+        size_t start { out.size() };
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+
+        putBigEndian32(out, crc32(&out[start], out.size() - start));
+    }
+
+    // zlib stream made of stored (uncompressed) deflate blocks:
+    // the pictures are 1 or 2 bits per pixel, small enough as they are
+    std::vector<uint8_t> storedZlib(const std::vector<uint8_t>& data)
+    {
+        constexpr size_t MaxBlock {65535};
+        std::vector<uint8_t> out { 0x78, 0x01 };
+        size_t offset {};
+
+        do
+        {
+            size_t size { std::min(MaxBlock, data.size() - offset) };
+            bool last { offset + size == data.size() };
+
+            out.push_back(last ? 1 : 0);
+            out.push_back(static_cast<uint8_t>(size));
+            out.push_back(static_cast<uint8_t>(size >> 8u));
+            out.push_back(static_cast<uint8_t>(~size));
+            out.push_back(static_cast<uint8_t>(~size >> 8u));
+            out.insert(out.end(), data.begin() + static_cast<std::ptrdiff_t>(offset),
+                       data.begin() + static_cast<std::ptrdiff_t>(offset + size));
+
+            offset += size;
+        }
+        while (offset < data.size());
+
+        // Adler-32 of the uncompressed data
+        uint32_t a {1}, b {};
+        for (uint8_t byte : data)
+        {
+            a = (a + byte) % 65521u;
+            b = (b + a) % 65521u;
+        }
+        putBigEndian32(out, (b << 16u) | a);
+
+        return out;
+    }
+}
+
+FrameCapture::FrameCapture(const std::string& video_path, const std::string& audio_path, int scale,
+                           bool extended_screen)
+    : scale {std::clamp(scale, 1, CaptureSpecs::MaxScale)}, extended {extended_screen}
+{
+    // High resolution pixels are half a low resolution one
+    if (extended) this->scale += this->scale % 2;
+
+    int width { Chip8Specs::ScreenWidth * this->scale };
+    int height { Chip8Specs::ScreenHeight * this->scale };
+
+    if (endsWith(video_path, ".y4m"))
+    {
+        format = VideoFormat::Y4m;
+        video_file.open(video_path, std::ios::binary);
+        if (!video_file.is_open())
+            throw std::runtime_error("Error: failed to open capture : " + video_path);
+
+        // Grayscale, 60 frames per second
+        video_file << "YUV4MPEG2 W" << width << " H" << height << " F60:1 Ip A1:1 Cmono\n";
+    }
+    else if (!video_path.empty())
+    {
+        format = VideoFormat::Png;
+        png_directory = video_path;
+
+        std::error_code error {};
+        std::filesystem::create_directories(png_directory, error);
+        if (!std::filesystem::is_directory(png_directory))
+            throw std::runtime_error("Error: failed to create capture directory : " + video_path);
+    }
+
+    if (!audio_path.empty())
+    {
+        audio_file.open(audio_path, std::ios::binary);
+        if (!audio_file.is_open())
+            throw std::runtime_error("Error: failed to open capture : " + audio_path);
+
+        // Sizes are patched on Close
+        writeWavHeader();
+    }
+
+    encoder = std::thread(&FrameCapture::Encode, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    try {
+        Close();
+    } catch (const std::exception&) {
+        // Reported by an explicit Close only
+    }
+}
+
+uint64_t FrameCapture::getFrameCount() { return pushed_frames; }
+
+void FrameCapture::Push(const Screen& screen, bool sound_active, const AudioPattern& pattern)
+{
+    ++pushed_frames;
+
+    if (has_pending && pending.sound_active == sound_active
+        && pending.screen == screen && pending.pattern == pattern)
+    {
+        ++pending.frame_count;
+        return;
+    }
+
+    if (has_pending) enqueue(pending);
+
+    pending.screen = screen;
+    pending.sound_active = sound_active;
+    pending.pattern = pattern;
+    pending.frame_count = 1;
+    has_pending = true;
+}
+
+void FrameCapture::enqueue(const Chunk& chunk)
+{
+    std::unique_lock<std::mutex> lock {mutex};
+
+    // The encoder is behind, wait instead of dropping frames
+    changed.wait(lock, [this] { return queue.size() < CaptureSpecs::QueueDepth; });
+
+    queue.push_back(chunk);
+    changed.notify_all();
+}
+
+void FrameCapture::Close()
+{
+    if (!encoder.joinable()) return;
+
+    if (has_pending)
+    {
+        enqueue(pending);
+        has_pending = false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+        closing = true;
+    }
+    changed.notify_all();
+    encoder.join();
+
+    if (audio_file.is_open())
+    {
+        audio_file.seekp(0);
+        writeWavHeader();
+        audio_file.close();
+    }
+
+    if (video_file.is_open()) video_file.close();
+
+    if (video_file.fail() || audio_file.fail())
+        throw std::runtime_error("Error: failed to write capture");
+}
+
+void FrameCapture::Encode()
+{
+    while (true)
+    {
+        Chunk chunk {};
+
+        {
+            std::unique_lock<std::mutex> lock {mutex};
+            changed.wait(lock, [this] { return !queue.empty() || closing; });
+
+            if (queue.empty()) return;
+
+            chunk = queue.front();
+            queue.pop_front();
+        }
+        changed.notify_all();
+
+        encodeVideo(chunk);
+        encodeAudio(chunk);
+    }
+}
+
+void FrameCapture::encodeVideo(const Chunk& chunk)
+{
+    if (format == VideoFormat::Y4m)
+    {
+        encodeY4mFrame(chunk.screen);
+
+        // Identical frames are the same bytes again
+        for (uint32_t i {} ; i < chunk.frame_count ; ++i)
+            video_file.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+    }
+    else if (format == VideoFormat::Png)
+        encodePng(chunk.screen);
+
+    encoded_frames += chunk.frame_count;
+}
+
+void FrameCapture::encodeY4mFrame(const Screen& screen)
+{
+    static const char frame_header[] {"FRAME\n"};
+    int width { Chip8Specs::ScreenWidth * scale };
+    int height { Chip8Specs::ScreenHeight * scale };
+
+    encoded.assign(frame_header, frame_header + sizeof(frame_header) - 1);
+    encoded.reserve(encoded.size() + static_cast<size_t>(width * height));
+
+    for (int y {} ; y < height ; ++y)
+        for (int x {} ; x < width ; ++x)
+            encoded.push_back(PixelLevels[pixelAt(screen, x, y, scale)]);
+}
+
+void FrameCapture::encodePng(const Screen& screen)
+{
+    int width { Chip8Specs::ScreenWidth * scale };
+    int height { Chip8Specs::ScreenHeight * scale };
+    // 2 bits per pixel for the planes
+    int depth { extended ? 2 : 1 };
+    int pixels_per_byte { 8 / depth };
+    size_t row_bytes { static_cast<size_t>(width * depth + 7) / 8 };
+
+    // Grayscale rows, each one preceded by its filter type (none)
+    std::vector<uint8_t> rows((row_bytes + 1) * static_cast<size_t>(height));
+
+    for (int y {} ; y < height ; ++y)
+    {
+        uint8_t* row { &rows[(row_bytes + 1) * static_cast<size_t>(y) + 1] };
+
+        for (int x {} ; x < width ; ++x)
+        {
+            uint8_t level { PngLevels[pixelAt(screen, x, y, scale)] };
+            if (depth == 1) level = level ? 1 : 0;
+
+            int shift { 8 - depth * (x % pixels_per_byte + 1) };
+            row[x / pixels_per_byte] |= static_cast<uint8_t>(level << shift);
+        }
+    }
+
+    std::vector<uint8_t> header {};
+    putBigEndian32(header, static_cast<uint32_t>(width));
+    putBigEndian32(header, static_cast<uint32_t>(height));
+    // Grayscale, deflate, no filter, no interlace
+    header.insert(header.end(), { static_cast<uint8_t>(depth), 0, 0, 0, 0 });
+
+    static const uint8_t signature[] { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    encoded.assign(std::begin(signature), std::end(signature));
+    putPngChunk(encoded, "IHDR", header);
+    putPngChunk(encoded, "IDAT", storedZlib(rows));
+    putPngChunk(encoded, "IEND", {});
+
+    std::ostringstream name;
+    name << "frame_" << std::setw(6) << std::setfill('0') << encoded_frames << ".png";
+
+    std::ofstream file(png_directory / name.str(), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+
+    // Reported on Close through the video stream state
+    if (!file) video_file.setstate(std::ios::failbit);
+}
+
+void FrameCapture::encodeAudio(const Chunk& chunk)
+{
+    if (!audio_file.is_open()) return;
+
+    samples.resize(CaptureSpecs::SamplesPerFrame);
+
+    if (chunk.pattern != tone_pattern)
+    {
+        tone_pattern = chunk.pattern;
+        tone.SetPattern(tone_pattern);
+    }
+
+    // Frame by frame, a long silence does not need a long buffer
+    for (uint32_t i {} ; i < chunk.frame_count ; ++i)
+    {
+        tone.Generate(samples.data(), CaptureSpecs::SamplesPerFrame, chunk.sound_active);
+
+        std::vector<uint8_t> bytes {};
+        StateWriter writer {bytes};
+        for (int16_t sample : samples) writer.put16(static_cast<uint16_t>(sample));
+
+        audio_file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        audio_samples += samples.size();
+    }
+}
+
+void FrameCapture::writeWavHeader()
+{
+    uint32_t data_size { static_cast<uint32_t>(audio_samples * sizeof(int16_t)) };
+    std::vector<uint8_t> header {};
+    StateWriter writer {header};
+
+    writer.putBytes(reinterpret_cast<const uint8_t*>("RIFF"), 4);
+    writer.put32(36 + data_size);
+    writer.putBytes(reinterpret_cast<const uint8_t*>("WAVEfmt "), 8);
+    writer.put32(16);
+    // PCM, mono, 16 bits
+    writer.put16(1);
+    writer.put16(1);
+    writer.put32(CaptureSpecs::SampleRate);
+    writer.put32(CaptureSpecs::SampleRate * sizeof(int16_t));
+    writer.put16(sizeof(int16_t));
+    writer.put16(16);
+    writer.putBytes(reinterpret_cast<const uint8_t*>("data"), 4);
+    writer.put32(data_size);
+
+    audio_file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+}
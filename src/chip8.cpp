@@ -1,10 +1,12 @@
 #include "chip8.hpp"
+#include "rom_image.hpp"
+#include "save_state.hpp"
 
-#include <fstream>
-#include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
-Chip8::Chip8()
+Chip8::Chip8() : memory(Chip8Specs::ClassicMemorySize)
 {
     // Load all fonts into memory
     for(uint i {} ; i < Chip8Specs::FontsetSize; ++i)
@@ -17,57 +19,265 @@ Chip8::Chip8()
 }
 
 // Accessors
-uint32_t* Chip8::getVideo() { return video; }
+MachineModel machineModelFromName(const std::string& name)
+{
+    if (name == "chip8")  return MachineModel::Chip8;
+    if (name == "schip")  return MachineModel::Schip;
+    if (name == "xochip") return MachineModel::XoChip;
+
+    throw std::invalid_argument("Error: unknown machine model : " + name);
+}
+
+const char* machineModelName(MachineModel model)
+{
+    switch (model)
+    {
+    case MachineModel::Schip:  return "schip";
+    case MachineModel::XoChip: return "xochip";
+    default:                   return "chip8";
+    }
+}
+
+void Chip8::setModel(MachineModel value)
+{
+    model = value;
+    memory_size = memorySizeOf(value);
+    memory.resize(static_cast<size_t>(memory_size));
+
+    // The big font only exists on the extended models
+    for(uint i {} ; i < Chip8Specs::BigFontsetSize; ++i)
+        memory[Chip8Specs::BigFontSetStartAddress + i] = (value == MachineModel::Chip8) ? 0 : Chip8Specs::BigFontSet[i];
+
+    screen = Screen {};
+    plane_mask = 1;
+    markVideoDirty(0, Chip8Specs::HiresScreenHeight);
+
+    cpu.setModel(value);
+    cpu.setQuirks(defaultQuirksOf(value));
+}
+
+MachineModel Chip8::getModel() { return model; }
+
+uint64_t* Chip8::getVideo() { return screen.left(0); }
+Screen& Chip8::getScreen() { return screen; }
+bool Chip8::isHires() { return screen.hires; }
+uint8_t Chip8::getPlaneMask() { return plane_mask; }
+uint8_t* Chip8::getRplFlags() { return rpl_flags; }
+const AudioPattern& Chip8::getAudioPattern() { return audio_pattern; }
+uint32_t Chip8::getVideoVersion() { return video_version; }
+uint64_t Chip8::getDirtyRows() { return dirty_rows; }
 uint8_t* Chip8::getKeypad() { return keypad; }
 uint16_t Chip8::getIndexRegister() { return index_register; }
+uint64_t Chip8::getOutOfBoundsAccesses() { return out_of_bounds_accesses; }
 
 uint8_t Chip8::getMemoryAt(uint16_t index)
 {
-    if (index >= Chip8Specs::MemorySize)
+    if (index >= memory_size)
     {
-        std::cout << "Read out of bounds at address: " << std::hex << index << "\n";
+        ++out_of_bounds_accesses;
         return 0;
     }
 
     return memory[index];
 }
 
+void Chip8::writeMemory(uint16_t index, uint8_t value)
+{
+    // Dropped, like the reads past the end
+    if (index >= memory_size)
+    {
+        ++out_of_bounds_accesses;
+        return;
+    }
+
+    memory[index] = value;
+    cpu.invalidateDecoded(index);
+}
+
 uint8_t Chip8::getDelayTimer() { return delay_timer; }
 uint8_t Chip8::getSoundTimer() { return sound_timer; }
 uint8_t Chip8::getRandomByte() { return random_device.get(); }
+Cpu* Chip8::getCpu() { return &cpu; }
 
 // Mutators
 void Chip8::setIndexRegister(uint16_t value) { index_register = value; }
-void Chip8::writeMemory(uint16_t index, uint8_t value) { memory[index] = value; }
 void Chip8::setDelayTimer(uint8_t value) { delay_timer = value; }
 void Chip8::setSoundTimer(uint8_t value) { sound_timer = value; }
+void Chip8::setSeed(uint64_t seed) { random_device.seed(seed); }
 void Chip8::setKeypad(int index, uint8_t value) { keypad[index] = value; }
+void Chip8::setPlaneMask(uint8_t value) { plane_mask = value; }
+void Chip8::setPitch(uint8_t value) { audio_pattern.pitch = value; }
+
+void Chip8::setHires(bool value)
+{
+    // Both modes start from a blank screen
+    screen = Screen {};
+    screen.hires = value;
+
+    markVideoDirty(0, Chip8Specs::HiresScreenHeight);
+}
+
+void Chip8::loadAudioPattern()
+{
+    for(int i {} ; i < Chip8Specs::AudioPatternSize ; ++i)
+        audio_pattern.bits[i] = getMemoryAt(index_register + i);
+
+    audio_pattern.enabled = true;
+}
+
+void Chip8::markVideoDirty(int first_row, int row_count)
+{
+    ++video_version;
+
+    // Rows wrap around the bottom of the screen
+    int height { screen.height() };
+    for(int i {} ; i < row_count && i < height ; ++i)
+        dirty_rows |= uint64_t {1} << ((first_row + i) % height);
+}
+
+void Chip8::clearDirtyRows() { dirty_rows = 0; }
 
 void Chip8::loadRomIntoMemory(const std::string& filename)
 {
-    // Open the file in binary mode
-    std::ifstream rom(filename, std::ios::binary);
-    if(!rom.is_open())
-        throw std::runtime_error("Error: failed to open ROM : " + filename);
+    // Mapped, copied once into memory below
+    RomImage rom {filename};
+    loadRom(rom.data(), rom.size());
+}
+
+void Chip8::loadRom(const uint8_t* data, size_t size)
+{
+    size_t capacity { static_cast<size_t>(memory_size - Chip8Specs::ProgramStartAddress) };
+    if (size > capacity)
+        throw std::runtime_error("Error: ROM too large for the " + std::string(machineModelName(model))
+                                 + " model : " + std::to_string(size) + " bytes, "
+                                 + std::to_string(capacity) + " available");
+
+    if (size > 0) std::memcpy(memory.data() + Chip8Specs::ProgramStartAddress, data, size);
+
+    // Anything decoded before belongs to the previous program
+    cpu.invalidateDecodedCache();
+}
+
+void Chip8::saveState(std::vector<uint8_t>& state)
+{
+    state.clear();
+
+    StateWriter writer {state};
+    writer.putBytes(SaveStateSpecs::Magic, sizeof(SaveStateSpecs::Magic));
+    writer.put16(SaveStateSpecs::Version);
+
+    writer.put8(static_cast<uint8_t>(model));
+    writer.putBytes(memory.data(), memory.size());
+    writer.put16(index_register);
+    writer.put8(delay_timer);
+    writer.put8(sound_timer);
+
+    // One bit per key
+    uint16_t keys {};
+    for(int i {} ; i < Chip8Specs::KeysCount ; ++i)
+        if(keypad[i]) keys |= 1u << i;
+    writer.put16(keys);
+
+    // Only the rows of the resolution in use and the planes of the
+    // model can hold pixels, the rest of the screen is always blank
+    writer.put8(screen.hires ? 1 : 0);
+    writer.put8(plane_mask);
+    for(int plane {} ; plane < planeCountOf(model) ; ++plane)
+    {
+        for(int y {} ; y < screen.height() ; ++y)
+            writer.put64(screen.left(plane)[y]);
+        if(screen.hires)
+            for(int y {} ; y < screen.height() ; ++y)
+                writer.put64(screen.right(plane)[y]);
+    }
+
+    writer.putBytes(rpl_flags, sizeof(rpl_flags));
+    writer.putBytes(audio_pattern.bits, sizeof(audio_pattern.bits));
+    writer.put8(audio_pattern.pitch);
+    writer.put8(audio_pattern.enabled ? 1 : 0);
+
+    cpu.saveState(writer);
+    random_device.saveState(writer);
+}
 
-    // Get the size of the rom file
-    rom.seekg(0, std::ios::end);
-    std::streamsize rom_size = static_cast<std::streamsize>(rom.tellg());
-    rom.seekg(0, std::ios::beg);
+void Chip8::loadState(const std::vector<uint8_t>& state)
+{
+    StateReader reader {state.data(), state.size()};
+
+    uint8_t magic[sizeof(SaveStateSpecs::Magic)] {};
+    reader.getBytes(magic, sizeof(magic));
+    if(!std::equal(std::begin(magic), std::end(magic), std::begin(SaveStateSpecs::Magic)))
+        throw std::runtime_error("Error: not a save state");
+
+    uint16_t version { reader.get16() };
+    if(version != SaveStateSpecs::Version)
+        throw std::runtime_error("Error: unsupported save state version : " + std::to_string(version));
+
+    // The memory size depends on it
+    uint8_t state_model { reader.get8() };
+    if(state_model != static_cast<uint8_t>(model))
+        throw std::runtime_error("Error: save state of another machine model");
+
+    // Restored on failure, so a bad blob leaves the machine as it was
+    std::vector<uint8_t> backup {};
+    saveState(backup);
+
+    try {
+        reader.getBytes(memory.data(), memory.size());
+        index_register = reader.get16();
+        delay_timer = reader.get8();
+        sound_timer = reader.get8();
+
+        uint16_t keys { reader.get16() };
+        for(int i {} ; i < Chip8Specs::KeysCount ; ++i)
+            keypad[i] = (keys >> i) & 1u;
+
+        screen = Screen {};
+        screen.hires = reader.get8() != 0;
+        plane_mask = reader.get8();
+        if(plane_mask >= (1u << Chip8Specs::PlaneCount))
+            throw std::runtime_error("Error: invalid plane mask in save state");
+
+        for(int plane {} ; plane < planeCountOf(model) ; ++plane)
+        {
+            for(int y {} ; y < screen.height() ; ++y)
+                screen.left(plane)[y] = reader.get64();
+            if(screen.hires)
+                for(int y {} ; y < screen.height() ; ++y)
+                    screen.right(plane)[y] = reader.get64();
+        }
 
-    // Dump rom content into a buffer
-    char* buffer = new char[rom_size];
-    rom.read(buffer, rom_size);
+        reader.getBytes(rpl_flags, sizeof(rpl_flags));
+        reader.getBytes(audio_pattern.bits, sizeof(audio_pattern.bits));
+        audio_pattern.pitch = reader.get8();
+        audio_pattern.enabled = reader.get8() != 0;
 
-    // Copy rom content into memory
-    for(std::streamsize i {} ; i < rom_size ; ++i)
-        memory[Chip8Specs::ProgramStartAddress + i] = buffer[i];
+        cpu.loadState(reader);
+        random_device.loadState(reader);
+
+        if(!reader.atEnd())
+            throw std::runtime_error("Error: trailing data in save state");
+    } catch (const std::exception&) {
+        loadState(backup);
+        throw;
+    }
+
+    // The whole screen has to be presented again
+    markVideoDirty(0, Chip8Specs::HiresScreenHeight);
 }
 
 void Chip8::Cycle()
 {
     cpu.Cycle();
+}
 
+uint32_t Chip8::Run(uint32_t max_instructions)
+{
+    return cpu.Run(max_instructions);
+}
+
+void Chip8::TickTimers()
+{
     if(delay_timer > 0) --delay_timer;
     if(sound_timer > 0) --sound_timer;
 }
@@ -1,19 +1,320 @@
 #include "cpu.hpp"
 #include "chip8.hpp"
+#include "cpu_access.hpp"
+#include "instructions.hpp"
 #include "masks.hpp"
+#include "profiler.hpp"
+#include "recompiler.hpp"
+#include "save_state.hpp"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <stdexcept>
 
-Cpu::Cpu()
+namespace
+{
+    using Instructions::rotateRight;
+
+    // Sprite row placed at the left edge of a screen row, moved to
+    // column x. A high resolution row spans two words, the bits cross
+    // from the left one to the right one. Pixels past the right
+    // edge are dropped or wrap around
+    template <bool Clips>
+    void placeSpriteRow(uint64_t bits, unsigned int x, bool wide_row, uint64_t& left, uint64_t& right)
+    {
+        if (!wide_row)
+        {
+            left = Clips ? bits >> x : rotateRight(bits, x);
+            right = 0;
+            return;
+        }
+
+        // The right word starts empty, so a 128-bit rotation
+        // by 64 or more is the same as a shift
+        uint64_t high {bits};
+        uint64_t low {};
+        if (x >= 64)
+        {
+            low = high;
+            high = 0;
+            x -= 64;
+        }
+
+        if (x > 0)
+        {
+            uint64_t wrapped { Clips ? 0 : low << (64u - x) };
+            low = (low >> x) | (high << (64u - x));
+            high = (high >> x) | wrapped;
+        }
+
+        left = high;
+        right = low;
+    }
+
+    // Moves the rows of one half of a plane by offset rows, down
+    // when positive. Rows scrolled in are blank
+    void scrollRows(uint64_t* rows, int height, int offset)
+    {
+        int distance { std::min(std::abs(offset), height) };
+
+        if (offset > 0)
+        {
+            std::memmove(rows + distance, rows, static_cast<size_t>(height - distance) * sizeof(uint64_t));
+            std::fill(rows, rows + distance, 0);
+        }
+        else
+        {
+            std::memmove(rows, rows + distance, static_cast<size_t>(height - distance) * sizeof(uint64_t));
+            std::fill(rows + height - distance, rows + height, 0);
+        }
+    }
+}
+
+Cpu::Cpu() : decoded_cache(Chip8Specs::ClassicMemorySize), block_coverage(Chip8Specs::ClassicMemorySize)
 {
     // Initialize the program counter
     setPC(Chip8Specs::ProgramStartAddress);
     dispatchInstructions();
 }
 
+Cpu::~Cpu() = default;
+
 void Cpu::setSystem(Chip8* sys) { system = sys; }
 void Cpu::setPC(uint16_t value) { pc = value; }
+CpuEngine Cpu::getEngine() { return engine; }
+
+bool Cpu::setProfiler(Profiler* value)
+{
+    if (!ProfilerSpecs::Enabled) return value == nullptr;
+
+    // The engine in use may change, as for setEngine
+    blocks_flush_pending = true;
+
+    profiler = value;
+    return true;
+}
+
+QuirkProfile quirkProfileFromName(const std::string& name)
+{
+    if (name == "vip")    return QuirkProfile::Vip;
+    if (name == "chip48") return QuirkProfile::Chip48;
+    if (name == "schip")  return QuirkProfile::Schip;
+    if (name == "xochip") return QuirkProfile::XoChip;
+
+    throw std::invalid_argument("Error: unknown quirk profile : " + name);
+}
+
+const char* quirkProfileName(QuirkProfile profile)
+{
+    switch (profile)
+    {
+    case QuirkProfile::Chip48: return "chip48";
+    case QuirkProfile::Schip:  return "schip";
+    case QuirkProfile::XoChip: return "xochip";
+    default:                   return "vip";
+    }
+}
+
+CpuEngine engineFromName(const std::string& name)
+{
+    if (name == "interpreter") return CpuEngine::Interpreter;
+    if (name == "threaded")    return CpuEngine::Threaded;
+    if (name == "recompiler")  return CpuEngine::Recompiler;
+
+    throw std::invalid_argument("Error: unknown engine : " + name);
+}
+
+bool Cpu::setEngine(CpuEngine value)
+{
+    if (value == CpuEngine::Threaded && !isThreadedSupported())
+        return false;
+
+    if (value == CpuEngine::Recompiler)
+    {
+        if (!recompiler) recompiler = std::make_unique<Recompiler>(this, system);
+        if (!recompiler->isAvailable()) return false;
+    }
+
+    // Blocks built by another engine may be stale by now
+    blocks_flush_pending = true;
+
+    engine = value;
+    return true;
+}
+
+void Cpu::setQuirks(QuirkProfile value)
+{
+    quirks = value;
+    dispatchInstructions();
+
+    // Decoded entries and blocks hold the previous handlers
+    invalidateDecodedCache();
+}
+
+QuirkProfile Cpu::getQuirks() { return quirks; }
+
+void Cpu::setModel(MachineModel value)
+{
+    model = value;
+    memory_size = memorySizeOf(value);
+    dispatchInstructions();
+
+    // The per-address tables follow the memory size, the
+    // threaded blocks are allocated again on first use
+    decoded_cache.assign(static_cast<size_t>(memory_size), DecodedInstruction {});
+    block_coverage.assign(static_cast<size_t>(memory_size), 0);
+    blocks.clear();
+    invalidateDecodedCache();
+}
+
+MachineModel Cpu::getModel() { return model; }
+
+uint8_t Cpu::getRegister(uint8_t index) { return registers[index]; }
+uint16_t Cpu::getPC() { return pc; }
+uint8_t Cpu::getSP() { return sp; }
+bool Cpu::isHalted() { return halted; }
+
+bool Cpu::isWaitingForKey()
+{
+    return (wordAt(pc) & 0xF0FFu) == 0xF00Au;
+}
+
+// === Idle detection ===
+
+namespace
+{
+    // Whether the 3xkk/4xkk test of a timer loop skips the jump back
+    bool leavesTimerLoop(uint16_t test, uint8_t value)
+    {
+        uint8_t byte { static_cast<uint8_t>(test & MASK_LOWER_8BITS) };
+        return ((test >> 12u) == 0x3) ? (value == byte) : (value != byte);
+    }
+}
+
+uint16_t Cpu::wordAt(uint32_t address)
+{
+    if (address + 1 >= static_cast<uint32_t>(memory_size)) return 0;
+
+    return static_cast<uint16_t>((system->getMemoryAt(address) << 8u) | system->getMemoryAt(address + 1));
+}
+
+bool Cpu::findTimerLoop(TimerLoop& loop)
+{
+    for (int position {} ; position < 3 ; ++position)
+    {
+        int start { pc - 2 * position };
+        // The jump back only reaches the first 4 KB
+        if (start < 0 || start > MASK_OPC_ADDR) continue;
+
+        uint16_t load { wordAt(start) };
+        uint16_t test { wordAt(start + 2) };
+        uint16_t jump { wordAt(start + 4) };
+        uint8_t x { static_cast<uint8_t>((load & MASK_OPC_VX) >> 8u) };
+
+        if ((load & 0xF0FFu) != 0xF007u) continue;
+        if (((test >> 12u) != 0x3 && (test >> 12u) != 0x4) || ((test & MASK_OPC_VX) >> 8u) != x) continue;
+        if (jump != (0x1000u | start)) continue;
+
+        loop = { static_cast<uint16_t>(start), x, position, test };
+        return true;
+    }
+
+    return false;
+}
+
+bool Cpu::isKeyWaitIdle()
+{
+    const uint8_t* keypad { system->getKeypad() };
+
+    // Still holding the key, Fx0A waits for its release
+    if (key_wait_pressed) return keypad[key_wait_key] != 0;
+
+    // A key down would be taken by the next Fx0A
+    return std::none_of(keypad, keypad + Chip8Specs::KeysCount, [](uint8_t key) { return key != 0; });
+}
+
+bool Cpu::isTimerLoopIdle(const TimerLoop& loop)
+{
+    uint8_t delay { system->getDelayTimer() };
+
+    // The test may still see the value loaded before the last tick
+    if (loop.position == 1 && leavesTimerLoop(loop.test, registers[loop.x])) return false;
+
+    return !leavesTimerLoop(loop.test, delay);
+}
+
+bool Cpu::isIdle()
+{
+    if (halted) return false;
+
+    if (isWaitingForKey()) return isKeyWaitIdle();
+
+    TimerLoop loop {};
+    return findTimerLoop(loop) && isTimerLoopIdle(loop);
+}
+
+uint32_t Cpu::SkipIdle(uint32_t max_instructions)
+{
+    if (halted || max_instructions == 0) return 0;
+
+    // Fx0A goes back onto itself, nothing else changes
+    if (isWaitingForKey()) return isKeyWaitIdle() ? max_instructions : 0;
+
+    TimerLoop loop {};
+    if (!findTimerLoop(loop) || !isTimerLoopIdle(loop)) return 0;
+
+    // Where the loop would stand after max_instructions, the
+    // only register written is vx, with the delay timer
+    uint32_t first_load { static_cast<uint32_t>((3 - loop.position) % 3) };
+    if (max_instructions > first_load) registers[loop.x] = system->getDelayTimer();
+
+    int last { static_cast<int>((loop.position + (max_instructions - 1) % 3) % 3) };
+    pc = loop.start + 2 * ((last + 1) % 3);
+
+    return max_instructions;
+}
+
+void Cpu::saveState(StateWriter& writer)
+{
+    writer.putBytes(registers, sizeof(registers));
+    writer.put16(pc);
+
+    for(uint16_t address : stack)
+        writer.put16(address);
+
+    writer.put8(sp);
+    writer.put8(halted ? 1 : 0);
+    writer.put8(key_wait_pressed ? 1 : 0);
+    writer.put8(key_wait_key);
+}
+
+void Cpu::loadState(StateReader& reader)
+{
+    reader.getBytes(registers, sizeof(registers));
+    pc = reader.get16();
+
+    for(uint16_t& address : stack)
+        address = reader.get16();
+
+    sp = reader.get8();
+    halted = reader.get8() != 0;
+    key_wait_pressed = reader.get8() != 0;
+    key_wait_key = reader.get8();
+
+    // Both index arrays, a corrupted blob must not reach them.
+    // The stack is a ring, sp stays below its depth
+    if(sp >= Chip8Specs::StackDepth)
+        throw std::runtime_error("Error: invalid stack pointer in save state");
+    if(key_wait_key >= Chip8Specs::KeysCount)
+        throw std::runtime_error("Error: invalid key in save state");
+
+    // Memory was replaced as well
+    invalidateDecodedCache();
+
+    if (profiler) profiler->ResetCallStack();
+}
 
 // Used to get Register X address value
 uint8_t Cpu::extractVx(uint16_t mask)
@@ -27,6 +328,11 @@ uint8_t Cpu::extractVy(uint16_t mask)
 }
 
 // === Instructions ===
+/*
+    The CHIP-8 instructions run the semantics shared with the
+    threaded engine and the vector machine (instructions.hpp),
+    the display and extended instructions are Cpu's own
+*/
 
 // Arithmetic and logical instructions
 // between registers x and y
@@ -34,110 +340,69 @@ uint8_t Cpu::extractVy(uint16_t mask)
 // LD vx, vy
 void Cpu::opc_8xy0() 
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    registers[vx] = registers[vy];
+    Access<> machine {*this};
+    Instructions::opc_8xy0(machine, current->x, current->y);
 }
 
 // OR vx, vy
+template <QuirkProfile Profile>
 void Cpu::opc_8xy1()
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    registers[vx] |= registers[vy];
-    registers[0xF] = 0;
+    Access<> machine {*this};
+    Instructions::opc_8xy1<Profile>(machine, current->x, current->y);
 }
 
 // AND vx, vy
+template <QuirkProfile Profile>
 void Cpu::opc_8xy2()
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    registers[vx] &= registers[vy];
-    registers[0xF] = 0;
+    Access<> machine {*this};
+    Instructions::opc_8xy2<Profile>(machine, current->x, current->y);
 }
 
 // XOR vx, vy
+template <QuirkProfile Profile>
 void Cpu::opc_8xy3()
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    registers[vx] ^= registers[vy];
-    registers[0xF] = 0;
+    Access<> machine {*this};
+    Instructions::opc_8xy3<Profile>(machine, current->x, current->y);
 }
 
 // ADD vx, vy
 void Cpu::opc_8xy4()
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    uint16_t sum { static_cast<uint16_t>(registers[vx] + registers[vy]) };
-
-    registers[vx] = sum & MASK_LOWER_8BITS;
-
-    // Register vf will carry a flag if the sum overflows 255
-    registers[0xF] = (sum > MASK_LOWER_8BITS) ? 1 : 0;
+    Access<> machine {*this};
+    Instructions::opc_8xy4(machine, current->x, current->y);
 }
 
 // SUB vx, vy
 void Cpu::opc_8xy5()
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    uint8_t tmp { registers[vx] };
-
-    registers[vx] -= registers[vy];
-
-    // Register vf is set to 1 if vx > vy
-    registers[0xF] = (tmp >= registers[vy]) ? 1 : 0;
+    Access<> machine {*this};
+    Instructions::opc_8xy5(machine, current->x, current->y);
 }
 
-// SHR vx
+// SHR vx {, vy}
+template <QuirkProfile Profile>
 void Cpu::opc_8xy6()
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    uint8_t old_vx { registers[vx] };
-
-    uint8_t shifted_vy { registers[vy] >>= 1 };
-
-    registers[vx] = shifted_vy;
-
-    // Save least significant bit 
-    registers[0xF] = (old_vx & MASK_LSB);
+    Access<> machine {*this};
+    Instructions::opc_8xy6<Profile>(machine, current->x, current->y);
 }
 
 // SUBN vx, vy
 void Cpu::opc_8xy7()
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    registers[vx] = registers[vy] - registers[vx];
-
-    registers[0xF] = (registers[vy] >= registers[vx]) ? 1 : 0;
+    Access<> machine {*this};
+    Instructions::opc_8xy7(machine, current->x, current->y);
 }
 
-// SHL vx
+// SHL vx {, vy}
+template <QuirkProfile Profile>
 void Cpu::opc_8xyE()
 {
-    uint8_t vx {extractVx(MASK_OPC_VX)};
-    uint8_t vy {extractVy(MASK_OPC_VY)};
-
-    uint8_t old_vx { registers[vx] };
-
-    uint8_t shifted_vy { registers[vy] <<= 1 };
-
-    registers[vx] = shifted_vy;
-
-    registers[0xF] = (old_vx & MASK_MSB) >> 7u;
+    Access<> machine {*this};
+    Instructions::opc_8xyE<Profile>(machine, current->x, current->y);
 }
 
 // Machine instructions
@@ -149,17 +414,24 @@ void Cpu::opc_8xyE()
 */
 
 // CLS
+// Clears the selected planes (only plane 0 before XO-CHIP)
 void Cpu::opc_00E0()
 {
-    uint32_t* video { system->getVideo() };
-    constexpr size_t buffer_size { Chip8Specs::ScreenWidth * Chip8Specs::ScreenHeight };
-    std::memset(video, 0, buffer_size * sizeof(uint32_t));
+    Screen& screen { system->getScreen() };
+    uint8_t plane_mask { system->getPlaneMask() };
+
+    for(int plane {} ; plane < Chip8Specs::PlaneCount ; ++plane)
+        if(plane_mask & (1u << plane))
+            std::fill(std::begin(screen.planes[plane]), std::end(screen.planes[plane]), 0);
+
+    system->markVideoDirty(0, screen.height());
 }
 
 // RET
 void Cpu::opc_00EE()
 {
-    pc = stack[--sp];
+    Access<> machine {*this};
+    Instructions::opc_00EE(machine);
 }
 
 /*
@@ -171,66 +443,74 @@ void Cpu::opc_00EE()
 // JP addr
 void Cpu::opc_1nnn()
 {
-    uint16_t address { static_cast<uint16_t>(opcode & MASK_OPC_ADDR) };
-    pc = address;
+    Access<> machine {*this};
+    Instructions::opc_1nnn(machine, current->address);
 }
 
 // CALL addr
 void Cpu::opc_2nnn()
 {
-    uint16_t address { static_cast<uint16_t>(opcode & MASK_OPC_ADDR) };
+    Access<> machine {*this};
+    Instructions::opc_2nnn(machine, current->address);
+}
 
-    stack[sp] = pc;
-    ++sp;
-    pc = address;
+template <MachineModel Model>
+void Cpu::skipNextInstruction()
+{
+    if constexpr (Model == MachineModel::XoChip)
+    {
+        if(system->getMemoryAt(pc) == 0xF0 && system->getMemoryAt(pc + 1) == 0x00)
+        {
+            pc += 4;
+            return;
+        }
+    }
+
+    pc += 2;
 }
 
 // SE vx, byte
 // Skip instruction if vx = kk
+template <MachineModel Model>
 void Cpu::opc_3xkk()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t byte { static_cast<uint8_t>(opcode & MASK_OPC_BYTE) };
-
-    if(registers[vx] == byte) pc += 2;
+    Access<Model> machine {*this};
+    Instructions::opc_3xkk(machine, current->x, current->byte);
 }
 
 // SNE vx, byte
 // Skip instruction if vx != kk
+template <MachineModel Model>
 void Cpu::opc_4xkk()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t byte { static_cast<uint8_t>(opcode & MASK_OPC_BYTE) };
-
-    if(registers[vx] != byte) pc += 2;
+    Access<Model> machine {*this};
+    Instructions::opc_4xkk(machine, current->x, current->byte);
 }
 
 // SE vx, vy
 // Skip instruction if vx = vy
+template <MachineModel Model>
 void Cpu::opc_5xy0()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t vy { extractVy(MASK_OPC_VY) };
-
-    if(registers[vx] == registers[vy]) pc += 2;
+    Access<Model> machine {*this};
+    Instructions::opc_5xy0(machine, current->x, current->y);
 }
 
 // SNE vx, vy
 // Skip instruction if vx != vy
+template <MachineModel Model>
 void Cpu::opc_9xy0()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t vy { extractVy(MASK_OPC_VY) };
-
-    if(registers[vx] != registers[vy]) pc += 2;
+    Access<Model> machine {*this};
+    Instructions::opc_9xy0(machine, current->x, current->y);
 }
 
-// JP addr, v0
+// JP addr, v0 (or JP xnn, vx)
+template <QuirkProfile Profile>
 void Cpu::opc_Bnnn()
 {
-    uint16_t address { static_cast<uint16_t>(opcode & MASK_OPC_ADDR) };
-
-    pc = registers[0] + address;
+    Access<> machine {*this};
+    Instructions::opc_Bnnn<Profile>(machine, current->x, current->address);
 }
 
 // Memory & Registers instructions
@@ -238,85 +518,59 @@ void Cpu::opc_Bnnn()
 // LD vx, byte
 void Cpu::opc_6xkk()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t byte { static_cast<uint8_t>(opcode & MASK_OPC_BYTE) };
-
-    registers[vx] = byte;
+    Access<> machine {*this};
+    Instructions::opc_6xkk(machine, current->x, current->byte);
 }
 
 // ADD vx, byte
 void Cpu::opc_7xkk()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t byte { static_cast<uint8_t>(opcode & MASK_OPC_BYTE) };
-
-    registers[vx] += byte;
+    Access<> machine {*this};
+    Instructions::opc_7xkk(machine, current->x, current->byte);
 }
 
 // LD I, addr
 void Cpu::opc_Annn()
 {
-    uint16_t address { static_cast<uint16_t>(opcode & MASK_OPC_ADDR) };
-
-    system->setIndexRegister(address);
+    Access<> machine {*this};
+    Instructions::opc_Annn(machine, current->address);
 }
 
 // ADD I, vx
 void Cpu::opc_Fx1E()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-
-    system->setIndexRegister(system->getIndexRegister() + registers[vx]);
+    Access<> machine {*this};
+    Instructions::opc_Fx1E(machine, current->x);
 }
 
 // LD I, vx
+template <QuirkProfile Profile>
 void Cpu::opc_Fx55()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-
-    for(uint8_t i {} ; i <= vx ; ++i)
-        system->writeMemory(system->getIndexRegister() + i, registers[i]);
-
-    system->setIndexRegister(system->getIndexRegister() + vx + 1);
+    Access<> machine {*this};
+    Instructions::opc_Fx55<Profile>(machine, current->x);
 }
 
 // LD vx, I
+template <QuirkProfile Profile>
 void Cpu::opc_Fx65()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-
-    for(uint8_t i {} ; i <= vx ; ++i)
-        registers[i] = system->getMemoryAt(system->getIndexRegister() + i);
-
-    system->setIndexRegister(system->getIndexRegister() + vx + 1);
+    Access<> machine {*this};
+    Instructions::opc_Fx65<Profile>(machine, current->x);
 }
 
 // LD B, vx
 void Cpu::opc_Fx33()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t val { registers[vx] };
-
-    uint16_t index { system->getIndexRegister() };
-    // ones digit
-    system->writeMemory(index + 2, val % 10);
-    val /= 10;
-
-    // tens digit
-    system->writeMemory(index + 1, val % 10);
-    val /= 10;
-
-    // hundreds digit
-    system->writeMemory(index, val % 10);
+    Access<> machine {*this};
+    Instructions::opc_Fx33(machine, current->x);
 }
 
 // RND vx, byte
 void Cpu::opc_Cxkk()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t byte { static_cast<uint8_t>(opcode & MASK_OPC_BYTE) };
-
-    registers[vx] = system->getRandomByte() & byte;
+    Access<> machine {*this};
+    Instructions::opc_Cxkk(machine, current->x, current->byte);
 }
 
 /*
@@ -328,138 +582,323 @@ void Cpu::opc_Cxkk()
 // LD vx, DT
 void Cpu::opc_Fx07()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-
-    registers[vx] = system->getDelayTimer();
+    Access<> machine {*this};
+    Instructions::opc_Fx07(machine, current->x);
 }
 
 // LD DT, vx
 void Cpu::opc_Fx15()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-
-    system->setDelayTimer(registers[vx]);
+    Access<> machine {*this};
+    Instructions::opc_Fx15(machine, current->x);
 }
 
 // LD ST, vx
 void Cpu::opc_Fx18()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-
-    system->setSoundTimer(registers[vx]);
+    Access<> machine {*this};
+    Instructions::opc_Fx18(machine, current->x);
 }
 
 // SKP vx
+template <MachineModel Model>
 void Cpu::opc_Ex9E()
 {
-    uint8_t vx  { extractVx(MASK_OPC_VX) };
-    uint8_t key { registers[vx] };
-
-    if(key < Chip8Specs::KeysCount && system->getKeypad()[key])
-        pc += 2;
+    Access<Model> machine {*this};
+    Instructions::opc_Ex9E(machine, current->x);
 }
 
 // SKNP vx
+template <MachineModel Model>
 void Cpu::opc_ExA1()
 {
-    uint8_t vx  { extractVx(MASK_OPC_VX) };
-    uint8_t key { registers[vx] };
-
-    if(key < Chip8Specs::KeysCount && !system->getKeypad()[key])
-        pc += 2;
+    Access<Model> machine {*this};
+    Instructions::opc_ExA1(machine, current->x);
 }
 
 // LD vx, K
 // Wait for a key press
 void Cpu::opc_Fx0A()
 {
-    static bool key_was_pressed = false;
-    static uint8_t last_key = 0;
+    Access<> machine {*this};
+    Instructions::opc_Fx0A(machine, current->x);
+}
+
+// DRW vx, vy, nibble
+// Display a sprite of size n at (vx, vy)
+// starting at memory location index_register
+template <QuirkProfile Profile>
+void Cpu::opc_Dxyn()
+{
+    Access<> machine {*this};
+    Instructions::opc_Dxyn<Profile>(machine, current->x, current->y, current->nibble);
+}
+
+// LD F, vx
+void Cpu::opc_Fx29()
+{
+    Access<> machine {*this};
+    Instructions::opc_Fx29(machine, current->x);
+}
+
+// === SUPER-CHIP instructions ===
+/*
+    Scrolls move whole words: a vertical scroll is a
+    memmove of the rows, a horizontal one shifts each
+    row and carries the bits across the two halves
+*/
+
+// SCD nibble
+// Scroll the selected planes down by n rows
+void Cpu::opc_00Cn()
+{
+    Screen& screen { system->getScreen() };
+    uint8_t plane_mask { system->getPlaneMask() };
+    int height { screen.height() };
+
+    for(int plane {} ; plane < Chip8Specs::PlaneCount ; ++plane)
+    {
+        if(!(plane_mask & (1u << plane))) continue;
 
-    uint8_t vx = extractVx(MASK_OPC_VX);
-    uint8_t* keypad = system->getKeypad();
+        scrollRows(screen.left(plane), height, current->nibble);
+        if(screen.hires) scrollRows(screen.right(plane), height, current->nibble);
+    }
+
+    system->markVideoDirty(0, height);
+}
 
-    if (!key_was_pressed)
+// SCR
+// Scroll the selected planes right by 4 pixels
+void Cpu::opc_00FB()
+{
+    Screen& screen { system->getScreen() };
+    uint8_t plane_mask { system->getPlaneMask() };
+    int height { screen.height() };
+
+    for(int plane {} ; plane < Chip8Specs::PlaneCount ; ++plane)
     {
-        // We look for an eventual pressed key
-        for (uint8_t i {} ; i < Chip8Specs::KeysCount; ++i)
+        if(!(plane_mask & (1u << plane))) continue;
+
+        uint64_t* left { screen.left(plane) };
+        uint64_t* right { screen.right(plane) };
+
+        for(int y {} ; y < height ; ++y)
         {
-            if (keypad[i])
-            {
-                last_key = i;
-                key_was_pressed = true;
-                break;
-            }
+            if(screen.hires) right[y] = (right[y] >> 4u) | (left[y] << 60u);
+            left[y] >>= 4u;
         }
-
-        // No key pressed yet, loop again
-        if (!key_was_pressed) pc -= 2;
     }
-    else
+
+    system->markVideoDirty(0, height);
+}
+
+// SCL
+// Scroll the selected planes left by 4 pixels
+void Cpu::opc_00FC()
+{
+    Screen& screen { system->getScreen() };
+    uint8_t plane_mask { system->getPlaneMask() };
+    int height { screen.height() };
+
+    for(int plane {} ; plane < Chip8Specs::PlaneCount ; ++plane)
     {
-        // Key pressed, wait for it to be released
-        if (!keypad[last_key])
+        if(!(plane_mask & (1u << plane))) continue;
+
+        uint64_t* left { screen.left(plane) };
+        uint64_t* right { screen.right(plane) };
+
+        for(int y {} ; y < height ; ++y)
         {
-            registers[vx] = last_key;
-            key_was_pressed = false;
+            left[y] <<= 4u;
+            if(screen.hires)
+            {
+                left[y] |= right[y] >> 60u;
+                right[y] <<= 4u;
+            }
         }
-        else pc -= 2;
     }
+
+    system->markVideoDirty(0, height);
+}
+
+// EXIT
+void Cpu::opc_00FD()
+{
+    halted = true;
+}
+
+// LOW
+void Cpu::opc_00FE()
+{
+    system->setHires(false);
+}
+
+// HIGH
+void Cpu::opc_00FF()
+{
+    system->setHires(true);
 }
 
 // DRW vx, vy, nibble
-// Display a sprite of size n at (vx, vy)
-// starting at memory location index_register
-void Cpu::opc_Dxyn()
+// Sprites are 8 pixels wide, or 16x16 when n is 0. With
+// several planes selected, each one takes the next sprite
+template <QuirkProfile Profile>
+void Cpu::opc_DxynExtended()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t vy { extractVy(MASK_OPC_VY) };
-    uint8_t sprite_height { static_cast<uint8_t>(opcode & MASK_OPC_NIBBLE) };
+    constexpr bool Clips { QuirkTraits<Profile>::Flags.clips_sprites };
 
-    // Wrap to avoid overflow screen boundaries
-    uint8_t x_cord = registers[vx] % Chip8Specs::ScreenWidth;
-    uint8_t y_cord = registers[vy] % Chip8Specs::ScreenHeight;
+    Screen& screen { system->getScreen() };
+    int width { screen.width() };
+    int height { screen.height() };
+
+    bool big_sprite { current->nibble == 0 };
+    int sprite_height { big_sprite ? 16 : current->nibble };
+    int row_bytes { big_sprite ? 2 : 1 };
+
+    unsigned int x_cord { registers[current->x] % static_cast<unsigned int>(width) };
+    int y_cord { registers[current->y] % height };
+    int visible_rows { Clips ? std::min(sprite_height, height - y_cord) : sprite_height };
 
     registers[0xF] = 0;
 
-    for(uint row {} ; row < sprite_height ; ++row)
+    if(visible_rows > 0) system->markVideoDirty(y_cord, visible_rows);
+
+    uint16_t index { system->getIndexRegister() };
+    uint8_t plane_mask { system->getPlaneMask() };
+
+    for(int plane {} ; plane < Chip8Specs::PlaneCount ; ++plane)
     {
-        uint8_t sprite_byte { system->getMemoryAt(system->getIndexRegister() + row) };
+        if(!(plane_mask & (1u << plane))) continue;
+
+        uint64_t* left { screen.left(plane) };
+        uint64_t* right { screen.right(plane) };
 
-        for(uint col {}  ; col < Chip8Specs::SpriteWidth ; ++col)
+        for(int row {} ; row < visible_rows ; ++row)
         {
-            uint8_t sprite_pixel = sprite_byte & (0x80u >> col) ;
-            uint32_t* video { system->getVideo() };
-            uint32_t* screen_pixel { &video[
-                ((y_cord + row) % Chip8Specs::ScreenHeight) * Chip8Specs::ScreenWidth +
-                ((x_cord + col) % Chip8Specs::ScreenWidth)
-            ]};
-
-            if(sprite_pixel)
-            {
-                if(*screen_pixel == Chip8Specs::PixelOn)
-                {
-                    // sprite pixel and screen pixel are both on
-                    // -> there's a collision
-                    registers[0xF] = 1;
-                }
-
-                *screen_pixel ^= Chip8Specs::PixelOn;
-            }
+            uint16_t address { static_cast<uint16_t>(index + row * row_bytes) };
+            uint64_t bits { uint64_t {system->getMemoryAt(address)} << 56u };
+            if(big_sprite) bits |= uint64_t {system->getMemoryAt(address + 1)} << 48u;
+
+            uint64_t sprite_left {};
+            uint64_t sprite_right {};
+            placeSpriteRow<Clips>(bits, x_cord, screen.hires, sprite_left, sprite_right);
+
+            int y { (y_cord + row) % height };
+
+            // Any pixel turned off on any plane
+            if((left[y] & sprite_left) | (right[y] & sprite_right)) registers[0xF] = 1;
+
+            left[y] ^= sprite_left;
+            right[y] ^= sprite_right;
         }
+
+        index += sprite_height * row_bytes;
     }
 }
 
-// LD F, vx
-void Cpu::opc_Fx29()
+// LD HF, vx
+void Cpu::opc_Fx30()
 {
-    uint8_t vx { extractVx(MASK_OPC_VX) };
-    uint8_t digit { registers[vx] };
+    uint8_t digit { static_cast<uint8_t>(registers[current->x] & 0xFu) };
 
-    // font characters are 5 bytes long
-    uint16_t sprite_first_char_location = Chip8Specs::FontSetStartAddress + (Chip8Specs::FontCharSize * digit);
+    system->setIndexRegister(Chip8Specs::BigFontSetStartAddress + Chip8Specs::BigFontCharSize * digit);
+}
 
-    system->setIndexRegister(sprite_first_char_location);
+// LD R, vx
+void Cpu::opc_Fx75()
+{
+    uint8_t* flags { system->getRplFlags() };
+
+    for(uint8_t i {} ; i <= current->x ; ++i)
+        flags[i] = registers[i];
+}
+
+// LD vx, R
+void Cpu::opc_Fx85()
+{
+    uint8_t* flags { system->getRplFlags() };
+
+    for(uint8_t i {} ; i <= current->x ; ++i)
+        registers[i] = flags[i];
+}
+
+// === XO-CHIP instructions ===
+
+// SCU nibble
+// Scroll the selected planes up by n rows
+void Cpu::opc_00Dn()
+{
+    Screen& screen { system->getScreen() };
+    uint8_t plane_mask { system->getPlaneMask() };
+    int height { screen.height() };
+
+    for(int plane {} ; plane < Chip8Specs::PlaneCount ; ++plane)
+    {
+        if(!(plane_mask & (1u << plane))) continue;
+
+        scrollRows(screen.left(plane), height, -current->nibble);
+        if(screen.hires) scrollRows(screen.right(plane), height, -current->nibble);
+    }
+
+    system->markVideoDirty(0, height);
+}
+
+// LD [I], vx - vy
+// Registers x to y, in that order even if x > y. I is unchanged
+void Cpu::opc_5xy2()
+{
+    uint8_t vx { current->x };
+    uint8_t vy { current->y };
+    int step { vx <= vy ? 1 : -1 };
+    int count { std::abs(vy - vx) + 1 };
+    uint16_t index { system->getIndexRegister() };
+
+    for(int i {} ; i < count ; ++i)
+        system->writeMemory(index + i, registers[vx + i * step]);
+}
+
+// LD vx - vy, [I]
+void Cpu::opc_5xy3()
+{
+    uint8_t vx { current->x };
+    uint8_t vy { current->y };
+    int step { vx <= vy ? 1 : -1 };
+    int count { std::abs(vy - vx) + 1 };
+    uint16_t index { system->getIndexRegister() };
+
+    for(int i {} ; i < count ; ++i)
+        registers[vx + i * step] = system->getMemoryAt(index + i);
+}
+
+// LD I, long addr
+// The 16-bit address is the word following the instruction
+void Cpu::opc_F000()
+{
+    // Fx00 with x != 0 does not exist
+    if(current->x != 0) return;
+
+    uint16_t address { static_cast<uint16_t>((system->getMemoryAt(pc) << 8u) | system->getMemoryAt(pc + 1)) };
+    system->setIndexRegister(address);
+
+    pc += 2;
+}
+
+// PLANE n
+void Cpu::opc_Fn01()
+{
+    system->setPlaneMask(current->x & 0x3u);
+}
+
+// AUDIO
+void Cpu::opc_F002()
+{
+    system->loadAudioPattern();
+}
+
+// PITCH vx
+void Cpu::opc_Fx3A()
+{
+    system->setPitch(registers[current->x]);
 }
 
 // === Instruction dispatching & opcode decoding ===
@@ -470,93 +909,232 @@ void Cpu::opc_Fx29()
 
 void Cpu::dispatchInstructions()
 {
-    table[0x0] = &Cpu::handle0Instructions;
+    // Entries of another model must not survive
+    std::fill(std::begin(table0), std::end(table0), nullptr);
+    std::fill(std::begin(table5), std::end(table5), nullptr);
+    std::fill(std::begin(tableF), std::end(tableF), nullptr);
+
+    switch (quirks)
+    {
+    case QuirkProfile::Chip48: dispatchQuirkInstructions<QuirkProfile::Chip48>(); break;
+    case QuirkProfile::Schip:  dispatchQuirkInstructions<QuirkProfile::Schip>(); break;
+    case QuirkProfile::XoChip: dispatchQuirkInstructions<QuirkProfile::XoChip>(); break;
+    default:                   dispatchQuirkInstructions<QuirkProfile::Vip>(); break;
+    }
+
+    switch (model)
+    {
+    case MachineModel::Schip:  dispatchModelInstructions<MachineModel::Schip>(); break;
+    case MachineModel::XoChip: dispatchModelInstructions<MachineModel::XoChip>(); break;
+    default:                   dispatchModelInstructions<MachineModel::Chip8>(); break;
+    }
+
     table[0x1] = &Cpu::opc_1nnn;
     table[0x2] = &Cpu::opc_2nnn;
-    table[0x3] = &Cpu::opc_3xkk;
-    table[0x4] = &Cpu::opc_4xkk;
-    table[0x5] = &Cpu::opc_5xy0;
     table[0x6] = &Cpu::opc_6xkk;
     table[0x7] = &Cpu::opc_7xkk;
-    table[0x8] = &Cpu::handle8Instructions;
-    table[0x9] = &Cpu::opc_9xy0;
     table[0xA] = &Cpu::opc_Annn;
-    table[0xB] = &Cpu::opc_Bnnn;
     table[0xC] = &Cpu::opc_Cxkk;
-    table[0xD] = &Cpu::opc_Dxyn;
-    table[0xE] = &Cpu::handleEInstructions;
-    table[0xF] = &Cpu::handleFInstructions;
+
+    table0[0xE0] = &Cpu::opc_00E0;
+    table0[0xEE] = &Cpu::opc_00EE;
+
+    table8[0x0] = &Cpu::opc_8xy0;
+    table8[0x4] = &Cpu::opc_8xy4;
+    table8[0x5] = &Cpu::opc_8xy5;
+    table8[0x7] = &Cpu::opc_8xy7;
+
+    tableF[0x07] = &Cpu::opc_Fx07;
+    tableF[0x0A] = &Cpu::opc_Fx0A;
+    tableF[0x15] = &Cpu::opc_Fx15;
+    tableF[0x18] = &Cpu::opc_Fx18;
+    tableF[0x1E] = &Cpu::opc_Fx1E;
+    tableF[0x29] = &Cpu::opc_Fx29;
+    tableF[0x33] = &Cpu::opc_Fx33;
 }
 
-void Cpu::handle0Instructions()
+template <QuirkProfile Profile>
+void Cpu::dispatchQuirkInstructions()
 {
-    switch(opcode & 0x00FFu)
-    {
-    case 0xE0: return opc_00E0();
-    case 0xEE: return opc_00EE();
-    default: break;
-    }
+    table[0xB] = &Cpu::opc_Bnnn<Profile>;
+    table[0xD] = (model == MachineModel::Chip8) ? &Cpu::opc_Dxyn<Profile> : &Cpu::opc_DxynExtended<Profile>;
+
+    table8[0x1] = &Cpu::opc_8xy1<Profile>;
+    table8[0x2] = &Cpu::opc_8xy2<Profile>;
+    table8[0x3] = &Cpu::opc_8xy3<Profile>;
+    table8[0x6] = &Cpu::opc_8xy6<Profile>;
+    table8[0xE] = &Cpu::opc_8xyE<Profile>;
+
+    tableF[0x55] = &Cpu::opc_Fx55<Profile>;
+    tableF[0x65] = &Cpu::opc_Fx65<Profile>;
 }
 
-void Cpu::handle8Instructions()
+template <MachineModel Model>
+void Cpu::dispatchModelInstructions()
 {
-    switch (opcode & 0x000Fu)
+    table[0x3] = &Cpu::opc_3xkk<Model>;
+    table[0x4] = &Cpu::opc_4xkk<Model>;
+    table[0x9] = &Cpu::opc_9xy0<Model>;
+
+    tableE[0x9E] = &Cpu::opc_Ex9E<Model>;
+    tableE[0xA1] = &Cpu::opc_ExA1<Model>;
+
+    // The VIP ignores the low nibble of 5xy0,
+    // XO-CHIP gives it a meaning
+    if constexpr (Model == MachineModel::XoChip)
+        table5[0x0] = &Cpu::opc_5xy0<Model>;
+    else
+        std::fill(std::begin(table5), std::end(table5), &Cpu::opc_5xy0<Model>);
+
+    if constexpr (Model == MachineModel::Chip8)
+        return;
+
+    for(uint8_t n {} ; n <= 0xF ; ++n)
+        table0[0xC0 + n] = &Cpu::opc_00Cn;
+    table0[0xFB] = &Cpu::opc_00FB;
+    table0[0xFC] = &Cpu::opc_00FC;
+    table0[0xFD] = &Cpu::opc_00FD;
+    table0[0xFE] = &Cpu::opc_00FE;
+    table0[0xFF] = &Cpu::opc_00FF;
+
+    tableF[0x30] = &Cpu::opc_Fx30;
+    tableF[0x75] = &Cpu::opc_Fx75;
+    tableF[0x85] = &Cpu::opc_Fx85;
+
+    if constexpr (Model == MachineModel::XoChip)
     {
-    case 0x0: return opc_8xy0();
-    case 0x1: return opc_8xy1();
-    case 0x2: return opc_8xy2();
-    case 0x3: return opc_8xy3();
-    case 0x4: return opc_8xy4();
-    case 0x5: return opc_8xy5();
-    case 0x6: return opc_8xy6();
-    case 0x7: return opc_8xy7();
-    case 0xE: return opc_8xyE();
-    default: break;
+        for(uint8_t n {} ; n <= 0xF ; ++n)
+            table0[0xD0 + n] = &Cpu::opc_00Dn;
+
+        table5[0x2] = &Cpu::opc_5xy2;
+        table5[0x3] = &Cpu::opc_5xy3;
+
+        tableF[0x00] = &Cpu::opc_F000;
+        tableF[0x01] = &Cpu::opc_Fn01;
+        tableF[0x02] = &Cpu::opc_F002;
+        tableF[0x3A] = &Cpu::opc_Fx3A;
     }
 }
 
-void Cpu::handleEInstructions()
+Cpu::CpuInstruction Cpu::resolveHandler(uint16_t op)
 {
-    switch (opcode & 0x00FFu)
+    CpuInstruction handler {nullptr};
+
+    switch((op & 0xF000u) >> 12u)
     {
-    case 0x9E: return opc_Ex9E();
-    case 0xA1: return opc_ExA1();
-    default: break;
+    case 0x0: handler = table0[op & 0x00FFu]; break;
+    case 0x5: handler = table5[op & 0x000Fu]; break;
+    case 0x8: handler = table8[op & 0x000Fu]; break;
+    case 0xE: handler = tableE[op & 0x00FFu]; break;
+    case 0xF: handler = tableF[op & 0x00FFu]; break;
+    default:  handler = table[(op & 0xF000u) >> 12u]; break;
     }
+
+    return handler ? handler : &Cpu::opc_unknown;
+}
+
+void Cpu::opc_unknown() {}
+
+// === Decoded instruction cache ===
+/*
+    Fetching and decoding is done once per address,
+    the result stays valid until the memory it was
+    decoded from is written
+*/
+
+void Cpu::decode(uint16_t address, DecodedInstruction& instruction)
+{
+    // Fetch opcode from memory
+    opcode = (system->getMemoryAt(address) << 8u) | system->getMemoryAt(address + 1);
+
+    instruction.opcode  = opcode;
+    instruction.address = opcode & MASK_OPC_ADDR;
+    instruction.x       = extractVx(MASK_OPC_VX);
+    instruction.y       = extractVy(MASK_OPC_VY);
+    instruction.byte    = opcode & MASK_OPC_BYTE;
+    instruction.nibble  = opcode & MASK_OPC_NIBBLE;
+    instruction.handler = resolveHandler(opcode);
 }
 
-void Cpu::handleFInstructions()
+void Cpu::invalidateDecoded(uint16_t address)
 {
-    switch (opcode & 0x00FFu)
+    // An instruction spans two bytes, so both the instruction
+    // starting here and the one starting just before are stale
+    if(address < memory_size)
     {
-    case 0x07: return opc_Fx07();
-    case 0x0A: return opc_Fx0A();
-    case 0x15: return opc_Fx15();
-    case 0x18: return opc_Fx18();
-    case 0x1E: return opc_Fx1E();
-    case 0x29: return opc_Fx29();
-    case 0x33: return opc_Fx33();
-    case 0x55: return opc_Fx55();
-    case 0x65: return opc_Fx65();
-    default: break;
+        decoded_cache[address].handler = nullptr;
+        if(block_coverage[address]) blocks_flush_pending = true;
     }
+    if(address >= 1 && address - 1 < memory_size) decoded_cache[address - 1].handler = nullptr;
+}
+
+void Cpu::invalidateDecodedCache()
+{
+    for(DecodedInstruction& instruction : decoded_cache)
+        instruction.handler = nullptr;
+
+    blocks_flush_pending = true;
 }
 
 void Cpu::Cycle()
 {
-    // Fetch opcode from memory
-    opcode = (system->getMemoryAt(pc) << 8u) | system->getMemoryAt(pc + 1);
+    DecodedInstruction* instruction {&decoded_scratch};
+    uint16_t address {pc};
+
+    if(pc + 1 < memory_size)
+    {
+        instruction = &decoded_cache[pc];
+        if(instruction->handler == nullptr) decode(pc, *instruction);
+    }
+    else decode(pc, *instruction);
+
     pc += 2;
 
-    // Decode the instruction
-    uint8_t instruction_id = (opcode & 0xF000u) >> 12u;
+    // Execute. Writes done by the instruction may invalidate its
+    // own entry, which only clears the handler: operands stay valid
+    current = instruction;
+    opcode = instruction->opcode;
 
-    if (table[instruction_id] == nullptr) {
-        std::cerr << "Unknown instruction ID: " << std::hex << instruction_id
-                  << " from opcode "            << std::hex << opcode << '\n';
-        return;
+    if constexpr (ProfilerSpecs::Enabled)
+    {
+        if(profiler)
+        {
+            profiler->Begin(address, opcode);
+            (this->*instruction->handler)();
+            profiler->End();
+            return;
+        }
+    }
+
+    (this->*instruction->handler)();
+}
+
+uint32_t Cpu::Run(uint32_t max_instructions)
+{
+    // The other engines have no per-instruction hooks
+    bool profiling { ProfilerSpecs::Enabled && profiler != nullptr };
+
+    // The outcome of loops only a timer tick or a key can end is
+    // computed instead of run. Profiles show them as they run
+    if(!profiling)
+    {
+        uint32_t skipped { SkipIdle(max_instructions) };
+        if(skipped > 0) return skipped;
+    }
+
+    if(engine == CpuEngine::Threaded && !profiling)
+        return RunThreaded(max_instructions);
+
+    if(engine == CpuEngine::Recompiler && !profiling)
+        return recompiler->Run(max_instructions);
+
+    uint32_t executed {};
+
+    while (executed < max_instructions && !halted)
+    {
+        Cycle();
+        ++executed;
     }
 
-    // Execute
-    (this->*table[instruction_id])();
+    return executed;
 }
@@ -0,0 +1,298 @@
+#include "cpu.hpp"
+#include "chip8.hpp"
+#include "cpu_access.hpp"
+#include "instructions.hpp"
+#include "masks.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+/*
+    Threaded engine
+
+    Straight-line runs of instructions are translated once into
+    blocks, then executed with direct-threaded dispatch: every op
+    holds the address of the code implementing it and jumps
+    straight to the next one, with no fetch, decode nor call.
+    Simple register operations are implemented inline, all the
+    others go through the regular handlers.
+*/
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CHIP8PP_HAS_COMPUTED_GOTO 1
+#else
+#define CHIP8PP_HAS_COMPUTED_GOTO 0
+#endif
+
+namespace
+{
+    // Longest block, in instructions
+    constexpr size_t MaxBlockLength {32};
+
+    // Order must match the label table in Cpu::RunThreaded
+    enum OpKind : uint8_t
+    {
+        OP_HANDLER,     // Call the regular handler, keep going
+        OP_TERMINATOR,  // Call the regular handler, leave the block
+        OP_END,         // Block cut short, leave it
+        OP_6xkk,
+        OP_7xkk,
+        OP_8xy0,
+        OP_8xy1,
+        OP_8xy2,
+        OP_8xy3,
+        OP_8xy4,
+        OP_8xy5,
+        OP_8xy7,
+        OP_Annn,
+        OP_Fx07,
+        OP_Fx15,
+        OP_Fx18,
+        OP_Fx1E,
+        OP_Fx29,
+    };
+
+    OpKind classify(uint16_t opcode, const QuirkFlags& quirks)
+    {
+        switch ((opcode & 0xF000u) >> 12u)
+        {
+        // Flow control: jumps, calls and skips
+        case 0x1: case 0x2: case 0x3: case 0x4:
+        case 0x5: case 0x9: case 0xB: case 0xE:
+            return OP_TERMINATOR;
+        // The display is handed back to the frontend between blocks
+        case 0xD:
+            return OP_TERMINATOR;
+        // Return and exit
+        case 0x0:
+            return (opcode == 0x00EE || opcode == 0x00FD) ? OP_TERMINATOR : OP_HANDLER;
+        case 0x6: return OP_6xkk;
+        case 0x7: return OP_7xkk;
+        case 0xA: return OP_Annn;
+        case 0x8:
+            switch (opcode & 0x000Fu)
+            {
+            case 0x0: return OP_8xy0;
+            // Inline versions clear VF, other profiles use the handlers
+            case 0x1: return quirks.resets_flag ? OP_8xy1 : OP_HANDLER;
+            case 0x2: return quirks.resets_flag ? OP_8xy2 : OP_HANDLER;
+            case 0x3: return quirks.resets_flag ? OP_8xy3 : OP_HANDLER;
+            case 0x4: return OP_8xy4;
+            case 0x5: return OP_8xy5;
+            case 0x7: return OP_8xy7;
+            default:  return OP_HANDLER;
+            }
+        case 0xF:
+            switch (opcode & 0x00FFu)
+            {
+            case 0x07: return OP_Fx07;
+            case 0x15: return OP_Fx15;
+            case 0x18: return OP_Fx18;
+            case 0x1E: return OP_Fx1E;
+            case 0x29: return OP_Fx29;
+            // Key wait and memory writes end the block, so that
+            // self-modifying code is seen by the next lookup
+            case 0x0A: case 0x33: case 0x55:
+                return OP_TERMINATOR;
+            // F000 nnnn moves pc past its operand
+            case 0x00:
+                return (opcode == 0xF000) ? OP_TERMINATOR : OP_HANDLER;
+            default: return OP_HANDLER;
+            }
+        default:
+            return OP_HANDLER;
+        }
+    }
+}
+
+bool Cpu::isThreadedSupported() { return CHIP8PP_HAS_COMPUTED_GOTO; }
+
+void Cpu::flushBlocks()
+{
+    for (auto& block : blocks) block.reset();
+    std::fill(block_coverage.begin(), block_coverage.end(), 0);
+    blocks_flush_pending = false;
+}
+
+void Cpu::buildBlock(uint16_t start, ThreadedBlock& block)
+{
+    uint16_t address {start};
+    QuirkFlags quirk_flags { quirkFlagsOf(quirks) };
+
+    while (block.ops.size() < MaxBlockLength && address + 1 < memory_size)
+    {
+        ThreadedOp op {};
+        decode(address, op.decoded);
+        op.address = address;
+        op.kind = classify(op.decoded.opcode, quirk_flags);
+
+        block.ops.push_back(op);
+        block_coverage[address] = block_coverage[address + 1] = 1;
+        address += 2;
+
+        if (op.kind == OP_TERMINATOR) break;
+    }
+
+    block.end = address;
+
+    // Blocks not ending with a terminator resume at their end
+    if (block.ops.empty() || block.ops.back().kind != OP_TERMINATOR)
+    {
+        ThreadedOp end_op {};
+        end_op.kind = OP_END;
+        end_op.address = address;
+        block.ops.push_back(end_op);
+    }
+}
+
+#if CHIP8PP_HAS_COMPUTED_GOTO
+
+uint32_t Cpu::RunThreaded(uint32_t max_instructions)
+{
+    static const void* const labels[] {
+        &&op_handler, &&op_terminator, &&op_end,
+        &&op_6xkk, &&op_7xkk,
+        &&op_8xy0, &&op_8xy1, &&op_8xy2, &&op_8xy3, &&op_8xy4, &&op_8xy5, &&op_8xy7,
+        &&op_Annn, &&op_Fx07, &&op_Fx15, &&op_Fx18, &&op_Fx1E, &&op_Fx29,
+    };
+
+    if (blocks.empty()) blocks.resize(memory_size);
+
+    Access<> machine {*this};
+    uint32_t executed {};
+
+    while (executed < max_instructions && !halted)
+    {
+        if (blocks_flush_pending) flushBlocks();
+
+        ThreadedBlock* block { (pc + 1 < memory_size) ? blocks[pc].get() : nullptr };
+
+        if (block == nullptr && pc + 1 < memory_size)
+        {
+            blocks[pc] = std::make_unique<ThreadedBlock>();
+            block = blocks[pc].get();
+            buildBlock(pc, *block);
+
+            for (ThreadedOp& op : block->ops)
+                op.target = labels[op.kind];
+        }
+
+        // The last op of a block cut short does not execute anything
+        size_t block_length { block ? block->ops.size() - (block->ops.back().kind == OP_END) : 0 };
+
+        // Not enough budget left for the whole block (or nothing to
+        // run from here): fall back to one instruction at a time
+        if (block_length == 0 || block_length > max_instructions - executed)
+        {
+            Cycle();
+            ++executed;
+            continue;
+        }
+
+        executed += block_length;
+
+        const ThreadedOp* op { block->ops.data() };
+        goto *op->target;
+
+    op_handler:
+        pc = op->address + 2;
+        current = &op->decoded;
+        opcode = op->decoded.opcode;
+        (this->*op->decoded.handler)();
+        goto *(++op)->target;
+
+    op_terminator:
+        pc = op->address + 2;
+        current = &op->decoded;
+        opcode = op->decoded.opcode;
+        (this->*op->decoded.handler)();
+        continue;
+
+    op_end:
+        pc = op->address;
+        continue;
+
+    // Inline ops, the same semantics as the handlers
+    op_6xkk:
+        Instructions::opc_6xkk(machine, op->decoded.x, op->decoded.byte);
+        goto *(++op)->target;
+
+    op_7xkk:
+        Instructions::opc_7xkk(machine, op->decoded.x, op->decoded.byte);
+        goto *(++op)->target;
+
+    op_8xy0:
+        Instructions::opc_8xy0(machine, op->decoded.x, op->decoded.y);
+        goto *(++op)->target;
+
+    // Only inlined when the profile clears VF, as VIP does
+    op_8xy1:
+        Instructions::opc_8xy1<QuirkProfile::Vip>(machine, op->decoded.x, op->decoded.y);
+        goto *(++op)->target;
+
+    op_8xy2:
+        Instructions::opc_8xy2<QuirkProfile::Vip>(machine, op->decoded.x, op->decoded.y);
+        goto *(++op)->target;
+
+    op_8xy3:
+        Instructions::opc_8xy3<QuirkProfile::Vip>(machine, op->decoded.x, op->decoded.y);
+        goto *(++op)->target;
+
+    op_8xy4:
+        Instructions::opc_8xy4(machine, op->decoded.x, op->decoded.y);
+        goto *(++op)->target;
+
+    op_8xy5:
+        Instructions::opc_8xy5(machine, op->decoded.x, op->decoded.y);
+        goto *(++op)->target;
+
+    op_8xy7:
+        Instructions::opc_8xy7(machine, op->decoded.x, op->decoded.y);
+        goto *(++op)->target;
+
+    op_Annn:
+        Instructions::opc_Annn(machine, op->decoded.address);
+        goto *(++op)->target;
+
+    op_Fx07:
+        Instructions::opc_Fx07(machine, op->decoded.x);
+        goto *(++op)->target;
+
+    op_Fx15:
+        Instructions::opc_Fx15(machine, op->decoded.x);
+        goto *(++op)->target;
+
+    op_Fx18:
+        Instructions::opc_Fx18(machine, op->decoded.x);
+        goto *(++op)->target;
+
+    op_Fx1E:
+        Instructions::opc_Fx1E(machine, op->decoded.x);
+        goto *(++op)->target;
+
+    op_Fx29:
+        Instructions::opc_Fx29(machine, op->decoded.x);
+        goto *(++op)->target;
+    }
+
+    return executed;
+}
+
+#else
+
+// No labels-as-values on this compiler, setEngine refuses the
+// threaded engine so this is never reached in practice
+uint32_t Cpu::RunThreaded(uint32_t max_instructions)
+{
+    uint32_t executed {};
+
+    while (executed < max_instructions && !halted)
+    {
+        Cycle();
+        ++executed;
+    }
+
+    return executed;
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include "emulation_thread.hpp"
+#include "chip8.hpp"
+#include "replay.hpp"
+#include "save_state.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+EmulationThread::EmulationThread(Chip8& system, int instructions_per_second,
+                                 size_t rewind_budget, ReplayRecorder* recorder)
+    : system {system}, scheduler {&system, instructions_per_second},
+      rewind {rewind_budget}, rewind_budget {rewind_budget}, recorder {recorder}
+{
+}
+
+EmulationThread::~EmulationThread()
+{
+    Stop();
+}
+
+void EmulationThread::SetStatePath(const std::string& path) { state_path = path; }
+uint64_t EmulationThread::getFrameCount() { return scheduler.getFrameCount(); }
+
+void EmulationThread::Start()
+{
+    if (running.exchange(true)) return;
+
+    // Something to present before the first frame ends
+    publish();
+
+    thread = std::thread(&EmulationThread::Loop, this);
+}
+
+void EmulationThread::Stop()
+{
+    running.store(false, std::memory_order_release);
+    if (thread.joinable()) thread.join();
+
+    sound_active.store(false, std::memory_order_relaxed);
+}
+
+bool EmulationThread::Submit(const MachineCommand& command) { return commands.Push(command); }
+bool EmulationThread::PollFrame() { return frames.Update(); }
+const VideoFrame& EmulationThread::getFrame() { return frames.Front(); }
+bool EmulationThread::PollAudioPattern() { return patterns.Update(); }
+const AudioPattern& EmulationThread::getAudioPattern() { return patterns.Front(); }
+bool EmulationThread::isSoundActive() { return sound_active.load(std::memory_order_relaxed); }
+
+bool EmulationThread::apply(const MachineCommand& command)
+{
+    switch (command.kind)
+    {
+    case MachineCommand::Kind::Key:
+        system.setKeypad(command.key, command.value);
+        return false;
+    case MachineCommand::Kind::QuickSave:
+        quickSave();
+        return false;
+    case MachineCommand::Kind::QuickLoad:
+        return quickLoad();
+    case MachineCommand::Kind::Rewind:
+        rewind_held = (command.value != 0);
+        return false;
+    }
+
+    return false;
+}
+
+void EmulationThread::quickSave()
+{
+    system.saveState(quick_save);
+
+    if (state_path.empty())
+        return;
+
+    try {
+        writeStateFile(state_path, quick_save);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+    }
+}
+
+bool EmulationThread::quickLoad()
+{
+    try {
+        // Nothing saved in this session, use the file
+        if (quick_save.empty() && !state_path.empty())
+            quick_save = readStateFile(state_path);
+
+        if (!quick_save.empty())
+        {
+            system.loadState(quick_save);
+            return true;
+        }
+    } catch (const std::exception& e) {
+        quick_save.clear();
+        std::cerr << e.what() << "\n";
+    }
+
+    return false;
+}
+
+void EmulationThread::publish()
+{
+    VideoFrame& frame { frames.Back() };
+
+    frame.screen = system.getScreen();
+    frame.frame_count = scheduler.getFrameCount();
+    frame.achieved_rate = pacer.getAchievedRate();
+    frame.applied_commands = applied_commands;
+    // The rewind changes the picture without any input
+    frame.waiting_for_key = !rewind_held && system.getCpu()->isWaitingForKey();
+
+    frames.Publish();
+
+    // Rarely changes, only sent when it does
+    if (system.getAudioPattern() != published_pattern)
+    {
+        published_pattern = system.getAudioPattern();
+        patterns.Back() = published_pattern;
+        patterns.Publish();
+    }
+}
+
+void EmulationThread::Loop()
+{
+    while (running.load(std::memory_order_acquire))
+    {
+        MachineCommand command {};
+        bool state_loaded {false};
+        bool sound {false};
+
+        while (commands.Pop(command))
+        {
+            state_loaded |= apply(command);
+            ++applied_commands;
+        }
+
+        if (recorder && state_loaded)
+            recorder->RecordStateLoad(scheduler.getFrameCount(), system);
+
+        // Holding the rewind key steps back one frame per frame
+        if (rewind_held && rewind_budget > 0)
+        {
+            if (rewind.StepBack(system) && recorder)
+                recorder->RecordStateLoad(scheduler.getFrameCount(), system);
+        }
+        else
+        {
+            uint64_t frame { scheduler.getFrameCount() };
+            if (recorder) recorder->RecordInputs(frame, system);
+
+            // Timers and display run at 60 Hz, independently of the cpu rate
+            uint32_t executed { scheduler.RunFrame(UINT32_MAX, pacer.getNextDeadline()) };
+            if (recorder) recorder->RecordFrame(frame, executed);
+
+            if (rewind_budget > 0) rewind.Push(system);
+
+            sound = system.getSoundTimer() > 0;
+        }
+
+        // Silent while rewinding
+        sound_active.store(sound, std::memory_order_relaxed);
+        publish();
+
+        // Sleep until the next frame instead of spinning
+        pacer.WaitForNextFrame();
+    }
+}
@@ -1,17 +1,44 @@
-#include <chrono>
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 
 #include "chip8.hpp"
 #include "cpu.hpp"
 #include "sdl_interface.hpp"
 #include "constants.hpp"
+#include "emulation_thread.hpp"
+#include "frame_pacer.hpp"
+#include "keymap.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "rewind_buffer.hpp"
+#include "scheduler.hpp"
+#include "sound_related.hpp"
 
 int main(int argc, char* argv[])
 {
-    if (argc != 4)
+    if (argc < 4)
 	{
-		std::cerr << "Emulator Usage: " << argv[0] << " <ROM> <Scale> <Delay>" << '\n';
+		std::cerr << "Emulator Usage: " << argv[0] << " <ROM> <Scale> <Delay> [Options]" << '\n'
+		          << "Options:" << '\n'
+		          << "  --engine <interpreter|threaded|recompiler>   Cpu execution engine" << '\n'
+		          << "  --model <chip8|schip|xochip>                 Machine model, instruction set and display (default: chip8)" << '\n'
+		          << "  --quirks <vip|chip48|schip|xochip>           Instruction behaviours of an interpreter era (default: the model's)" << '\n'
+		          << "  --rewind-budget <MB>                         Rewind history memory (0 disables it)" << '\n'
+		          << "  --seed <Number>                              Seed of the random generator (Cxkk)" << '\n'
+		          << "  --audio-buffer <Samples>                     Audio buffer size, lower is less latency (default: 512)" << '\n'
+		          << "  --record <File>                              Record the inputs for a headless replay" << '\n'
+		          << "  --keys <File>                                Key and controller layout file" << '\n'
+		          << "  --ghosting <Percent>                         Share of the previous picture kept each frame (default: 0)" << '\n'
+		          << "  --scanlines                                  Darken the line below every pixel row" << '\n'
+		          << "  --profile <File>                             Per-opcode and per-address profile (profiler builds)" << '\n'
+		          << "  --profile-folded <File>                      Profile as folded stacks, for flame graphs" << '\n';
 		std::exit(EXIT_FAILURE);
 	}
 
@@ -20,40 +47,128 @@ int main(int argc, char* argv[])
 	int cycle_delay         { std::stoi(argv[3]) };
 
     Chip8 chip8 {};
+    MachineModel model {MachineModel::Chip8};
+    std::optional<QuirkProfile> quirks {};
+    size_t rewind_budget { RewindSpecs::DefaultMemoryBudget };
+    std::optional<uint64_t> seed {};
+    std::string record_path {};
+    int audio_buffer_samples { SoundSpecs::device_samples };
+    DisplayEffects effects {};
+    KeyLayout layout {};
+    std::unique_ptr<ReplayRecorder> recorder {};
+    std::string profile_path {};
+    std::string folded_path {};
+    std::unique_ptr<Profiler> profiler {};
+
+    // The delay between cycles is turned into an instruction
+    // rate, a delay of 0 lets the cpu run as fast as possible
+    int instructions_per_second {
+        cycle_delay > 0 ? std::max(1000 / cycle_delay, 1) : SchedulerSpecs::Unlimited
+    };
 
     try {
+        for (int i {4} ; i < argc ; ++i)
+        {
+            std::string arg { argv[i] };
+
+            if (arg == "--engine" && i + 1 < argc)
+            {
+                if (!chip8.getCpu()->setEngine(engineFromName(argv[++i])))
+                    throw std::runtime_error("Error: engine not available on this build : " + std::string(argv[i]));
+            }
+            else if (arg == "--model" && i + 1 < argc) model = machineModelFromName(argv[++i]);
+            else if (arg == "--quirks" && i + 1 < argc) quirks = quirkProfileFromName(argv[++i]);
+            else if (arg == "--rewind-budget" && i + 1 < argc)
+                rewind_budget = std::stoul(argv[++i]) * 1024 * 1024;
+            else if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i], nullptr, 0);
+            else if (arg == "--record" && i + 1 < argc) record_path = argv[++i];
+            else if (arg == "--audio-buffer" && i + 1 < argc) audio_buffer_samples = std::stoi(argv[++i]);
+            else if (arg == "--keys" && i + 1 < argc) layout.LoadFromFile(argv[++i]);
+            else if (arg == "--ghosting" && i + 1 < argc) effects.ghosting_percent = std::stoi(argv[++i]);
+            else if (arg == "--scanlines") effects.scanlines = true;
+            else if (arg == "--profile" && i + 1 < argc) profile_path = argv[++i];
+            else if (arg == "--profile-folded" && i + 1 < argc) folded_path = argv[++i];
+            else throw std::invalid_argument("Error: unexpected argument : " + arg);
+        }
+
+        // The model sets its own profile, --quirks overrides it
+        chip8.setModel(model);
+        if (quirks) chip8.getCpu()->setQuirks(*quirks);
+
         chip8.loadRomIntoMemory(romFilename);
+
+        // A replay needs to know the seed, pick one if none was given
+        if (!seed && !record_path.empty())
+        {
+            std::random_device rd;
+            seed = (static_cast<uint64_t>(rd()) << 32u) | rd();
+        }
+
+        if (seed) chip8.setSeed(*seed);
+
+        if (!profile_path.empty() || !folded_path.empty())
+        {
+            profiler = std::make_unique<Profiler>();
+            if (!chip8.getCpu()->setProfiler(profiler.get()))
+                throw std::runtime_error("Error: profiler not available, configure with -DCHIP8PP_PROFILER=ON");
+        }
+
+        if (!record_path.empty())
+            recorder = std::make_unique<ReplayRecorder>(record_path,
+                ReplayHeader { hashRomFile(romFilename), *seed, instructions_per_second,
+                               chip8.getCpu()->getQuirks(), model });
     } catch (const std::exception& e) {
         std::cerr << e.what() << "\n";
         return EXIT_FAILURE;
     }
-    SdlInterface interface("Chip8pp", Chip8Specs::ScreenWidth * video_scale_coeff, Chip8Specs::ScreenHeight * video_scale_coeff, Chip8Specs::ScreenWidth, Chip8Specs::ScreenHeight, &chip8);
+    // The machine runs on its own thread from now on, until Stop
+    EmulationThread emulation(chip8, instructions_per_second, rewind_budget, recorder.get());
+
+    SdlInterface interface("Chip8pp", Chip8Specs::ScreenWidth * video_scale_coeff, Chip8Specs::ScreenHeight * video_scale_coeff, &emulation, audio_buffer_samples, effects, layout);
 
-    int pitch { static_cast<int>(sizeof(chip8.getVideo()[0]) * Chip8Specs::ScreenWidth) };
+    // Quick saves are kept next to the ROM
+    emulation.SetStatePath(std::string(romFilename) + ".state");
 
-	auto previous_cycle_time { std::chrono::high_resolution_clock::now() };
-	bool quit { false };
+    // Presentation has its own pace, a slow present
+    // only delays the display, never the machine
+    FramePacer pacer(SchedulerSpecs::FrameRate);
+    bool quit { false };
+
+    emulation.Start();
 
     while (!quit)
-	{
-		quit = interface.HandleKeyInput();
+    {
+        // While the machine waits for a key, nothing is drawn until
+        // an input comes: sleep in the event queue instead of frames
+        bool idle { interface.isIdle(emulation.getFrame()) };
+        quit = interface.HandleKeyInput(idle ? KeyboardSpecs::IdleWaitMs : 0);
 
-		auto current_time { std::chrono::high_resolution_clock::now() };
-		float delta_time {
-            std::chrono::duration<float, std::chrono::milliseconds::period>(current_time - previous_cycle_time).count()
-        };
+        emulation.PollFrame();
+        interface.Update(emulation.getFrame());
 
-		if (delta_time > cycle_delay)
-		{
-			previous_cycle_time = current_time;
+        // Sleep until the next frame instead of spinning
+        if (!idle && pacer.WaitForNextFrame())
+        {
+            std::ostringstream title;
+            title << "Chip8pp - " << std::fixed << std::setprecision(1)
+                  << emulation.getFrame().achieved_rate << "/" << pacer.getTargetRate() << " fps";
+            interface.SetTitle(title.str().c_str());
+        }
+    }
 
-			chip8.Cycle();
+    emulation.Stop();
 
-            if(chip8.getSoundTimer() > 0) interface.PlaySound();
+    if (recorder) recorder->Finish(emulation.getFrameCount());
 
-			interface.Update(pitch);
-		}
-	}
+    if (profiler)
+    {
+        try {
+            writeProfileFiles(*profiler, profile_path, folded_path);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,85 @@
+#include "frame_pacer.hpp"
+
+#include <algorithm>
+#include <thread>
+
+namespace
+{
+    constexpr std::chrono::microseconds MinSpinMargin {200};
+    constexpr std::chrono::microseconds MaxSpinMargin {2000};
+}
+
+FramePacer::FramePacer(int target_rate, int max_catch_up_frames)
+    : target_rate {target_rate}, max_catch_up_frames {max_catch_up_frames}
+{
+    period = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / target_rate;
+    spin_margin = MinSpinMargin;
+
+    base_time = Clock::now();
+    window_start = base_time;
+}
+
+FramePacer::Clock::time_point FramePacer::deadlineOf(uint64_t frame)
+{
+    // Split in whole seconds and a fraction to stay exact
+    auto whole_seconds { std::chrono::seconds(frame / target_rate) };
+    auto fraction {
+        std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(frame % target_rate)) / target_rate
+    };
+
+    return base_time + whole_seconds + fraction;
+}
+
+FramePacer::Clock::time_point FramePacer::getNextDeadline() { return deadlineOf(frame_index + 1); }
+int FramePacer::getTargetRate() { return target_rate; }
+double FramePacer::getAchievedRate() { return achieved_rate; }
+uint64_t FramePacer::getDroppedFrames() { return dropped_frames; }
+
+bool FramePacer::WaitForNextFrame()
+{
+    ++frame_index;
+    auto deadline { deadlineOf(frame_index) };
+    auto now { Clock::now() };
+
+    if (now < deadline)
+    {
+        // Coarse sleep, woken up a bit early on purpose
+        auto wake_time { deadline - spin_margin };
+        if (now < wake_time)
+        {
+            std::this_thread::sleep_until(wake_time);
+
+            // Adapt the margin to how late the OS woke us up,
+            // it settles around twice the typical oversleep
+            auto oversleep { Clock::now() - wake_time };
+            spin_margin = std::clamp<Clock::duration>(
+                (spin_margin * 7 + oversleep * 2) / 8, MinSpinMargin, MaxSpinMargin);
+        }
+
+        // Fine correction for the remaining sub-millisecond part
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+    }
+    else if (now - deadline > period * max_catch_up_frames)
+    {
+        // Too far behind (debugger, suspended process...):
+        // drop the missed frames instead of running them in a burst
+        dropped_frames += (now - deadline) / period;
+        base_time = now;
+        frame_index = 0;
+    }
+
+    // Measure the achieved rate
+    ++window_frames;
+    now = Clock::now();
+
+    if (now - window_start >= std::chrono::seconds(1))
+    {
+        achieved_rate = window_frames / std::chrono::duration<double>(now - window_start).count();
+        window_frames = 0;
+        window_start = now;
+        return true;
+    }
+
+    return false;
+}
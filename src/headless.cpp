@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "capture.hpp"
+#include "chip8.hpp"
+#include "cpu.hpp"
+#include "constants.hpp"
+#include "profiler.hpp"
+#include "replay.hpp"
+#include "save_state.hpp"
+#include "scheduler.hpp"
+
+/*
+    Headless runner: executes a ROM without any
+    display and dumps the final machine state
+*/
+
+static void dumpState(Chip8& chip8, uint64_t executed_cycles, std::ostream& out)
+{
+    Cpu* cpu { chip8.getCpu() };
+
+    out << "Cycles: " << std::dec << executed_cycles
+        << (cpu->isHalted() ? " (halted)" : " (budget exhausted)") << '\n';
+
+    if (chip8.getOutOfBoundsAccesses() != 0)
+        out << "Out of bounds accesses: " << chip8.getOutOfBoundsAccesses() << '\n';
+
+    out << std::hex << std::uppercase << std::setfill('0')
+        << "PC: 0x" << std::setw(4) << cpu->getPC()
+        << "  I: 0x" << std::setw(4) << chip8.getIndexRegister()
+        << "  SP: 0x" << std::setw(2) << static_cast<int>(cpu->getSP())
+        << "  DT: 0x" << std::setw(2) << static_cast<int>(chip8.getDelayTimer())
+        << "  ST: 0x" << std::setw(2) << static_cast<int>(chip8.getSoundTimer()) << '\n';
+
+    for(uint8_t i {} ; i < Chip8Specs::RegisterCount ; ++i)
+    {
+        out << 'V' << static_cast<int>(i) << ": 0x"
+            << std::setw(2) << static_cast<int>(cpu->getRegister(i))
+            << ((i % 8 == 7) ? '\n' : ' ');
+    }
+
+    // Framebuffer, one character per pixel: '#' for the first
+    // plane, '+' for the second one and '@' for both
+    static const char pixels[] {'.', '#', '+', '@'};
+    const Screen& screen { chip8.getScreen() };
+
+    for(int y {} ; y < screen.height() ; ++y)
+    {
+        for(int x {} ; x < screen.width() ; ++x)
+            out << pixels[screen.pixelAt(x, y)];
+        out << '\n';
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Headless Usage: " << argv[0] << " <ROM> <Cycles> [Output] [Options]" << '\n'
+                  << "Options:" << '\n'
+                  << "  --engine <interpreter|threaded|recompiler>   Cpu execution engine" << '\n'
+                  << "  --model <chip8|schip|xochip>                 Machine model, instruction set and display (default: chip8)" << '\n'
+                  << "  --quirks <vip|chip48|schip|xochip>           Instruction behaviours of an interpreter era (default: the model's)" << '\n'
+                  << "  --load-state <File>                          Start from a save state" << '\n'
+                  << "  --save-state <File>                          Save the final state" << '\n'
+                  << "  --seed <Number>                              Seed of the random generator (Cxkk)" << '\n'
+                  << "  --replay <File>                              Feed back a recording of the emulator" << '\n'
+                  << "  --profile <File>                             Per-opcode and per-address profile (profiler builds)" << '\n'
+                  << "  --profile-folded <File>                      Profile as folded stacks, for flame graphs" << '\n'
+                  << "  --capture-video <File.y4m|Directory>         Record the frames, as Y4M or as a PNG sequence" << '\n'
+                  << "  --capture-audio <File.wav>                   Record the sound timer tone" << '\n'
+                  << "  --capture-scale <Factor>                     Pixel size of the captured video (default 8)" << '\n';
+        std::exit(EXIT_FAILURE);
+    }
+
+    char* romFilename       { argv[1] };
+    uint64_t max_cycles     { std::stoull(argv[2]) };
+    std::string output_path {};
+    std::string load_state_path {};
+    std::string save_state_path {};
+    std::string replay_path {};
+    std::unique_ptr<ReplayPlayer> replay {};
+    std::string profile_path {};
+    std::string folded_path {};
+    std::unique_ptr<Profiler> profiler {};
+    std::string capture_video_path {};
+    std::string capture_audio_path {};
+    int capture_scale {CaptureSpecs::DefaultScale};
+    std::unique_ptr<FrameCapture> capture {};
+
+    Chip8 chip8 {};
+    MachineModel model {MachineModel::Chip8};
+    std::optional<QuirkProfile> quirks {};
+
+    try {
+        for (int i {3} ; i < argc ; ++i)
+        {
+            std::string arg { argv[i] };
+
+            if (arg == "--engine" && i + 1 < argc)
+            {
+                if (!chip8.getCpu()->setEngine(engineFromName(argv[++i])))
+                    throw std::runtime_error("Error: engine not available on this build : " + std::string(argv[i]));
+            }
+            else if (arg == "--model" && i + 1 < argc) model = machineModelFromName(argv[++i]);
+            else if (arg == "--quirks" && i + 1 < argc) quirks = quirkProfileFromName(argv[++i]);
+            else if (arg == "--load-state" && i + 1 < argc) load_state_path = argv[++i];
+            else if (arg == "--save-state" && i + 1 < argc) save_state_path = argv[++i];
+            else if (arg == "--replay" && i + 1 < argc) replay_path = argv[++i];
+            else if (arg == "--profile" && i + 1 < argc) profile_path = argv[++i];
+            else if (arg == "--profile-folded" && i + 1 < argc) folded_path = argv[++i];
+            else if (arg == "--capture-video" && i + 1 < argc) capture_video_path = argv[++i];
+            else if (arg == "--capture-audio" && i + 1 < argc) capture_audio_path = argv[++i];
+            else if (arg == "--capture-scale" && i + 1 < argc) capture_scale = std::stoi(argv[++i]);
+            else if (arg == "--seed" && i + 1 < argc) chip8.setSeed(std::stoull(argv[++i], nullptr, 0));
+            else if (output_path.empty() && arg.rfind("--", 0) != 0) output_path = arg;
+            else throw std::invalid_argument("Error: unexpected argument : " + arg);
+        }
+
+        // The model sets its own profile, --quirks overrides it
+        chip8.setModel(model);
+        if (quirks) chip8.getCpu()->setQuirks(*quirks);
+
+        if (!profile_path.empty() || !folded_path.empty())
+        {
+            profiler = std::make_unique<Profiler>();
+            if (!chip8.getCpu()->setProfiler(profiler.get()))
+                throw std::runtime_error("Error: profiler not available, configure with -DCHIP8PP_PROFILER=ON");
+        }
+
+        // Before the ROM is loaded, the model bounds its size
+        if (!replay_path.empty())
+        {
+            // Recordings start from a freshly loaded ROM
+            if (!load_state_path.empty())
+                throw std::invalid_argument("Error: --replay and --load-state cannot be combined");
+
+            replay = std::make_unique<ReplayPlayer>(replay_path);
+            if (replay->getHeader().rom_hash != hashRomFile(romFilename))
+                throw std::runtime_error("Error: replay was recorded on another ROM : " + replay_path);
+
+            chip8.setSeed(replay->getHeader().seed);
+            chip8.setModel(replay->getHeader().model);
+            chip8.getCpu()->setQuirks(replay->getHeader().quirks);
+        }
+
+        chip8.loadRomIntoMemory(romFilename);
+
+        if (!load_state_path.empty()) chip8.loadState(readStateFile(load_state_path));
+
+        if (!capture_video_path.empty() || !capture_audio_path.empty())
+            capture = std::make_unique<FrameCapture>(capture_video_path, capture_audio_path, capture_scale,
+                                                     chip8.getModel() != MachineModel::Chip8);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // Run frame by frame, without waiting for the clock,
+    // until the cycle budget is spent or the ROM halts
+    Scheduler scheduler(&chip8, replay ? replay->getHeader().instructions_per_second
+                                       : SchedulerSpecs::DefaultInstructionsPerSecond);
+    uint64_t executed_cycles {};
+
+    if (replay)
+    {
+        // A replay goes on until the recording ends, the player may
+        // rewind or load a state after the ROM halted
+        try {
+            while (executed_cycles < max_cycles && replay->ApplyInputs(scheduler.getFrameCount(), chip8))
+            {
+                uint64_t remaining { max_cycles - executed_cycles };
+                uint32_t budget { static_cast<uint32_t>(std::min<uint64_t>(remaining, UINT32_MAX)) };
+
+                // Frames of an unlimited rate recording are as long as they were
+                if (scheduler.getInstructionsPerSecond() == SchedulerSpecs::Unlimited)
+                    executed_cycles += scheduler.RunFrame(
+                        std::min(budget, replay->getFrameLength(scheduler.getFrameCount())),
+                        Scheduler::Clock::time_point::max());
+                else
+                    executed_cycles += scheduler.RunFrame(budget);
+
+                if (capture) capture->Push(chip8.getScreen(), chip8.getSoundTimer() > 0, chip8.getAudioPattern());
+            }
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        while (executed_cycles < max_cycles && !chip8.getCpu()->isHalted())
+        {
+            uint64_t remaining { max_cycles - executed_cycles };
+            executed_cycles += scheduler.RunFrame(
+                static_cast<uint32_t>(std::min<uint64_t>(remaining, UINT32_MAX)));
+
+            if (capture) capture->Push(chip8.getScreen(), chip8.getSoundTimer() > 0, chip8.getAudioPattern());
+        }
+    }
+
+    if (capture)
+    {
+        try {
+            capture->Close();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (profiler)
+    {
+        try {
+            writeProfileFiles(*profiler, profile_path, folded_path);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!save_state_path.empty())
+    {
+        try {
+            std::vector<uint8_t> state {};
+            chip8.saveState(state);
+            writeStateFile(save_state_path, state);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!output_path.empty())
+    {
+        std::ofstream output(output_path);
+        if (!output.is_open())
+        {
+            std::cerr << "Error: failed to open output : " << output_path << "\n";
+            return EXIT_FAILURE;
+        }
+
+        dumpState(chip8, executed_cycles, output);
+    }
+    else dumpState(chip8, executed_cycles, std::cout);
+
+    return 0;
+}
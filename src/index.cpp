@@ -0,0 +1,64 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "rom_library.hpp"
+
+/*
+    ROM library indexer: scans a directory for ROMs, hashes
+    them and finds the machine model and quirks each one needs,
+    from the ROM database when it knows the ROM, from the code
+    otherwise. The index is kept on disk and updated in place,
+    only new or modified ROMs are read again
+*/
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Index Usage: " << argv[0] << " <Directory> <Index> [Options]" << '\n'
+                  << "Options:" << '\n'
+                  << "  --database <File>                            Known ROMs: hash, model, quirks and title" << '\n';
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::string directory { argv[1] };
+    std::string index_path { argv[2] };
+    RomDatabase database {};
+    RomIndex index {};
+
+    auto start { std::chrono::steady_clock::now() };
+    size_t read_count {};
+
+    try {
+        for (int i {3} ; i < argc ; ++i)
+        {
+            std::string arg { argv[i] };
+
+            if (arg == "--database" && i + 1 < argc) database.LoadFromFile(argv[++i]);
+            else throw std::invalid_argument("Error: unexpected argument : " + arg);
+        }
+
+        index.LoadFromFile(index_path);
+        read_count = index.Scan(directory, database);
+        index.SaveToFile(index_path);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    size_t known_count {};
+    for (const RomInfo& info : index.getEntries())
+        known_count += info.known ? 1 : 0;
+
+    double wall_seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+
+    std::cerr << index.getEntries().size() << " ROMs indexed (" << known_count << " from the database), "
+              << read_count << " read, the others from the index, in "
+              << std::fixed << std::setprecision(3) << wall_seconds << " s\n";
+
+    return 0;
+}
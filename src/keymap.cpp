@@ -0,0 +1,89 @@
+#include "keymap.hpp"
+#include "constants.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    // Prefix of the controller bindings in layout files
+    const std::string PadPrefix {"pad"};
+
+    std::string trim(const std::string& text)
+    {
+        size_t first { text.find_first_not_of(" \t\r") };
+        if (first == std::string::npos) return {};
+
+        size_t last { text.find_last_not_of(" \t\r") };
+        return text.substr(first, last - first + 1);
+    }
+}
+
+KeyLayout::KeyLayout()
+{
+    keys.fill(KeyboardSpecs::Unbound);
+    buttons.fill(KeyboardSpecs::Unbound);
+
+    for (const KeyboardSpecs::KeyBinding& binding : KeyboardSpecs::DefaultKeys)
+        keys[binding.scancode] = binding.key;
+
+    for (const KeyboardSpecs::ButtonBinding& binding : KeyboardSpecs::DefaultButtons)
+        buttons[binding.button] = binding.key;
+}
+
+void KeyLayout::LoadFromFile(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Error: failed to open key layout : " + path);
+
+    // The file replaces the whole layout, unlisted keys are unbound
+    keys.fill(KeyboardSpecs::Unbound);
+    buttons.fill(KeyboardSpecs::Unbound);
+
+    std::string line {};
+
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        int key {};
+
+        if (!(fields >> std::hex >> key))
+        {
+            if (!trim(line).empty())
+                throw std::invalid_argument("Error: invalid key binding : " + line);
+            continue;
+        }
+
+        std::string rest {};
+        std::getline(fields, rest);
+        std::string name { trim(rest) };
+
+        if (key < 0 || key >= Chip8Specs::KeysCount || name.empty())
+            throw std::invalid_argument("Error: invalid key binding : " + line);
+
+        // Key names may contain spaces ("Keypad 8"), the
+        // controller prefix is a whole word
+        if (name.compare(0, PadPrefix.size(), PadPrefix) == 0 && name.size() > PadPrefix.size()
+            && (name[PadPrefix.size()] == ' ' || name[PadPrefix.size()] == '\t'))
+        {
+            std::string button_name { trim(name.substr(PadPrefix.size())) };
+            SDL_GameControllerButton button { SDL_GameControllerGetButtonFromString(button_name.c_str()) };
+            if (button == SDL_CONTROLLER_BUTTON_INVALID)
+                throw std::invalid_argument("Error: unknown controller button : " + button_name);
+
+            buttons[button] = static_cast<uint8_t>(key);
+        }
+        else
+        {
+            SDL_Scancode scancode { SDL_GetScancodeFromName(name.c_str()) };
+            if (scancode == SDL_SCANCODE_UNKNOWN)
+                throw std::invalid_argument("Error: unknown key name : " + name);
+
+            keys[scancode] = static_cast<uint8_t>(key);
+        }
+    }
+}
@@ -0,0 +1,308 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    enum OpcodeFamily : int
+    {
+        Op00E0, Op00EE, OpUnknown, Op1nnn, Op2nnn, Op3xkk, Op4xkk, Op5xy0,
+        Op6xkk, Op7xkk, Op8xy0, Op8xy1, Op8xy2, Op8xy3, Op8xy4, Op8xy5,
+        Op8xy6, Op8xy7, Op8xyE, Op9xy0, OpAnnn, OpBnnn, OpCxkk, OpDxyn,
+        OpEx9E, OpExA1, OpFx07, OpFx0A, OpFx15, OpFx18, OpFx1E, OpFx29,
+        OpFx33, OpFx55, OpFx65,
+        // SUPER-CHIP and XO-CHIP
+        Op00Cn, Op00Dn, Op00FB, Op00FC, Op00FD, Op00FE, Op00FF, Op5xy2,
+        Op5xy3, OpF000, OpFn01, OpF002, OpFx30, OpFx3A, OpFx75, OpFx85
+    };
+
+    const char* const FamilyNames[OpcodeFamilyCount] {
+        "00E0", "00EE", "unknown", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0",
+        "6xkk", "7xkk", "8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5",
+        "8xy6", "8xy7", "8xyE", "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn",
+        "Ex9E", "ExA1", "Fx07", "Fx0A", "Fx15", "Fx18", "Fx1E", "Fx29",
+        "Fx33", "Fx55", "Fx65",
+        "00Cn", "00Dn", "00FB", "00FC", "00FD", "00FE", "00FF", "5xy2",
+        "5xy3", "F000", "Fn01", "F002", "Fx30", "Fx3A", "Fx75", "Fx85"
+    };
+
+    std::string hex4(uint16_t value)
+    {
+        static const char* digits {"0123456789ABCDEF"};
+        return { digits[(value >> 12u) & 0xFu], digits[(value >> 8u) & 0xFu],
+                 digits[(value >> 4u) & 0xFu], digits[value & 0xFu] };
+    }
+
+    double percentOf(uint64_t part, uint64_t total)
+    {
+        return total ? 100.0 * static_cast<double>(part) / static_cast<double>(total) : 0.0;
+    }
+}
+
+int opcodeFamilyOf(uint16_t opcode)
+{
+    uint8_t low { static_cast<uint8_t>(opcode & 0xFFu) };
+
+    switch (opcode >> 12u)
+    {
+    case 0x0:
+        if (opcode == 0x00E0) return Op00E0;
+        if (opcode == 0x00EE) return Op00EE;
+        if ((opcode & 0xFFF0u) == 0x00C0) return Op00Cn;
+        if ((opcode & 0xFFF0u) == 0x00D0) return Op00Dn;
+        if (opcode == 0x00FB) return Op00FB;
+        if (opcode == 0x00FC) return Op00FC;
+        if (opcode == 0x00FD) return Op00FD;
+        if (opcode == 0x00FE) return Op00FE;
+        if (opcode == 0x00FF) return Op00FF;
+        return OpUnknown;
+    case 0x1: return Op1nnn;
+    case 0x2: return Op2nnn;
+    case 0x3: return Op3xkk;
+    case 0x4: return Op4xkk;
+    case 0x5:
+        switch (opcode & 0xFu)
+        {
+        case 0x0: return Op5xy0;
+        case 0x2: return Op5xy2;
+        case 0x3: return Op5xy3;
+        default:  return OpUnknown;
+        }
+    case 0x6: return Op6xkk;
+    case 0x7: return Op7xkk;
+    case 0x8:
+        switch (opcode & 0xFu)
+        {
+        case 0x0: return Op8xy0;
+        case 0x1: return Op8xy1;
+        case 0x2: return Op8xy2;
+        case 0x3: return Op8xy3;
+        case 0x4: return Op8xy4;
+        case 0x5: return Op8xy5;
+        case 0x6: return Op8xy6;
+        case 0x7: return Op8xy7;
+        case 0xE: return Op8xyE;
+        default:  return OpUnknown;
+        }
+    case 0x9: return (opcode & 0xFu) == 0 ? Op9xy0 : OpUnknown;
+    case 0xA: return OpAnnn;
+    case 0xB: return OpBnnn;
+    case 0xC: return OpCxkk;
+    case 0xD: return OpDxyn;
+    case 0xE:
+        if (low == 0x9E) return OpEx9E;
+        if (low == 0xA1) return OpExA1;
+        return OpUnknown;
+    default:
+        switch (low)
+        {
+        case 0x00: return (opcode == 0xF000) ? OpF000 : OpUnknown;
+        case 0x01: return OpFn01;
+        case 0x02: return (opcode == 0xF002) ? OpF002 : OpUnknown;
+        case 0x07: return OpFx07;
+        case 0x0A: return OpFx0A;
+        case 0x15: return OpFx15;
+        case 0x18: return OpFx18;
+        case 0x1E: return OpFx1E;
+        case 0x29: return OpFx29;
+        case 0x30: return OpFx30;
+        case 0x3A: return OpFx3A;
+        case 0x33: return OpFx33;
+        case 0x55: return OpFx55;
+        case 0x65: return OpFx65;
+        case 0x75: return OpFx75;
+        case 0x85: return OpFx85;
+        default:   return OpUnknown;
+        }
+    }
+}
+
+const char* opcodeFamilyName(int family)
+{
+    return (family >= 0 && family < OpcodeFamilyCount) ? FamilyNames[family] : "unknown";
+}
+
+Profiler::Profiler()
+{
+    Reset();
+}
+
+void Profiler::add(Counter& counter, uint64_t host_ns)
+{
+    ++counter.instructions;
+    counter.host_ns += host_ns;
+}
+
+void Profiler::End()
+{
+    uint64_t host_ns { static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()) };
+
+    add(families[family], host_ns);
+    add(addresses[address], host_ns);
+    add(nodes[current_node].self, host_ns);
+    opcodes[address] = opcode;
+
+    // The call itself is charged to the caller
+    if (family == Op2nnn) enterCall(opcode & 0x0FFFu);
+    else if (family == Op00EE) leaveCall();
+}
+
+void Profiler::enterCall(uint16_t target)
+{
+    if (depth >= ProfilerSpecs::MaxCallDepth)
+    {
+        ++untracked_calls;
+        return;
+    }
+
+    uint64_t key { (static_cast<uint64_t>(current_node) << 16u) | target };
+    auto [child, inserted] { children.try_emplace(key, static_cast<uint32_t>(nodes.size())) };
+
+    if (inserted)
+        nodes.push_back(CallNode { current_node, target, Counter {} });
+
+    current_node = child->second;
+    ++depth;
+}
+
+void Profiler::leaveCall()
+{
+    if (untracked_calls > 0)
+    {
+        --untracked_calls;
+        return;
+    }
+
+    // Returning from the root is a bug of the ROM, stay there
+    if (depth == 0) return;
+
+    current_node = nodes[current_node].parent;
+    --depth;
+}
+
+void Profiler::ResetCallStack()
+{
+    current_node = 0;
+    depth = 0;
+    untracked_calls = 0;
+}
+
+void Profiler::Reset()
+{
+    std::fill(std::begin(families), std::end(families), Counter {});
+    std::fill(std::begin(addresses), std::end(addresses), Counter {});
+    std::fill(std::begin(opcodes), std::end(opcodes), 0);
+
+    nodes.assign(1, CallNode {});
+    children.clear();
+    ResetCallStack();
+}
+
+uint64_t Profiler::getInstructionCount()
+{
+    return std::accumulate(std::begin(families), std::end(families), uint64_t {},
+        [](uint64_t total, const Counter& counter) { return total + counter.instructions; });
+}
+
+void Profiler::writeReport(std::ostream& out, size_t hot_addresses)
+{
+    uint64_t total_instructions { getInstructionCount() };
+    uint64_t total_ns { std::accumulate(std::begin(families), std::end(families), uint64_t {},
+        [](uint64_t total, const Counter& counter) { return total + counter.host_ns; }) };
+
+    out << std::fixed << "Instructions: " << total_instructions
+        << "  Host time: " << std::setprecision(3) << static_cast<double>(total_ns) / 1e6 << " ms\n\n";
+
+    std::vector<int> order(OpcodeFamilyCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+        [this](int a, int b) { return families[a].host_ns > families[b].host_ns; });
+
+    out << std::left << std::setw(10) << "family" << std::right << std::setw(15) << "instructions"
+        << std::setw(9) << "share" << std::setw(12) << "host ms" << std::setw(9) << "time"
+        << std::setw(11) << "ns/instr" << '\n';
+
+    for (int index : order)
+    {
+        const Counter& counter { families[index] };
+        if (counter.instructions == 0) continue;
+
+        out << std::left << std::setw(10) << opcodeFamilyName(index) << std::right
+            << std::setw(15) << counter.instructions
+            << std::setprecision(1) << std::setw(8) << percentOf(counter.instructions, total_instructions) << '%'
+            << std::setprecision(3) << std::setw(12) << static_cast<double>(counter.host_ns) / 1e6
+            << std::setprecision(1) << std::setw(8) << percentOf(counter.host_ns, total_ns) << '%'
+            << std::setprecision(2) << std::setw(11)
+            << static_cast<double>(counter.host_ns) / static_cast<double>(counter.instructions) << '\n';
+    }
+
+    std::vector<uint16_t> hot(Chip8Specs::MemorySize);
+    std::iota(hot.begin(), hot.end(), uint16_t {});
+    hot.erase(std::remove_if(hot.begin(), hot.end(),
+        [this](uint16_t index) { return addresses[index].instructions == 0; }), hot.end());
+
+    size_t shown { std::min(hot_addresses, hot.size()) };
+    std::partial_sort(hot.begin(), hot.begin() + static_cast<std::ptrdiff_t>(shown), hot.end(),
+        [this](uint16_t a, uint16_t b) { return addresses[a].instructions > addresses[b].instructions; });
+
+    out << '\n' << std::left << std::setw(10) << "address" << std::setw(8) << "opcode"
+        << std::right << std::setw(15) << "instructions" << std::setw(9) << "share"
+        << std::setw(12) << "host ms" << '\n';
+
+    for (size_t i {} ; i < shown ; ++i)
+    {
+        const Counter& counter { addresses[hot[i]] };
+
+        out << std::left << std::setw(10) << "0x" + hex4(hot[i]) << std::setw(8) << hex4(opcodes[hot[i]])
+            << std::right << std::setw(15) << counter.instructions
+            << std::setprecision(1) << std::setw(8) << percentOf(counter.instructions, total_instructions) << '%'
+            << std::setprecision(3) << std::setw(12) << static_cast<double>(counter.host_ns) / 1e6 << '\n';
+    }
+}
+
+void Profiler::writeFoldedStacks(std::ostream& out)
+{
+    std::vector<uint32_t> path {};
+
+    for (uint32_t index {} ; index < nodes.size() ; ++index)
+    {
+        if (nodes[index].self.instructions == 0) continue;
+
+        path.clear();
+        for (uint32_t node {index} ; node != 0 ; node = nodes[node].parent)
+            path.push_back(node);
+
+        out << "rom";
+        for (auto it { path.rbegin() } ; it != path.rend() ; ++it)
+            out << ";sub_" << hex4(nodes[*it].address);
+
+        out << ' ' << nodes[index].self.instructions << '\n';
+    }
+}
+
+void writeProfileFiles(Profiler& profiler, const std::string& report_path, const std::string& folded_path)
+{
+    if (!report_path.empty())
+    {
+        std::ofstream report(report_path);
+        if (!report.is_open())
+            throw std::runtime_error("Error: failed to open profile : " + report_path);
+
+        profiler.writeReport(report);
+    }
+
+    if (!folded_path.empty())
+    {
+        std::ofstream folded(folded_path);
+        if (!folded.is_open())
+            throw std::runtime_error("Error: failed to open profile : " + folded_path);
+
+        profiler.writeFoldedStacks(folded);
+    }
+}
@@ -0,0 +1,513 @@
+#include "recompiler.hpp"
+#include "chip8.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__FreeBSD__))
+#define CHIP8PP_HAS_RECOMPILER 1
+#include <sys/mman.h>
+#else
+#define CHIP8PP_HAS_RECOMPILER 0
+#endif
+
+namespace
+{
+    constexpr size_t CodeBufferSize {4 * 1024 * 1024};
+    // Longest block, in instructions
+    constexpr size_t MaxBlockLength {64};
+    // Worst case size of a compiled block, a handler call being
+    // the largest sequence emitted for a single instruction
+    constexpr size_t MaxBlockBytes {MaxBlockLength * 64 + 128};
+    // Executions of an address before its block is compiled
+    constexpr uint8_t HotThreshold {8};
+    // Marks the addresses from which nothing can be compiled
+    constexpr uint8_t NeverCompile {0xFF};
+
+    // Context field offsets, used by the generated code
+    constexpr uint8_t CtxRegisters     {8};
+    constexpr uint8_t CtxBudget        {16};
+    constexpr uint8_t CtxIndexRegister {24};
+    constexpr uint8_t CtxPc            {28};
+
+    enum class Flow
+    {
+        // Emitted inline or as a handler call, keep going
+        Continue,
+        // Handler call, then leave the block (jumps, skips,
+        // calls, memory writes)
+        Terminate,
+        // Leave the block before it, the interpreter runs it
+        Interpret,
+        // Plain jump, chained to the target block
+        Jump,
+        // Conditional skip, both paths chained
+        Skip,
+    };
+
+    Flow classify(uint16_t opcode, uint16_t address, MachineModel model)
+    {
+        // XO-CHIP skips over F000 nnnn as a whole, the
+        // length of the skip is only known by the handler
+        Flow skip { model == MachineModel::XoChip ? Flow::Terminate : Flow::Skip };
+
+        switch ((opcode & 0xF000u) >> 12u)
+        {
+        case 0x0:
+            return (opcode == 0x00EE || opcode == 0x00FD) ? Flow::Terminate : Flow::Continue;
+        case 0x1:
+            // A jump onto itself halts, the handler takes care of it
+            return ((opcode & 0x0FFFu) == address) ? Flow::Terminate : Flow::Jump;
+        case 0x5:
+            // 5xy2 and 5xy3 on XO-CHIP, 5xy2 writes memory
+            return (model == MachineModel::XoChip && (opcode & 0x000Fu) != 0) ? Flow::Terminate : skip;
+        case 0x3: case 0x4: case 0x9:
+            return skip;
+        case 0x2: case 0xB: case 0xE:
+            return Flow::Terminate;
+        case 0xD:
+            return Flow::Interpret;
+        case 0xF:
+            switch (opcode & 0x00FFu)
+            {
+            case 0x0A: return Flow::Interpret;
+            case 0x33: case 0x55: return Flow::Terminate;
+            case 0x00: return (opcode == 0xF000) ? Flow::Terminate : Flow::Continue;
+            default: return Flow::Continue;
+            }
+        default:
+            return Flow::Continue;
+        }
+    }
+}
+
+Recompiler::Recompiler(Cpu* cpu, Chip8* system) : cpu {cpu}, system {system}
+{
+    static_assert(offsetof(Context, registers) == CtxRegisters, "Context layout");
+    static_assert(offsetof(Context, budget) == CtxBudget, "Context layout");
+    static_assert(offsetof(Context, index_register) == CtxIndexRegister, "Context layout");
+    static_assert(offsetof(Context, pc) == CtxPc, "Context layout");
+
+    context.cpu = cpu;
+    context.registers = cpu->registers;
+
+    compiled.assign(static_cast<size_t>(cpu->memory_size), nullptr);
+    hits.assign(static_cast<size_t>(cpu->memory_size), 0);
+
+#if CHIP8PP_HAS_RECOMPILER
+    // Blocks get chained by patching jumps in place, so the
+    // buffer stays writable and executable
+    void* buffer { mmap(nullptr, CodeBufferSize, PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) };
+
+    if (buffer != MAP_FAILED)
+    {
+        code = static_cast<uint8_t*>(buffer);
+        code_size = CodeBufferSize;
+        emitThunks();
+    }
+#endif
+}
+
+Recompiler::~Recompiler()
+{
+#if CHIP8PP_HAS_RECOMPILER
+    if (code) munmap(code, code_size);
+#endif
+}
+
+bool Recompiler::isAvailable() { return code != nullptr; }
+
+// === Code emission ===
+
+void Recompiler::emit8(uint8_t value) { code[code_used++] = value; }
+
+void Recompiler::emit32(uint32_t value)
+{
+    std::memcpy(code + code_used, &value, sizeof(value));
+    code_used += sizeof(value);
+}
+
+void Recompiler::emit64(uint64_t value)
+{
+    std::memcpy(code + code_used, &value, sizeof(value));
+    code_used += sizeof(value);
+}
+
+void Recompiler::emitBytes(std::initializer_list<uint8_t> bytes)
+{
+    for (uint8_t byte : bytes) emit8(byte);
+}
+
+void Recompiler::emitJump(size_t target_offset)
+{
+    // jmp rel32
+    emit8(0xE9);
+    emit32(static_cast<uint32_t>(static_cast<int64_t>(target_offset) - static_cast<int64_t>(code_used + 4)));
+}
+
+void Recompiler::emitExit(uint16_t pc)
+{
+    // mov dword [r13 + pc], imm32
+    emitBytes({0x41, 0xC7, 0x45, CtxPc});
+    emit32(pc);
+    emitJump(exit_offset);
+}
+
+void Recompiler::emitChain(uint16_t target)
+{
+    if (target + 1 < cpu->memory_size && compiled[target])
+    {
+        emitJump(compiled[target] - code);
+        return;
+    }
+
+    // Jump to the exit stub right after, patched once
+    // the target block gets compiled
+    emit8(0xE9);
+    pending_chains.push_back({code_used, target});
+    emit32(0);
+    emitExit(target);
+}
+
+void Recompiler::emitHandlerCall(const CompiledOp* op)
+{
+    // mov [r13 + index_register], r12d
+    emitBytes({0x45, 0x89, 0x65, CtxIndexRegister});
+    // mov rdi, r13
+    emitBytes({0x4C, 0x89, 0xEF});
+    // mov rsi, op
+    emitBytes({0x48, 0xBE});
+    emit64(reinterpret_cast<uint64_t>(op));
+    // mov rax, CallHandler ; call rax
+    emitBytes({0x48, 0xB8});
+    emit64(reinterpret_cast<uint64_t>(&Recompiler::CallHandler));
+    emitBytes({0xFF, 0xD0});
+    // mov r12d, [r13 + index_register]
+    emitBytes({0x45, 0x8B, 0x65, CtxIndexRegister});
+}
+
+bool Recompiler::emitInline(const Cpu::DecodedInstruction& decoded)
+{
+    // Register operands are addressed as [rbx + n]
+    const uint8_t x { decoded.x };
+    const uint8_t y { decoded.y };
+
+    switch ((decoded.opcode & 0xF000u) >> 12u)
+    {
+    case 0x6:
+        // mov byte [rbx + x], kk
+        emitBytes({0xC6, 0x43, x, decoded.byte});
+        return true;
+    case 0x7:
+        // add byte [rbx + x], kk
+        emitBytes({0x80, 0x43, x, decoded.byte});
+        return true;
+    case 0xA:
+        // mov r12d, nnn
+        emitBytes({0x41, 0xBC});
+        emit32(decoded.address);
+        return true;
+    case 0x8:
+        switch (decoded.opcode & 0x000Fu)
+        {
+        case 0x0:
+            // mov al, [rbx + y] ; mov [rbx + x], al
+            emitBytes({0x8A, 0x43, y, 0x88, 0x43, x});
+            return true;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+        {
+            // mov al, [rbx + y] ; or/and/xor [rbx + x], al ; mov byte [rbx + 15], 0
+            static constexpr uint8_t logic_opcodes[] {0x00, 0x08, 0x20, 0x30};
+            emitBytes({0x8A, 0x43, y, logic_opcodes[decoded.opcode & 0x000Fu], 0x43, x});
+            // Only the profiles resetting VF get the store
+            if (quirkFlagsOf(cpu->quirks).resets_flag)
+                emitBytes({0xC6, 0x43, 0x0F, 0x00});
+            return true;
+        }
+        case 0x4:
+            // mov al, [rbx + x] ; add al, [rbx + y] ; setc cl
+            // mov [rbx + x], al ; mov [rbx + 15], cl
+            emitBytes({0x8A, 0x43, x, 0x02, 0x43, y, 0x0F, 0x92, 0xC1});
+            emitBytes({0x88, 0x43, x, 0x88, 0x4B, 0x0F});
+            return true;
+        case 0x5:
+            // mov al, [rbx + x] ; sub al, [rbx + y] ; setnc cl
+            // mov [rbx + x], al ; mov [rbx + 15], cl
+            emitBytes({0x8A, 0x43, x, 0x2A, 0x43, y, 0x0F, 0x93, 0xC1});
+            emitBytes({0x88, 0x43, x, 0x88, 0x4B, 0x0F});
+            return true;
+        case 0x7:
+            // mov al, [rbx + y] ; sub al, [rbx + x] ; setnc cl
+            // mov [rbx + x], al ; mov [rbx + 15], cl
+            emitBytes({0x8A, 0x43, y, 0x2A, 0x43, x, 0x0F, 0x93, 0xC1});
+            emitBytes({0x88, 0x43, x, 0x88, 0x4B, 0x0F});
+            return true;
+        default:
+            return false;
+        }
+    case 0xF:
+        switch (decoded.opcode & 0x00FFu)
+        {
+        case 0x1E:
+            // movzx eax, byte [rbx + x] ; add r12d, eax ; and r12d, 0xFFFF
+            emitBytes({0x0F, 0xB6, 0x43, x, 0x41, 0x01, 0xC4});
+            emitBytes({0x41, 0x81, 0xE4, 0xFF, 0xFF, 0x00, 0x00});
+            return true;
+        case 0x29:
+            // movzx eax, byte [rbx + x] ; lea eax, [rax + rax * 4 + FontSetStartAddress]
+            // mov r12d, eax
+            emitBytes({0x0F, 0xB6, 0x43, x});
+            emitBytes({0x8D, 0x44, 0x80, static_cast<uint8_t>(Chip8Specs::FontSetStartAddress)});
+            emitBytes({0x41, 0x89, 0xC4});
+            return true;
+        default:
+            return false;
+        }
+    default:
+        return false;
+    }
+}
+
+void Recompiler::emitThunks()
+{
+    // enter(context, block): saves the callee-saved registers used
+    // by compiled code, loads the machine state and jumps to the block
+    enter_offset = code_used;
+    // push rbx ; push r12 ; push r13
+    emitBytes({0x53, 0x41, 0x54, 0x41, 0x55});
+    // mov r13, rdi
+    emitBytes({0x49, 0x89, 0xFD});
+    // mov rbx, [r13 + registers]
+    emitBytes({0x49, 0x8B, 0x5D, CtxRegisters});
+    // mov r12d, [r13 + index_register]
+    emitBytes({0x45, 0x8B, 0x65, CtxIndexRegister});
+    // jmp rsi
+    emitBytes({0xFF, 0xE6});
+
+    // Common exit: writes the index register back and returns
+    exit_offset = code_used;
+    // mov [r13 + index_register], r12d
+    emitBytes({0x45, 0x89, 0x65, CtxIndexRegister});
+    // pop r13 ; pop r12 ; pop rbx ; ret
+    emitBytes({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});
+}
+
+void Recompiler::Flush()
+{
+    // Keep the thunks at the start of the buffer
+    code_used = exit_offset + 10;
+
+    // Sized again, the model may have changed since
+    compiled.assign(static_cast<size_t>(cpu->memory_size), nullptr);
+    hits.assign(static_cast<size_t>(cpu->memory_size), 0);
+    pending_chains.clear();
+    compiled_ops.clear();
+}
+
+uint8_t* Recompiler::Compile(uint16_t start)
+{
+    if (code_size - code_used < MaxBlockBytes) Flush();
+
+    size_t entry_offset { code_used };
+    size_t budget_patch {};
+    uint32_t length {};
+    uint16_t address {start};
+
+    // Budget check, bails out with pc at the start of the block:
+    // cmp qword [r13 + budget], length ; jl bail ; sub qword [r13 + budget], length
+    emitBytes({0x49, 0x81, 0x7D, CtxBudget});
+    budget_patch = code_used;
+    emit32(0);
+    emitBytes({0x0F, 0x8C});
+    size_t bail_patch { code_used };
+    emit32(0);
+    emitBytes({0x49, 0x81, 0x6D, CtxBudget});
+    emit32(0);
+
+    bool block_open {true};
+
+    while (block_open)
+    {
+        if (length == MaxBlockLength || address + 1 >= cpu->memory_size)
+        {
+            emitExit(address);
+            break;
+        }
+
+        Cpu::DecodedInstruction decoded {};
+        cpu->decode(address, decoded);
+        Flow flow { classify(decoded.opcode, address, cpu->model) };
+
+        switch (flow)
+        {
+        case Flow::Interpret:
+            emitExit(address);
+            block_open = false;
+            break;
+        case Flow::Jump:
+            ++length;
+            emitChain(decoded.address);
+            block_open = false;
+            break;
+        case Flow::Skip:
+        {
+            ++length;
+
+            // cmp byte [rbx + x], kk  or  mov al, [rbx + x] ; cmp al, [rbx + y]
+            uint8_t instruction_id { static_cast<uint8_t>((decoded.opcode & 0xF000u) >> 12u) };
+            if (instruction_id == 0x3 || instruction_id == 0x4)
+                emitBytes({0x80, 0x7B, decoded.x, decoded.byte});
+            else
+                emitBytes({0x8A, 0x43, decoded.x, 0x3A, 0x43, decoded.y});
+
+            // je / jne to the skipping path
+            bool skip_if_equal { instruction_id == 0x3 || instruction_id == 0x5 };
+            emitBytes({0x0F, static_cast<uint8_t>(skip_if_equal ? 0x84 : 0x85)});
+            size_t skip_patch { code_used };
+            emit32(0);
+
+            emitChain(address + 2);
+
+            int32_t skip_rel { static_cast<int32_t>(code_used - (skip_patch + 4)) };
+            std::memcpy(code + skip_patch, &skip_rel, sizeof(skip_rel));
+            emitChain(address + 4);
+
+            block_open = false;
+            break;
+        }
+        case Flow::Continue:
+        case Flow::Terminate:
+            ++length;
+
+            if (flow == Flow::Continue && emitInline(decoded))
+                break;
+
+            compiled_ops.push_back({decoded, address});
+            emitHandlerCall(&compiled_ops.back());
+
+            if (flow == Flow::Terminate)
+            {
+                // CallHandler stored the next pc in the context and
+                // returned the block compiled there, if any:
+                // test rax, rax ; jz exit ; jmp rax
+                emitBytes({0x48, 0x85, 0xC0, 0x0F, 0x84});
+                emit32(static_cast<uint32_t>(static_cast<int64_t>(exit_offset) - static_cast<int64_t>(code_used + 4)));
+                emitBytes({0xFF, 0xE0});
+                block_open = false;
+            }
+            break;
+        }
+
+        cpu->block_coverage[address] = cpu->block_coverage[address + 1] = 1;
+        address += 2;
+    }
+
+    if (length == 0)
+    {
+        // Nothing to compile from here (Dxyn, Fx0A)
+        code_used = entry_offset;
+        hits[start] = NeverCompile;
+        return nullptr;
+    }
+
+    // Bail out stub
+    size_t bail_offset { code_used };
+    emitExit(start);
+
+    std::memcpy(code + budget_patch, &length, sizeof(length));
+    std::memcpy(code + budget_patch + 4 + 2 + 4 + 4, &length, sizeof(length));
+    int32_t bail_rel { static_cast<int32_t>(bail_offset - (bail_patch + 4)) };
+    std::memcpy(code + bail_patch, &bail_rel, sizeof(bail_rel));
+
+    compiled[start] = code + entry_offset;
+
+    // Chain the blocks that were waiting for this one
+    for (auto chain { pending_chains.begin() } ; chain != pending_chains.end() ; )
+    {
+        if (chain->target == start)
+        {
+            int32_t rel { static_cast<int32_t>(entry_offset - (chain->rel32_offset + 4)) };
+            std::memcpy(code + chain->rel32_offset, &rel, sizeof(rel));
+            chain = pending_chains.erase(chain);
+        }
+        else ++chain;
+    }
+
+    return compiled[start];
+}
+
+uint8_t* Recompiler::CallHandler(Context* context, const CompiledOp* op)
+{
+    Cpu* cpu { context->cpu };
+
+    cpu->system->setIndexRegister(static_cast<uint16_t>(context->index_register));
+    cpu->pc = op->address + 2;
+    cpu->current = &op->decoded;
+    cpu->opcode = op->decoded.opcode;
+
+    (cpu->*op->decoded.handler)();
+
+    context->index_register = cpu->system->getIndexRegister();
+    context->pc = cpu->pc;
+
+    // Lets the generated code go on with the next block without
+    // going back to the dispatcher, unless something has to be
+    // handled there first
+    Recompiler* recompiler { cpu->recompiler.get() };
+    if (cpu->halted || cpu->blocks_flush_pending || cpu->pc + 1 >= cpu->memory_size)
+        return nullptr;
+
+    return recompiler->compiled[cpu->pc];
+}
+
+uint32_t Recompiler::Run(uint32_t max_instructions)
+{
+    uint32_t executed {};
+
+    while (executed < max_instructions && !cpu->halted)
+    {
+        if (cpu->blocks_flush_pending)
+        {
+            Flush();
+            cpu->flushBlocks();
+        }
+
+        uint16_t pc { cpu->pc };
+        uint8_t* entry {nullptr};
+
+        if (code && pc + 1 < cpu->memory_size)
+        {
+            entry = compiled[pc];
+
+            if (!entry && hits[pc] != NeverCompile && ++hits[pc] >= HotThreshold)
+                entry = Compile(pc);
+        }
+
+        if (entry)
+        {
+            uint32_t budget { max_instructions - executed };
+            context.budget = budget;
+            context.index_register = system->getIndexRegister();
+
+            reinterpret_cast<EnterFunction>(code + enter_offset)(&context, entry);
+
+            uint32_t ran { budget - static_cast<uint32_t>(context.budget) };
+            cpu->pc = static_cast<uint16_t>(context.pc);
+            system->setIndexRegister(static_cast<uint16_t>(context.index_register));
+
+            executed += ran;
+
+            // Not enough budget left for the block
+            if (ran > 0) continue;
+        }
+
+        // Cold code, or code left to the interpreter
+        cpu->Cycle();
+        ++executed;
+    }
+
+    return executed;
+}
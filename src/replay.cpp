@@ -0,0 +1,205 @@
+#include "replay.hpp"
+#include "chip8.hpp"
+#include "rom_image.hpp"
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    enum RecordKind : uint8_t
+    {
+        Key,
+        Frame,
+        State,
+        End
+    };
+}
+
+uint64_t hashRomFile(const std::string& filename)
+{
+    RomImage rom {filename};
+
+    uint64_t hash {0xCBF29CE484222325u};
+    for (size_t i {} ; i < rom.size() ; ++i)
+    {
+        hash ^= rom.data()[i];
+        hash *= 0x100000001B3u;
+    }
+
+    return hash;
+}
+
+ReplayRecorder::ReplayRecorder(const std::string& filename, const ReplayHeader& header)
+    : file {filename, std::ios::binary}, header {header}
+{
+    if (!file.is_open())
+        throw std::runtime_error("Error: failed to open replay : " + filename);
+
+    StateWriter writer {buffer};
+    writer.putBytes(ReplaySpecs::Magic, sizeof(ReplaySpecs::Magic));
+    writer.put16(ReplaySpecs::Version);
+    writer.put64(header.rom_hash);
+    writer.put64(header.seed);
+    writer.put32(static_cast<uint32_t>(header.instructions_per_second));
+    writer.put8(static_cast<uint8_t>(header.quirks));
+    writer.put8(static_cast<uint8_t>(header.model));
+
+    flush();
+}
+
+ReplayRecorder::~ReplayRecorder()
+{
+    Finish(last_frame);
+}
+
+void ReplayRecorder::putRecord(uint64_t frame, uint8_t kind)
+{
+    StateWriter writer {buffer};
+    writer.putVarint(((frame - last_frame) << 2u) | kind);
+    last_frame = frame;
+}
+
+void ReplayRecorder::flush()
+{
+    file.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+}
+
+void ReplayRecorder::RecordInputs(uint64_t frame, Chip8& system)
+{
+    if (finished) return;
+
+    const uint8_t* current { system.getKeypad() };
+
+    for (int i {} ; i < Chip8Specs::KeysCount ; ++i)
+    {
+        uint8_t pressed { current[i] ? uint8_t {1} : uint8_t {0} };
+        if (pressed == keypad[i]) continue;
+
+        putRecord(frame, Key);
+        buffer.push_back(static_cast<uint8_t>(i | (pressed << 4u)));
+        keypad[i] = pressed;
+    }
+
+    flush();
+}
+
+void ReplayRecorder::RecordStateLoad(uint64_t frame, Chip8& system)
+{
+    if (finished) return;
+
+    system.saveState(state);
+
+    putRecord(frame, State);
+    StateWriter writer {buffer};
+    writer.putVarint(state.size());
+    writer.putBytes(state.data(), state.size());
+    flush();
+
+    // Key changes are relative to the restored machine
+    for (int i {} ; i < Chip8Specs::KeysCount ; ++i)
+        keypad[i] = system.getKeypad()[i] ? 1 : 0;
+}
+
+void ReplayRecorder::RecordFrame(uint64_t frame, uint32_t executed)
+{
+    if (finished || header.instructions_per_second != SchedulerSpecs::Unlimited) return;
+
+    putRecord(frame, Frame);
+    StateWriter {buffer}.putVarint(executed);
+    flush();
+}
+
+void ReplayRecorder::Finish(uint64_t frame)
+{
+    if (finished) return;
+
+    putRecord(std::max(frame, last_frame), End);
+    flush();
+    file.flush();
+    finished = true;
+}
+
+ReplayPlayer::ReplayPlayer(const std::string& filename)
+    : data {readStateFile(filename)}
+{
+    reader = StateReader {data.data(), data.size()};
+
+    uint8_t magic[sizeof(ReplaySpecs::Magic)] {};
+    reader.getBytes(magic, sizeof(magic));
+    if (!std::equal(std::begin(magic), std::end(magic), std::begin(ReplaySpecs::Magic)))
+        throw std::runtime_error("Error: not a replay : " + filename);
+
+    uint16_t version { reader.get16() };
+    if (version != ReplaySpecs::Version)
+        throw std::runtime_error("Error: unsupported replay version : " + std::to_string(version));
+
+    header.rom_hash = reader.get64();
+    header.seed = reader.get64();
+    header.instructions_per_second = static_cast<int>(reader.get32());
+
+    uint8_t quirks { reader.get8() };
+    if (quirks > static_cast<uint8_t>(QuirkProfile::XoChip))
+        throw std::runtime_error("Error: unknown quirk profile in replay : " + filename);
+    header.quirks = static_cast<QuirkProfile>(quirks);
+
+    uint8_t model { reader.get8() };
+    if (model > static_cast<uint8_t>(MachineModel::XoChip))
+        throw std::runtime_error("Error: unknown machine model in replay : " + filename);
+    header.model = static_cast<MachineModel>(model);
+
+    readRecord();
+}
+
+const ReplayHeader& ReplayPlayer::getHeader() { return header; }
+
+// A recording cut short (crash, killed process) ends at its last record
+void ReplayPlayer::readRecord()
+{
+    if (reader.atEnd())
+    {
+        kind = End;
+        ended = true;
+        return;
+    }
+
+    uint64_t value { reader.getVarint() };
+    record_frame += value >> 2u;
+    kind = value & 3u;
+    ended = (kind == End);
+}
+
+bool ReplayPlayer::ApplyInputs(uint64_t frame, Chip8& system)
+{
+    while (!ended && record_frame <= frame && (kind == Key || kind == State))
+    {
+        if (kind == Key)
+        {
+            uint8_t key { reader.get8() };
+            system.setKeypad(key & 0xFu, (key >> 4u) & 1u);
+        }
+        else
+        {
+            state.resize(reader.getVarint());
+            reader.getBytes(state.data(), state.size());
+            system.loadState(state);
+        }
+
+        readRecord();
+    }
+
+    return !(ended && record_frame <= frame);
+}
+
+uint32_t ReplayPlayer::getFrameLength(uint64_t frame)
+{
+    if (ended || kind != Frame || record_frame != frame)
+        throw std::runtime_error("Error: corrupted replay, missing frame length");
+
+    uint32_t executed { static_cast<uint32_t>(reader.getVarint()) };
+    readRecord();
+
+    return executed;
+}
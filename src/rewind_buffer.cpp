@@ -0,0 +1,195 @@
+#include "rewind_buffer.hpp"
+#include "chip8.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+    // LEB128, runs are usually short
+    void putVarint(std::vector<uint8_t>& out, size_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80u));
+            value >>= 7u;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    size_t getVarint(const std::vector<uint8_t>& in, size_t& offset)
+    {
+        size_t value {};
+        unsigned int shift {};
+
+        while (offset < in.size())
+        {
+            uint8_t byte { in[offset++] };
+            value |= static_cast<size_t>(byte & 0x7Fu) << shift;
+            if (!(byte & 0x80u)) return value;
+            shift += 7;
+        }
+
+        throw std::runtime_error("Error: corrupted rewind delta");
+    }
+
+    /*
+        Delta of state against keyframe, as a list of
+        (unchanged byte count, changed byte count, changed bytes XOR keyframe)
+    */
+    void encodeDelta(const std::vector<uint8_t>& keyframe, const std::vector<uint8_t>& state, std::vector<uint8_t>& out)
+    {
+        size_t i {};
+
+        while (i < state.size())
+        {
+            size_t run_start {i};
+            while (i < state.size() && state[i] == keyframe[i]) ++i;
+            if (i == state.size()) break;
+            putVarint(out, i - run_start);
+
+            // Short equal runs are cheaper kept inside the literal
+            size_t literal_start {i};
+            size_t equal_run {};
+            while (i < state.size() && equal_run < 3)
+            {
+                equal_run = (state[i] == keyframe[i]) ? equal_run + 1 : 0;
+                ++i;
+            }
+            i -= equal_run;
+
+            putVarint(out, i - literal_start);
+            for (size_t j {literal_start} ; j < i ; ++j)
+                out.push_back(state[j] ^ keyframe[j]);
+        }
+    }
+
+    void applyDelta(const std::vector<uint8_t>& delta, std::vector<uint8_t>& state)
+    {
+        size_t offset {};
+        size_t position {};
+
+        while (offset < delta.size())
+        {
+            position += getVarint(delta, offset);
+            size_t literal { getVarint(delta, offset) };
+
+            if (literal > delta.size() - offset || literal > state.size() - position)
+                throw std::runtime_error("Error: corrupted rewind delta");
+
+            for (size_t j {} ; j < literal ; ++j)
+                state[position + j] ^= delta[offset + j];
+
+            offset += literal;
+            position += literal;
+        }
+    }
+}
+
+RewindBuffer::RewindBuffer(size_t memory_budget, int keyframe_interval)
+    : memory_budget {memory_budget}, keyframe_interval {std::max(keyframe_interval, 1)}
+{
+}
+
+size_t RewindBuffer::getSnapshotCount() { return snapshots.size(); }
+size_t RewindBuffer::getMemoryUsage() { return memory_usage; }
+size_t RewindBuffer::getMemoryBudget() { return memory_budget; }
+
+size_t RewindBuffer::footprintOf(const Snapshot& snapshot)
+{
+    return sizeof(Snapshot) + snapshot.data.capacity();
+}
+
+const RewindBuffer::Snapshot& RewindBuffer::keyframeOf(size_t index)
+{
+    while (!snapshots[index].keyframe) --index;
+    return snapshots[index];
+}
+
+void RewindBuffer::decode(size_t index, std::vector<uint8_t>& out)
+{
+    out = keyframeOf(index).data;
+    if (!snapshots[index].keyframe) applyDelta(snapshots[index].data, out);
+}
+
+// Deltas are useless without their keyframe, the
+// oldest keyframe goes away together with them
+void RewindBuffer::dropOldest()
+{
+    --keyframe_count;
+
+    do
+    {
+        memory_usage -= footprintOf(snapshots.front());
+        snapshots.pop_front();
+    }
+    while (!snapshots.empty() && !snapshots.front().keyframe);
+}
+
+void RewindBuffer::Push(Chip8& system)
+{
+    system.saveState(state);
+
+    Snapshot snapshot {};
+    const std::vector<uint8_t>* keyframe { snapshots.empty() ? nullptr : &keyframeOf(snapshots.size() - 1).data };
+
+    if (keyframe == nullptr || deltas_since_keyframe + 1 >= keyframe_interval || keyframe->size() != state.size())
+    {
+        snapshot.keyframe = true;
+        snapshot.data = state;
+        deltas_since_keyframe = 0;
+        ++keyframe_count;
+    }
+    else
+    {
+        encodeDelta(*keyframe, state, snapshot.data);
+        snapshot.data.shrink_to_fit();
+        ++deltas_since_keyframe;
+    }
+
+    memory_usage += footprintOf(snapshot);
+    snapshots.push_back(std::move(snapshot));
+
+    // The newest keyframe and its deltas are always kept
+    while (memory_usage > memory_budget && keyframe_count > 1)
+        dropOldest();
+}
+
+bool RewindBuffer::StepBack(Chip8& system)
+{
+    if (snapshots.size() < 2) return false;
+
+    memory_usage -= footprintOf(snapshots.back());
+    snapshots.pop_back();
+
+    if (deltas_since_keyframe > 0) --deltas_since_keyframe;
+    else
+    {
+        // Popped a keyframe, count the deltas of the previous one
+        --keyframe_count;
+        deltas_since_keyframe = 0;
+        for (size_t i { snapshots.size() - 1 } ; !snapshots[i].keyframe ; --i)
+            ++deltas_since_keyframe;
+    }
+
+    decode(snapshots.size() - 1, restored);
+
+    // Only the machine goes back in time, not the player's hands
+    uint8_t keypad[Chip8Specs::KeysCount] {};
+    std::copy(system.getKeypad(), system.getKeypad() + Chip8Specs::KeysCount, keypad);
+
+    system.loadState(restored);
+
+    for (int i {} ; i < Chip8Specs::KeysCount ; ++i)
+        system.setKeypad(i, keypad[i]);
+
+    return true;
+}
+
+void RewindBuffer::Clear()
+{
+    snapshots.clear();
+    memory_usage = 0;
+    keyframe_count = 0;
+    deltas_since_keyframe = 0;
+}
@@ -0,0 +1,65 @@
+#include "rom_image.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8PP_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define CHIP8PP_HAS_MMAP 0
+#endif
+
+RomImage::RomImage(const std::string& filename)
+{
+#if CHIP8PP_HAS_MMAP
+    int descriptor { open(filename.c_str(), O_RDONLY) };
+    if (descriptor < 0)
+        throw std::runtime_error("Error: failed to open ROM : " + filename);
+
+    struct stat status {};
+    if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode))
+    {
+        close(descriptor);
+        throw std::runtime_error("Error: failed to open ROM : " + filename);
+    }
+
+    length = static_cast<size_t>(status.st_size);
+
+    // Empty files cannot be mapped, there is nothing to load anyway
+    if (length > 0)
+    {
+        void* pages { mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0) };
+        if (pages == MAP_FAILED)
+        {
+            close(descriptor);
+            throw std::runtime_error("Error: failed to map ROM : " + filename);
+        }
+
+        mapping = pages;
+        bytes = static_cast<const uint8_t*>(pages);
+    }
+
+    // The mapping outlives the descriptor
+    close(descriptor);
+#else
+    std::ifstream rom(filename, std::ios::binary);
+    if (!rom.is_open())
+        throw std::runtime_error("Error: failed to open ROM : " + filename);
+
+    buffer.assign(std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>());
+    bytes = buffer.data();
+    length = buffer.size();
+#endif
+}
+
+RomImage::~RomImage()
+{
+#if CHIP8PP_HAS_MMAP
+    if (mapping) munmap(mapping, length);
+#endif
+}
@@ -0,0 +1,387 @@
+#include "rom_library.hpp"
+#include "constants.hpp"
+#include "masks.hpp"
+#include "rom_image.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    // === XXH64 ===
+    constexpr uint64_t Prime1 {0x9E3779B185EBCA87u};
+    constexpr uint64_t Prime2 {0xC2B2AE3D27D4EB4Fu};
+    constexpr uint64_t Prime3 {0x165667B19E3779F9u};
+    constexpr uint64_t Prime4 {0x85EBCA77C2B2AE63u};
+    constexpr uint64_t Prime5 {0x27D4EB2F165667C5u};
+
+    uint64_t rotateLeft(uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); }
+
+    // Little endian, whatever the host
+    uint64_t read64(const uint8_t* bytes)
+    {
+        uint64_t value {};
+        for (int i {7} ; i >= 0 ; --i) value = (value << 8u) | bytes[i];
+        return value;
+    }
+
+    uint64_t read32(const uint8_t* bytes)
+    {
+        uint64_t value {};
+        for (int i {3} ; i >= 0 ; --i) value = (value << 8u) | bytes[i];
+        return value;
+    }
+
+    uint64_t mixLane(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * Prime2;
+        return rotateLeft(accumulator, 31) * Prime1;
+    }
+
+    uint64_t mergeLane(uint64_t hash, uint64_t accumulator)
+    {
+        hash ^= mixLane(0, accumulator);
+        return hash * Prime1 + Prime4;
+    }
+
+    // === Model detection ===
+    MachineModel modelOf(uint16_t opcode)
+    {
+        uint8_t low { static_cast<uint8_t>(opcode & MASK_LOWER_8BITS) };
+
+        switch (opcode >> 12u)
+        {
+        case 0x0:
+            if ((opcode & 0xFFF0u) == 0x00D0u) return MachineModel::XoChip;
+            if (((opcode & 0xFFF0u) == 0x00C0u && (opcode & 0xFu) != 0) || (opcode >= 0x00FBu && opcode <= 0x00FFu))
+                return MachineModel::Schip;
+            break;
+        case 0x5:
+            if ((opcode & 0xFu) == 0x2 || (opcode & 0xFu) == 0x3) return MachineModel::XoChip;
+            break;
+        case 0xD:
+            if ((opcode & 0xFu) == 0) return MachineModel::Schip;
+            break;
+        case 0xF:
+            if (opcode == 0xF000u || opcode == 0xF002u || low == 0x01 || low == 0x3A) return MachineModel::XoChip;
+            if (low == 0x30 || low == 0x75 || low == 0x85) return MachineModel::Schip;
+            break;
+        }
+
+        return MachineModel::Chip8;
+    }
+
+    bool isRomFile(const std::filesystem::path& path)
+    {
+        std::string extension { path.extension().string() };
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+        return std::any_of(std::begin(RomLibrarySpecs::Extensions), std::end(RomLibrarySpecs::Extensions),
+                           [&extension](const char* known) { return extension == known; });
+    }
+
+    std::string trim(const std::string& text)
+    {
+        size_t first { text.find_first_not_of(" \t\r") };
+        if (first == std::string::npos) return {};
+
+        size_t last { text.find_last_not_of(" \t\r") };
+        return text.substr(first, last - first + 1);
+    }
+}
+
+uint64_t hashRom(const uint8_t* data, size_t size)
+{
+    const uint8_t* cursor {data};
+    const uint8_t* end {data + size};
+    uint64_t hash {};
+
+    if (size >= 32)
+    {
+        uint64_t lanes[4] { Prime1 + Prime2, Prime2, 0, 0 - Prime1 };
+
+        for ( ; end - cursor >= 32 ; cursor += 32)
+            for (int lane {} ; lane < 4 ; ++lane)
+                lanes[lane] = mixLane(lanes[lane], read64(cursor + 8 * lane));
+
+        hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+        for (uint64_t lane : lanes) hash = mergeLane(hash, lane);
+    }
+    else hash = Prime5;
+
+    hash += size;
+
+    for ( ; end - cursor >= 8 ; cursor += 8)
+    {
+        hash ^= mixLane(0, read64(cursor));
+        hash = rotateLeft(hash, 27) * Prime1 + Prime4;
+    }
+
+    if (end - cursor >= 4)
+    {
+        hash ^= read32(cursor) * Prime1;
+        hash = rotateLeft(hash, 23) * Prime2 + Prime3;
+        cursor += 4;
+    }
+
+    for ( ; cursor < end ; ++cursor)
+    {
+        hash ^= *cursor * Prime5;
+        hash = rotateLeft(hash, 11) * Prime1;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33u;
+    hash *= Prime2;
+    hash ^= hash >> 29u;
+    hash *= Prime3;
+    hash ^= hash >> 32u;
+
+    return hash;
+}
+
+MachineModel detectMachineModel(const uint8_t* data, size_t size)
+{
+    // Only XO-CHIP has room for more than 3.5 KB
+    if (size > Chip8Specs::ClassicMemorySize - Chip8Specs::ProgramStartAddress)
+        return MachineModel::XoChip;
+
+    auto wordAt = [data, size](size_t offset) -> uint16_t {
+        return offset + 1 < size ? static_cast<uint16_t>((data[offset] << 8u) | data[offset + 1]) : 0;
+    };
+
+    // Offsets from the program start, jumps below it are not followed
+    auto offsetOf = [](uint16_t address) -> size_t {
+        return address >= Chip8Specs::ProgramStartAddress ? address - Chip8Specs::ProgramStartAddress : SIZE_MAX;
+    };
+
+    MachineModel model {MachineModel::Chip8};
+    std::vector<uint8_t> visited(size, 0);
+    std::vector<size_t> pending {0};
+
+    while (!pending.empty() && model != MachineModel::XoChip)
+    {
+        size_t offset { pending.back() };
+        pending.pop_back();
+
+        // One straight-line run, branches are queued
+        while (offset < size && offset + 1 < size && !visited[offset] && model != MachineModel::XoChip)
+        {
+            visited[offset] = 1;
+
+            uint16_t opcode { wordAt(offset) };
+            model = std::max(model, modelOf(opcode));
+
+            size_t next { offset + (opcode == 0xF000u ? 4 : 2) };
+
+            switch (opcode >> 12u)
+            {
+            case 0x0:
+                // Return and exit
+                if (opcode == 0x00EEu || opcode == 0x00FDu) next = SIZE_MAX;
+                break;
+            case 0x1:
+                next = offsetOf(opcode & MASK_OPC_ADDR);
+                break;
+            case 0x2:
+                pending.push_back(offsetOf(opcode & MASK_OPC_ADDR));
+                break;
+            // Computed jump, the targets are unknown
+            case 0xB:
+                next = SIZE_MAX;
+                break;
+            case 0x3: case 0x4: case 0x5: case 0x9:
+                pending.push_back(next + (wordAt(next) == 0xF000u ? 4 : 2));
+                break;
+            case 0xE:
+                if ((opcode & MASK_LOWER_8BITS) == 0x9E || (opcode & MASK_LOWER_8BITS) == 0xA1)
+                    pending.push_back(next + (wordAt(next) == 0xF000u ? 4 : 2));
+                break;
+            }
+
+            offset = next;
+        }
+    }
+
+    return model;
+}
+
+// === RomDatabase ===
+
+void RomDatabase::LoadFromFile(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Error: failed to open ROM database : " + path);
+
+    std::string line {};
+
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        uint64_t hash {};
+        std::string model {};
+        std::string quirks {};
+
+        if (trim(line).empty()) continue;
+
+        if (!(fields >> std::hex >> hash >> model >> quirks))
+            throw std::invalid_argument("Error: invalid ROM database entry : " + line);
+
+        std::string title {};
+        std::getline(fields, title);
+
+        entries[hash] = Entry { machineModelFromName(model), quirkProfileFromName(quirks), trim(title) };
+    }
+}
+
+const RomDatabase::Entry* RomDatabase::find(uint64_t hash) const
+{
+    auto it { entries.find(hash) };
+    return it != entries.end() ? &it->second : nullptr;
+}
+
+// === RomIndex ===
+
+void RomIndex::rebuildHashes()
+{
+    by_hash.clear();
+    for (size_t i {} ; i < entries.size() ; ++i)
+        by_hash.emplace(entries[i].hash, i);
+}
+
+void RomIndex::LoadFromFile(const std::string& path)
+{
+    entries.clear();
+    by_hash.clear();
+
+    // Nothing indexed yet
+    if (!std::filesystem::exists(path)) return;
+
+    std::ifstream file(path);
+    std::string line {};
+
+    if (!file.is_open() || !std::getline(file, line) || line != RomLibrarySpecs::IndexHeader)
+        throw std::runtime_error("Error: not a ROM index : " + path);
+
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        RomInfo info {};
+        std::string model {};
+        std::string quirks {};
+        std::string source {};
+
+        if (!std::getline(fields, info.path, '\t')
+            || !(fields >> std::dec >> info.size >> info.modified >> std::hex >> info.hash >> model >> quirks >> source))
+            throw std::invalid_argument("Error: invalid ROM index entry : " + line);
+
+        info.model = machineModelFromName(model);
+        info.quirks = quirkProfileFromName(quirks);
+        info.known = (source == "database");
+
+        std::getline(fields, info.title);
+        info.title = trim(info.title);
+
+        entries.push_back(info);
+    }
+
+    std::sort(entries.begin(), entries.end(),
+        [](const RomInfo& a, const RomInfo& b) { return a.path < b.path; });
+    rebuildHashes();
+}
+
+void RomIndex::SaveToFile(const std::string& path)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Error: failed to open ROM index : " + path);
+
+    file << RomLibrarySpecs::IndexHeader << '\n';
+
+    for (const RomInfo& info : entries)
+    {
+        file << info.path << '\t' << std::dec << info.size << '\t' << info.modified << '\t'
+             << std::hex << std::uppercase << std::setfill('0') << std::setw(16) << info.hash << '\t'
+             << machineModelName(info.model) << '\t' << quirkProfileName(info.quirks) << '\t'
+             << (info.known ? "database" : "detected") << '\t' << info.title << '\n';
+    }
+}
+
+size_t RomIndex::Scan(const std::string& directory, const RomDatabase& database)
+{
+    namespace fs = std::filesystem;
+
+    std::unordered_map<std::string, const RomInfo*> previous {};
+    for (const RomInfo& info : entries)
+        previous.emplace(info.path, &info);
+
+    std::vector<RomInfo> scanned {};
+    size_t read_count {};
+
+    for (const fs::directory_entry& file : fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied))
+    {
+        if (!file.is_regular_file() || !isRomFile(file.path())) continue;
+
+        RomInfo info {};
+        info.path = file.path().string();
+        info.size = file.file_size();
+        info.modified = static_cast<int64_t>(file.last_write_time().time_since_epoch().count());
+
+        // Unchanged since the last scan: the hash is still right, and
+        // so is the detected model, unless the database decided it
+        auto it { previous.find(info.path) };
+        const RomInfo* cached { (it != previous.end() && it->second->size == info.size
+                                 && it->second->modified == info.modified) ? it->second : nullptr };
+
+        if (cached && (!cached->known || database.find(cached->hash)))
+        {
+            info.hash = cached->hash;
+            info.model = cached->model;
+            info.quirks = cached->quirks;
+        }
+        else
+        {
+            RomImage rom {info.path};
+            info.hash = hashRom(rom.data(), rom.size());
+            info.model = detectMachineModel(rom.data(), rom.size());
+            info.quirks = defaultQuirksOf(info.model);
+            ++read_count;
+        }
+
+        if (const RomDatabase::Entry* entry { database.find(info.hash) })
+        {
+            info.model = entry->model;
+            info.quirks = entry->quirks;
+            info.title = entry->title;
+            info.known = true;
+        }
+
+        scanned.push_back(info);
+    }
+
+    std::sort(scanned.begin(), scanned.end(),
+        [](const RomInfo& a, const RomInfo& b) { return a.path < b.path; });
+
+    entries = std::move(scanned);
+    rebuildHashes();
+
+    return read_count;
+}
+
+const std::vector<RomInfo>& RomIndex::getEntries() { return entries; }
+
+const RomInfo* RomIndex::findByHash(uint64_t hash)
+{
+    auto it { by_hash.find(hash) };
+    return it != by_hash.end() ? &entries[it->second] : nullptr;
+}
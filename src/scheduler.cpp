@@ -0,0 +1,69 @@
+#include "scheduler.hpp"
+#include "chip8.hpp"
+
+#include <algorithm>
+
+Scheduler::Scheduler(Chip8* system, int instructions_per_second)
+    : system {system}, instructions_per_second {instructions_per_second}
+{
+}
+
+uint64_t Scheduler::getFrameCount() { return frame_count; }
+int Scheduler::getInstructionsPerSecond() { return instructions_per_second; }
+
+uint32_t Scheduler::nextFrameBudget()
+{
+    budget_remainder += instructions_per_second;
+
+    uint32_t budget = budget_remainder / SchedulerSpecs::FrameRate;
+    budget_remainder %= SchedulerSpecs::FrameRate;
+
+    return budget;
+}
+
+uint32_t Scheduler::RunFrame(uint32_t max_instructions, Clock::time_point deadline)
+{
+    uint32_t executed {};
+
+    if (instructions_per_second == SchedulerSpecs::Unlimited)
+    {
+        // Run in small batches so the clock is not read
+        // after every single instruction
+        constexpr uint32_t batch_size {256};
+
+        if (deadline == Clock::time_point {})
+            deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / SchedulerSpecs::FrameRate;
+
+        do
+        {
+            // Only a timer tick or a key can end the loop the program
+            // is in: a frame of known length (replays) is skipped to
+            // its end, a live one ends here and the caller sleeps
+            if (system->getCpu()->isIdle())
+            {
+                if (deadline == Clock::time_point::max())
+                    executed += system->Run(max_instructions - executed);
+                break;
+            }
+
+            uint32_t batch { std::min(batch_size, max_instructions - executed) };
+            uint32_t ran { system->Run(batch) };
+            executed += ran;
+
+            if (ran < batch_size) break;
+        }
+        while (Clock::now() < deadline);
+    }
+    else
+    {
+        uint32_t budget { nextFrameBudget() };
+        executed = system->Run(std::min(budget, max_instructions));
+
+        if (max_instructions < budget) return executed;
+    }
+
+    system->TickTimers();
+    ++frame_count;
+
+    return executed;
+}
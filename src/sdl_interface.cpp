@@ -1,87 +1,334 @@
 #include "sdl_interface.hpp"
 #include "sound_related.hpp"
 #include "constants.hpp"
+#include "keymap.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+namespace
+{
+    // Colors of the 4 plane combinations
+    constexpr uint32_t PlaneColors[] {
+        Chip8Specs::ColorOff, Chip8Specs::ColorOn, Chip8Specs::ColorPlane2, Chip8Specs::ColorPlanes
+    };
+
+    // Transparent, then black at a third of the opacity
+    constexpr uint32_t ScanlineClear {0x00000000};
+    constexpr uint32_t ScanlineDark  {0x00000060};
+
+    // One texel row, one texel per pixel, from the words of screen row y
+    void expandRow(const Screen& screen, int y, uint32_t* texels)
+    {
+        int halves { screen.hires ? 2 : 1 };
+
+        for(int half {} ; half < halves ; ++half)
+        {
+            uint64_t plane0 { half ? screen.right(0)[y] : screen.left(0)[y] };
+            uint64_t plane1 { half ? screen.right(1)[y] : screen.left(1)[y] };
+
+            for(int bit {63} ; bit >= 0 ; --bit)
+                *texels++ = PlaneColors[((plane0 >> bit) & 1u) | (((plane1 >> bit) & 1u) << 1u)];
+        }
+    }
+}
+
 SdlInterface::SdlInterface(const char* window_title,
-    int window_width, int window_height,
-    int texture_width, int texture_height, Chip8* system) : system {system}
+    int window_width, int window_height, EmulationThread* emulation,
+    int audio_buffer_samples, const DisplayEffects& effects, const KeyLayout& layout)
+    : emulation {emulation}, layout {layout}
 {
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+    // Controllers already plugged in are reported as added
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER);
 
     window = SDL_CreateWindow(window_title, 0, 0, window_width, window_height, SDL_WINDOW_SHOWN);
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // Ghosting blends every frame into a texture, on the GPU
+    Uint32 renderer_flags { SDL_RENDERER_ACCELERATED };
+    if(effects.ghosting_percent > 0)
+        renderer_flags |= SDL_RENDERER_TARGETTEXTURE;
+
+    renderer = SDL_CreateRenderer(window, -1, renderer_flags);
 
-    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 
-        texture_width, texture_height);
+    // One texel per pixel in both resolutions, a low resolution
+    // frame converts and uploads a quarter of the texels
+    lores_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+        Chip8Specs::ScreenWidth, Chip8Specs::ScreenHeight);
+    hires_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+        Chip8Specs::HiresScreenWidth, Chip8Specs::HiresScreenHeight);
 
-    InitSound();
+    InitEffects(effects);
+    InitSound(audio_buffer_samples);
 }
 
 SdlInterface::~SdlInterface()
 {
-    SDL_DestroyTexture(texture);
+    for(SDL_GameController* controller : controllers)
+        SDL_GameControllerClose(controller);
+    if(scanline_mask) SDL_DestroyTexture(scanline_mask);
+    if(phosphor) SDL_DestroyTexture(phosphor);
+    SDL_DestroyTexture(hires_texture);
+    SDL_DestroyTexture(lores_texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
+    // Stops the callback first
     SDL_CloseAudioDevice(audio_device);
-    delete[] audio_buffer;
 
     SDL_Quit();
 }
 
-bool SdlInterface::HandleKeyInput()
+bool SdlInterface::HandleKeyInput(int wait_ms)
 {
     bool quit {false};
 
     SDL_Event event;
 
-    while(SDL_PollEvent(&event))
-    {
+    // Sleeps in the event queue until something happens, then
+    // takes whatever else is pending without blocking again
+    bool pending { wait_ms > 0 ? SDL_WaitEventTimeout(&event, wait_ms) != 0 : SDL_PollEvent(&event) != 0 };
 
+    for( ; pending ; pending = SDL_PollEvent(&event) != 0)
+    {
         if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_m)
-            is_muted = !is_muted;
+            is_muted = !is_muted.load();
+
+        if(event.type == SDL_KEYDOWN && !event.key.repeat && event.key.keysym.sym == SDLK_F5)
+            Submit({ MachineCommand::Kind::QuickSave });
+
+        if(event.type == SDL_KEYDOWN && !event.key.repeat && event.key.keysym.sym == SDLK_F9)
+            Submit({ MachineCommand::Kind::QuickLoad });
+
+        if((event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) && !event.key.repeat
+           && event.key.keysym.sym == SDLK_BACKSPACE)
+            Submit({ MachineCommand::Kind::Rewind, 0, static_cast<uint8_t>(event.type == SDL_KEYDOWN) });
 
         switch(event.type)
         {
         case SDL_QUIT:
             quit = true;
             break;
+        case SDL_WINDOWEVENT:
+            if(event.window.event == SDL_WINDOWEVENT_EXPOSED ||
+               event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                needs_redraw = true;
+            break;
+        // The phosphor content was lost
+        case SDL_RENDER_TARGETS_RESET:
+            needs_redraw = true;
+            break;
         case SDL_KEYUP:
         case SDL_KEYDOWN:
-            // Get the pressed key
-            SDL_Keycode pressed_key { event.key.keysym.sym };
+        {
+            // The key is already down, repeats change nothing
+            if(event.key.repeat)
+                break;
+
+            uint8_t chip8_key { layout.keyOfScancode(event.key.keysym.scancode) };
+            if(chip8_key != KeyboardSpecs::Unbound)
+                Submit({ MachineCommand::Kind::Key, chip8_key, static_cast<uint8_t>(event.type == SDL_KEYDOWN) });
+
+            break;
+        }
+        case SDL_CONTROLLERBUTTONUP:
+        case SDL_CONTROLLERBUTTONDOWN:
+        {
+            uint8_t chip8_key { layout.keyOfButton(event.cbutton.button) };
+            if(chip8_key != KeyboardSpecs::Unbound)
+                Submit({ MachineCommand::Kind::Key, chip8_key, static_cast<uint8_t>(event.type == SDL_CONTROLLERBUTTONDOWN) });
 
-            if(Chip8Specs::KeyMap.count(pressed_key) > 0)
+            break;
+        }
+        case SDL_CONTROLLERDEVICEADDED:
+            if(SDL_GameController* controller { SDL_GameControllerOpen(event.cdevice.which) })
+                controllers.push_back(controller);
+            break;
+        case SDL_CONTROLLERDEVICEREMOVED:
+        {
+            // Removal events carry the instance id, not the device index
+            SDL_GameController* controller { SDL_GameControllerFromInstanceID(event.cdevice.which) };
+            auto it { std::find(controllers.begin(), controllers.end(), controller) };
+            if(it != controllers.end())
             {
-                uint8_t chip8_key { Chip8Specs::KeyMap.at(pressed_key) };
-                system->setKeypad(chip8_key, (event.type == SDL_KEYUP ? 0 : 1));
+                SDL_GameControllerClose(controller);
+                controllers.erase(it);
             }
-
             break;
         }
+        }
     }
 
     return quit;
 }
 
-void SdlInterface::Update(int pitch)
+bool SdlInterface::isIdle(const VideoFrame& frame) const
 {
-    uint32_t frame_buffer[Chip8Specs::ScreenWidth * Chip8Specs::ScreenHeight];
+    // Inputs still in the queue may wake the machine up
+    return frame.waiting_for_key && frame.applied_commands == submitted_commands
+        && fade_frames_left == 0 && !needs_redraw;
+}
 
-    uint32_t* video { system->getVideo() };
+void SdlInterface::Submit(const MachineCommand& command)
+{
+    // Only possible if the emulation thread is stuck
+    if(!emulation->Submit(command))
+        std::cerr << "Input queue full, event dropped\n";
+    else
+        ++submitted_commands;
+}
 
-    for(int i {} ; i < Chip8Specs::ScreenWidth * Chip8Specs::ScreenHeight ; ++i)
-        frame_buffer[i] = (video[i] ? Chip8Specs::ColorOn : Chip8Specs::ColorOff);
+void SdlInterface::SetTitle(const char* title)
+{
+    SDL_SetWindowTitle(window, title);
+}
 
-    SDL_UpdateTexture(texture, nullptr, frame_buffer, pitch);
+void SdlInterface::InitEffects(const DisplayEffects& effects)
+{
+    if(effects.ghosting_percent > 0)
+    {
+        if(!SDL_RenderTargetSupported(renderer))
+        {
+            std::cerr << "Render targets not supported, ghosting disabled\n";
+        }
+        else
+        {
+            double keep { std::clamp(effects.ghosting_percent, 1, 99) / 100.0 };
+
+            phosphor = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                Chip8Specs::HiresScreenWidth, Chip8Specs::HiresScreenHeight);
+            SDL_SetTextureBlendMode(phosphor, SDL_BLENDMODE_NONE);
+            SDL_SetTextureBlendMode(lores_texture, SDL_BLENDMODE_BLEND);
+            SDL_SetTextureBlendMode(hires_texture, SDL_BLENDMODE_BLEND);
+
+            ghosting_alpha = static_cast<Uint8>(std::lround(255 * (1.0 - keep)));
+            // Until what is left of the old picture is below one color step
+            fade_frames = static_cast<int>(std::ceil(std::log(1.0 / 255) / std::log(keep)));
+        }
+    }
+
+    if(effects.scanlines)
+    {
+        int output_width {}, output_height {};
+        SDL_GetRendererOutputSize(renderer, &output_width, &output_height);
+
+        // One texel per window line, the last line of
+        // every high resolution row is darkened
+        int row_height { std::max(output_height / Chip8Specs::HiresScreenHeight, 2) };
+        std::vector<uint32_t> lines(static_cast<size_t>(std::max(output_height, 1)));
+        for(size_t line {} ; line < lines.size() ; ++line)
+            lines[line] = (static_cast<int>(line) % row_height == row_height - 1) ? ScanlineDark : ScanlineClear;
+
+        scanline_mask = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC,
+            1, static_cast<int>(lines.size()));
+        SDL_SetTextureBlendMode(scanline_mask, SDL_BLENDMODE_BLEND);
+        // Uploaded once, never changes
+        SDL_UpdateTexture(scanline_mask, nullptr, lines.data(), static_cast<int>(sizeof(uint32_t)));
+    }
+}
+
+void SdlInterface::Update(const VideoFrame& frame)
+{
+    const Screen& screen { frame.screen };
+    int height { screen.height() };
+
+    // Frames may have been skipped since the last present,
+    // the rows are compared with what is on screen
+    uint64_t dirty_rows { (needs_redraw || screen.hires != presented_screen.hires) ? ~uint64_t {0} : 0 };
+    for(int plane {} ; plane < Chip8Specs::PlaneCount ; ++plane)
+    {
+        for(int y {} ; y < height ; ++y)
+        {
+            if(screen.left(plane)[y] != presented_screen.left(plane)[y]
+               || screen.right(plane)[y] != presented_screen.right(plane)[y])
+                dirty_rows |= uint64_t {1} << y;
+        }
+    }
+
+    // Nothing changed since the last present, and nothing is fading
+    if(dirty_rows == 0 && fade_frames_left == 0)
+        return;
+
+    if(dirty_rows != 0)
+    {
+        int first_row {};
+        while(first_row < height && !(dirty_rows & (uint64_t {1} << first_row)))
+            ++first_row;
+
+        int last_row { height - 1 };
+        while(last_row > first_row && !(dirty_rows & (uint64_t {1} << last_row)))
+            --last_row;
+
+        UploadRows(screen, first_row, last_row);
+
+        presented_screen = screen;
+        fade_frames_left = fade_frames;
+    }
+    else
+    {
+        --fade_frames_left;
+    }
+
+    Present();
+    needs_redraw = false;
+}
+
+SDL_Texture* SdlInterface::textureOf(bool hires)
+{
+    return hires ? hires_texture : lores_texture;
+}
+
+void SdlInterface::UploadRows(const Screen& screen, int first_row, int last_row)
+{
+    SDL_Texture* texture { textureOf(screen.hires) };
+
+    SDL_Rect band { 0, first_row, screen.width(), last_row - first_row + 1 };
+    void* pixels {nullptr};
+    int locked_pitch {};
+
+    if(SDL_LockTexture(texture, &band, &pixels, &locked_pitch) != 0)
+    {
+        std::cerr << "SDL texture error: " << SDL_GetError() << std::endl;
+        return;
+    }
+
+    // Bits are expanded to colors only here, straight into the
+    // texture memory, every texel of the band is written
+    Uint8* texel_row { static_cast<Uint8*>(pixels) };
+
+    for(int y { first_row } ; y <= last_row ; ++y, texel_row += locked_pitch)
+        expandRow(screen, y, reinterpret_cast<uint32_t*>(texel_row));
+
+    SDL_UnlockTexture(texture);
+}
+
+void SdlInterface::Present()
+{
+    SDL_Texture* texture { textureOf(presented_screen.hires) };
+    SDL_Texture* picture { texture };
+
+    if(phosphor)
+    {
+        // The new frame is blended over the previous ones,
+        // opaque when the phosphor is lost or done fading
+        bool opaque { needs_redraw || fade_frames_left == 0 };
+
+        SDL_SetRenderTarget(renderer, phosphor);
+        SDL_SetTextureAlphaMod(texture, opaque ? 255 : ghosting_alpha);
+        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+        SDL_SetRenderTarget(renderer, nullptr);
+
+        picture = phosphor;
+    }
+
+    // Scaled to the window by the renderer
     SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderCopy(renderer, picture, nullptr, nullptr);
+    if(scanline_mask)
+        SDL_RenderCopy(renderer, scanline_mask, nullptr, nullptr);
     SDL_RenderPresent(renderer);
 }
 
-void SdlInterface::InitSound()
+void SdlInterface::InitSound(int buffer_samples)
 {
     SDL_AudioSpec spec;
     SDL_zero(spec);
@@ -90,39 +337,39 @@ void SdlInterface::InitSound()
     spec.format = SoundSpecs::device_format;
     // mono channel
     spec.channels = 1;
-    spec.samples = SoundSpecs::device_samples;
-    // No audio callback
-    spec.callback = nullptr;
+    spec.samples = static_cast<Uint16>(std::clamp(buffer_samples,
+        SoundSpecs::min_device_samples, SoundSpecs::max_device_samples));
+    // Samples are pulled by SDL from its audio thread
+    spec.callback = &SdlInterface::AudioCallback;
+    spec.userdata = this;
 
-    audio_device = SDL_OpenAudioDevice(nullptr, 0, &spec, nullptr, 0);
+    SDL_AudioSpec obtained;
+    audio_device = SDL_OpenAudioDevice(nullptr, 0, &spec, &obtained, 0);
     if (audio_device == 0)
     {
         std::cerr << "SDL audio error: " << SDL_GetError() << std::endl;
         return;
     }
 
-    // Sound generation
-
-    const int frequency { SoundSpecs::sound_frequency };
-    const int duration_ms { SoundSpecs::sound_duration_ms };
+    tone = ToneGenerator {obtained.freq};
 
-    const int sample_count { spec.freq * duration_ms / 1000 };
-    audio_length = sample_count;
-
-    audio_buffer = new uint8_t[sample_count];
+    // Silence is generated while the timer is stopped,
+    // the device runs for the whole session
+    SDL_PauseAudioDevice(audio_device, 0);
+}
 
-    int half_period = spec.freq / (2 * frequency);
-    // Square wave: 255 (high), 0 (low)
-    for (int i = 0 ; i < sample_count ; ++i)
-        audio_buffer[i] = (i / half_period) % 2 == 0 ? 5 : 0;
+void SDLCALL SdlInterface::AudioCallback(void* userdata, Uint8* stream, int length)
+{
+    static_cast<SdlInterface*>(userdata)->FillAudio(
+        reinterpret_cast<int16_t*>(stream), length / static_cast<int>(sizeof(int16_t)));
 }
 
-void SdlInterface::PlaySound()
+void SdlInterface::FillAudio(int16_t* samples, int count)
 {
-    if(is_muted)
-        return;
+    if(emulation->PollAudioPattern())
+        tone.SetPattern(emulation->getAudioPattern());
 
-    SDL_ClearQueuedAudio(audio_device);
-    SDL_QueueAudio(audio_device, audio_buffer, audio_length);
-    SDL_PauseAudioDevice(audio_device, 0);
+    // The timer only changes at 60 Hz, once per buffer is enough
+    bool audible { emulation->isSoundActive() && !is_muted.load(std::memory_order_relaxed) };
+    tone.Generate(samples, count, audible);
 }
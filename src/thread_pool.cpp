@@ -0,0 +1,109 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i {} ; i < thread_count ; ++i)
+        queues.push_back(std::make_unique<WorkerQueue>());
+
+    for (size_t i {} ; i < thread_count ; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard {state_lock};
+        stopping = true;
+    }
+    work_available.notify_all();
+
+    for (std::thread& worker : workers) worker.join();
+}
+
+size_t ThreadPool::getThreadCount() { return workers.size(); }
+
+void ThreadPool::Submit(Task task)
+{
+    ++unfinished;
+
+    // Counted before the task is visible, a worker popping it
+    // right away must not decrement below zero. Published under
+    // the state lock so that a worker about to sleep cannot miss it
+    {
+        std::lock_guard<std::mutex> guard {state_lock};
+        ++queued;
+    }
+
+    WorkerQueue& queue { *queues[next_queue++ % queues.size()] };
+    {
+        std::lock_guard<std::mutex> guard {queue.lock};
+        queue.tasks.push_back(std::move(task));
+    }
+    work_available.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> guard {state_lock};
+    all_done.wait(guard, [this] { return unfinished == 0; });
+}
+
+bool ThreadPool::popLocal(size_t worker, Task& task)
+{
+    WorkerQueue& queue { *queues[worker] };
+    std::lock_guard<std::mutex> guard {queue.lock};
+
+    if (queue.tasks.empty()) return false;
+
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(size_t worker, Task& task)
+{
+    for (size_t i {1} ; i < queues.size() ; ++i)
+    {
+        WorkerQueue& victim { *queues[(worker + i) % queues.size()] };
+        std::lock_guard<std::mutex> guard {victim.lock};
+
+        if (victim.tasks.empty()) continue;
+
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t worker)
+{
+    while (true)
+    {
+        Task task {};
+
+        if (popLocal(worker, task) || steal(worker, task))
+        {
+            --queued;
+            task();
+
+            if (--unfinished == 0)
+            {
+                std::lock_guard<std::mutex> guard {state_lock};
+                all_done.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard {state_lock};
+        work_available.wait(guard, [this] { return stopping || queued > 0; });
+
+        if (stopping && queued == 0) return;
+    }
+}
@@ -0,0 +1,69 @@
+#include "vector_kernels.hpp"
+
+/*
+    AVX2 kernels of the vector machine, 32 lanes per vector.
+    This file is built with -mavx2, the kernels are only used
+    when the CPU reports AVX2 support at runtime
+*/
+
+#if defined(__AVX2__) && (defined(__GNUC__) || defined(__clang__))
+
+#include <immintrin.h>
+
+namespace
+{
+    struct Avx2Lanes
+    {
+        static constexpr size_t Width {32};
+        using Vec = __m256i;
+
+        static Vec zero() { return _mm256_setzero_si256(); }
+        static Vec ones() { return _mm256_set1_epi8(-1); }
+        static Vec set8(uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+        static Vec set16(uint16_t value) { return _mm256_set1_epi16(static_cast<short>(value)); }
+
+        static Vec load8(const uint8_t* p) { return _mm256_loadu_si256(reinterpret_cast<const Vec*>(p)); }
+        static void store8(uint8_t* p, Vec v) { _mm256_storeu_si256(reinterpret_cast<Vec*>(p), v); }
+        static Vec load16(const uint16_t* p) { return _mm256_loadu_si256(reinterpret_cast<const Vec*>(p)); }
+        static void store16(uint16_t* p, Vec v) { _mm256_storeu_si256(reinterpret_cast<Vec*>(p), v); }
+
+        static Vec add8(Vec a, Vec b) { return _mm256_add_epi8(a, b); }
+        static Vec sub8(Vec a, Vec b) { return _mm256_sub_epi8(a, b); }
+        static Vec add16(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+        static Vec slli16_2(Vec a) { return _mm256_slli_epi16(a, 2); }
+        static Vec and_(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+        static Vec or_(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+        static Vec xor_(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+        static Vec andnot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); }
+        static Vec cmpeq8(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+        static Vec cmpeq16(Vec a, Vec b) { return _mm256_cmpeq_epi16(a, b); }
+        static Vec max8u(Vec a, Vec b) { return _mm256_max_epu8(a, b); }
+        static Vec subs8u(Vec a, Vec b) { return _mm256_subs_epu8(a, b); }
+
+        static Vec blend(Vec old_value, Vec new_value, Vec mask)
+        {
+            return _mm256_blendv_epi8(old_value, new_value, mask);
+        }
+
+        static Vec widenLo(Vec a) { return _mm256_cvtepu8_epi16(_mm256_castsi256_si128(a)); }
+        static Vec widenHi(Vec a) { return _mm256_cvtepu8_epi16(_mm256_extracti128_si256(a, 1)); }
+        static Vec widenMaskLo(Vec mask) { return _mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask)); }
+        static Vec widenMaskHi(Vec mask) { return _mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask, 1)); }
+
+        // packs works within 128-bit halves, put the quadwords back in order
+        static Vec packMask(Vec lo, Vec hi)
+        {
+            return _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xD8);
+        }
+
+        static uint32_t movemask(Vec a) { return static_cast<uint32_t>(_mm256_movemask_epi8(a)); }
+    };
+}
+
+const VectorKernels* vectorKernelsAvx2() { return makeKernels<Avx2Lanes>("avx2"); }
+
+#else
+
+const VectorKernels* vectorKernelsAvx2() { return nullptr; }
+
+#endif
@@ -0,0 +1,63 @@
+#include "vector_kernels.hpp"
+
+/*
+    SSE2 kernels of the vector machine, 16 lanes per vector.
+    SSE2 is part of the x86-64 baseline, no extra flag needed
+*/
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+
+#include <emmintrin.h>
+
+namespace
+{
+    struct Sse2Lanes
+    {
+        static constexpr size_t Width {16};
+        using Vec = __m128i;
+
+        static Vec zero() { return _mm_setzero_si128(); }
+        static Vec ones() { return _mm_set1_epi8(-1); }
+        static Vec set8(uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+        static Vec set16(uint16_t value) { return _mm_set1_epi16(static_cast<short>(value)); }
+
+        static Vec load8(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const Vec*>(p)); }
+        static void store8(uint8_t* p, Vec v) { _mm_storeu_si128(reinterpret_cast<Vec*>(p), v); }
+        static Vec load16(const uint16_t* p) { return _mm_loadu_si128(reinterpret_cast<const Vec*>(p)); }
+        static void store16(uint16_t* p, Vec v) { _mm_storeu_si128(reinterpret_cast<Vec*>(p), v); }
+
+        static Vec add8(Vec a, Vec b) { return _mm_add_epi8(a, b); }
+        static Vec sub8(Vec a, Vec b) { return _mm_sub_epi8(a, b); }
+        static Vec add16(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+        static Vec slli16_2(Vec a) { return _mm_slli_epi16(a, 2); }
+        static Vec and_(Vec a, Vec b) { return _mm_and_si128(a, b); }
+        static Vec or_(Vec a, Vec b) { return _mm_or_si128(a, b); }
+        static Vec xor_(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+        static Vec andnot(Vec a, Vec b) { return _mm_andnot_si128(a, b); }
+        static Vec cmpeq8(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+        static Vec cmpeq16(Vec a, Vec b) { return _mm_cmpeq_epi16(a, b); }
+        static Vec max8u(Vec a, Vec b) { return _mm_max_epu8(a, b); }
+        static Vec subs8u(Vec a, Vec b) { return _mm_subs_epu8(a, b); }
+
+        // No blendv before SSE4.1
+        static Vec blend(Vec old_value, Vec new_value, Vec mask)
+        {
+            return _mm_or_si128(_mm_and_si128(mask, new_value), _mm_andnot_si128(mask, old_value));
+        }
+
+        static Vec widenLo(Vec a) { return _mm_unpacklo_epi8(a, _mm_setzero_si128()); }
+        static Vec widenHi(Vec a) { return _mm_unpackhi_epi8(a, _mm_setzero_si128()); }
+        static Vec widenMaskLo(Vec mask) { return _mm_unpacklo_epi8(mask, mask); }
+        static Vec widenMaskHi(Vec mask) { return _mm_unpackhi_epi8(mask, mask); }
+        static Vec packMask(Vec lo, Vec hi) { return _mm_packs_epi16(lo, hi); }
+        static uint32_t movemask(Vec a) { return static_cast<uint32_t>(_mm_movemask_epi8(a)); }
+    };
+}
+
+const VectorKernels* vectorKernelsSse2() { return makeKernels<Sse2Lanes>("sse2"); }
+
+#else
+
+const VectorKernels* vectorKernelsSse2() { return nullptr; }
+
+#endif
@@ -0,0 +1,394 @@
+#include "vector_machine.hpp"
+#include "instructions.hpp"
+#include "masks.hpp"
+#include "rom_image.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    // The kernels implement the logic instructions clearing VF
+    bool hasQuirkFreeKernel(uint16_t opcode, const QuirkFlags& quirks)
+    {
+        uint16_t logic_op { static_cast<uint16_t>(opcode & 0xF00Fu) };
+        bool is_logic { logic_op == 0x8001u || logic_op == 0x8002u || logic_op == 0x8003u };
+
+        return quirks.resets_flag || !is_logic;
+    }
+
+    const VectorKernels* selectKernels()
+    {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        if (__builtin_cpu_supports("avx2") && vectorKernelsAvx2()) return vectorKernelsAvx2();
+#endif
+        return vectorKernelsSse2();
+    }
+}
+
+VectorMachine::VectorMachine(size_t lane_count)
+    : lane_count {lane_count}
+{
+    if (lane_count == 0) throw std::invalid_argument("Error: a vector machine needs at least one lane");
+
+    padded_lanes = (lane_count + VectorSpecs::LaneAlignment - 1) / VectorSpecs::LaneAlignment * VectorSpecs::LaneAlignment;
+
+    registers.resize(Chip8Specs::RegisterCount * padded_lanes);
+    pc.assign(padded_lanes, Chip8Specs::ProgramStartAddress);
+    index_register.resize(padded_lanes);
+    delay_timer.resize(padded_lanes);
+    sound_timer.resize(padded_lanes);
+    sp.resize(padded_lanes);
+    active.resize(padded_lanes);
+    pending.resize(padded_lanes);
+    group_mask8.resize(padded_lanes);
+    group_mask16.resize(padded_lanes);
+
+    // Padding lanes never run
+    std::fill(active.begin(), active.begin() + lane_count, 0xFFFFu);
+    running_lanes = lane_count;
+
+    memory.resize(Chip8Specs::ClassicMemorySize * lane_count);
+    stack.resize(Chip8Specs::StackDepth * lane_count);
+    video.resize(Chip8Specs::ScreenHeight * lane_count);
+    keypad.resize(Chip8Specs::KeysCount * lane_count);
+    key_wait_pressed.resize(lane_count);
+    key_wait_key.resize(lane_count);
+    random_devices.resize(lane_count);
+
+    // Load all fonts into memory
+    for (size_t lane {} ; lane < lane_count ; ++lane)
+        std::copy(std::begin(Chip8Specs::FontSet), std::end(Chip8Specs::FontSet),
+                  memory.begin() + lane * Chip8Specs::ClassicMemorySize + Chip8Specs::FontSetStartAddress);
+
+    views.lane_count     = padded_lanes;
+    views.registers      = registers.data();
+    views.pc             = pc.data();
+    views.index_register = index_register.data();
+    views.delay_timer    = delay_timer.data();
+    views.sound_timer    = sound_timer.data();
+    views.pending        = pending.data();
+    views.group_mask8    = group_mask8.data();
+    views.group_mask16   = group_mask16.data();
+
+    kernels = selectKernels();
+    max_groups = std::max<size_t>(4, padded_lanes / VectorSpecs::LaneAlignment);
+    address_stamps.resize(UINT16_MAX + 1);
+}
+
+void VectorMachine::loadRomIntoMemory(const std::string& filename)
+{
+    RomImage rom {filename};
+    loadRom(rom.data(), rom.size());
+}
+
+void VectorMachine::loadRom(const uint8_t* data, size_t size)
+{
+    if (size > Chip8Specs::ClassicMemorySize - Chip8Specs::ProgramStartAddress)
+        throw std::runtime_error("Error: ROM too large for the chip8 model : " + std::to_string(size) + " bytes, "
+                                 + std::to_string(Chip8Specs::ClassicMemorySize - Chip8Specs::ProgramStartAddress)
+                                 + " available");
+
+    for (size_t lane {} ; lane < lane_count ; ++lane)
+        std::copy_n(data, size, memory.begin() + lane * Chip8Specs::ClassicMemorySize + Chip8Specs::ProgramStartAddress);
+
+    std::memset(memory_written, 0, sizeof(memory_written));
+}
+
+// Accessors
+size_t VectorMachine::getLaneCount() { return lane_count; }
+const char* VectorMachine::getKernelName() { return kernels ? kernels->name : "scalar"; }
+bool VectorMachine::isHalted(size_t lane) { return active[lane] == 0; }
+uint8_t VectorMachine::getRegister(size_t lane, uint8_t index) { return registerOf(lane, index); }
+uint16_t VectorMachine::getPC(size_t lane) { return pc[lane]; }
+uint16_t VectorMachine::getIndexRegister(size_t lane) { return index_register[lane]; }
+uint8_t VectorMachine::getSP(size_t lane) { return sp[lane]; }
+uint8_t VectorMachine::getDelayTimer(size_t lane) { return delay_timer[lane]; }
+uint8_t VectorMachine::getSoundTimer(size_t lane) { return sound_timer[lane]; }
+uint8_t VectorMachine::getMemoryAt(size_t lane, uint16_t address) { return readMemory(lane, address); }
+uint64_t* VectorMachine::getVideo(size_t lane) { return &video[lane * Chip8Specs::ScreenHeight]; }
+
+void VectorMachine::setKeypad(size_t lane, int index, uint8_t value)
+{
+    keypad[lane * Chip8Specs::KeysCount + index] = value;
+}
+
+void VectorMachine::setSeed(size_t lane, uint64_t seed)
+{
+    random_devices[lane].seed(seed);
+}
+
+void VectorMachine::setScalar(bool value)
+{
+    kernels = value ? nullptr : selectKernels();
+}
+
+void VectorMachine::setQuirks(QuirkProfile value)
+{
+    quirks = value;
+
+    switch (quirks)
+    {
+    case QuirkProfile::Chip48: execute_lane = &VectorMachine::executeLane<QuirkProfile::Chip48>; break;
+    case QuirkProfile::Schip:  execute_lane = &VectorMachine::executeLane<QuirkProfile::Schip>; break;
+    case QuirkProfile::XoChip: execute_lane = &VectorMachine::executeLane<QuirkProfile::XoChip>; break;
+    default:                   execute_lane = &VectorMachine::executeLane<QuirkProfile::Vip>; break;
+    }
+}
+
+QuirkProfile VectorMachine::getQuirks() { return quirks; }
+
+uint8_t& VectorMachine::registerOf(size_t lane, uint8_t index)
+{
+    return registers[index * padded_lanes + lane];
+}
+
+// Out of bounds accesses behave like Chip8: reads
+// return 0 and writes are dropped
+uint8_t VectorMachine::readMemory(size_t lane, uint16_t address)
+{
+    return (address < Chip8Specs::ClassicMemorySize) ? memory[lane * Chip8Specs::ClassicMemorySize + address] : 0;
+}
+
+void VectorMachine::writeMemory(size_t lane, uint16_t address, uint8_t value)
+{
+    if (address >= Chip8Specs::ClassicMemorySize) return;
+
+    memory[lane * Chip8Specs::ClassicMemorySize + address] = value;
+    memory_written[address] = 1;
+}
+
+uint16_t VectorMachine::fetch(size_t lane)
+{
+    return (readMemory(lane, pc[lane]) << 8u) | readMemory(lane, pc[lane] + 1);
+}
+
+void VectorMachine::halt(size_t lane)
+{
+    active[lane] = 0;
+    --running_lanes;
+}
+
+// State of one lane, as the shared instruction semantics see
+// it (see instructions.hpp). Same behaviour as Cpu::Access
+class VectorMachine::LaneAccess
+{
+private:
+    VectorMachine& machine;
+    size_t lane {};
+public:
+    LaneAccess(VectorMachine& machine, size_t lane) : machine {machine}, lane {lane} {}
+
+    uint8_t& v(uint8_t index) { return machine.registerOf(lane, index); }
+    uint16_t& pc() { return machine.pc[lane]; }
+    uint16_t* stack() { return &machine.stack[lane * Chip8Specs::StackDepth]; }
+    uint8_t& sp() { return machine.sp[lane]; }
+
+    uint16_t index() { return machine.index_register[lane]; }
+    void setIndex(uint16_t value) { machine.index_register[lane] = value; }
+    uint8_t read(uint16_t address) { return machine.readMemory(lane, address); }
+    void write(uint16_t address, uint8_t value) { machine.writeMemory(lane, address, value); }
+
+    uint8_t delayTimer() { return machine.delay_timer[lane]; }
+    void setDelayTimer(uint8_t value) { machine.delay_timer[lane] = value; }
+    void setSoundTimer(uint8_t value) { machine.sound_timer[lane] = value; }
+
+    const uint8_t* keypad() { return &machine.keypad[lane * Chip8Specs::KeysCount]; }
+    uint8_t& keyWaitPressed() { return machine.key_wait_pressed[lane]; }
+    uint8_t& keyWaitKey() { return machine.key_wait_key[lane]; }
+    uint8_t randomByte() { return machine.random_devices[lane].get(); }
+
+    uint64_t* video() { return machine.getVideo(lane); }
+    // Lanes are not presented
+    void markVideoDirty(int, int) {}
+
+    // Only the CHIP-8 model, no F000 nnnn
+    void skipNext() { machine.pc[lane] += 2; }
+    void halt() { machine.halt(lane); }
+};
+
+template <QuirkProfile Profile>
+void VectorMachine::executeLane(size_t lane, uint16_t opcode)
+{
+    uint8_t x { static_cast<uint8_t>((opcode & MASK_OPC_VX) >> 8u) };
+    uint8_t y { static_cast<uint8_t>((opcode & MASK_OPC_VY) >> 4u) };
+    uint8_t byte { static_cast<uint8_t>(opcode & MASK_OPC_BYTE) };
+    uint8_t nibble { static_cast<uint8_t>(opcode & MASK_OPC_NIBBLE) };
+    uint16_t address { static_cast<uint16_t>(opcode & MASK_OPC_ADDR) };
+
+    LaneAccess machine {*this, lane};
+
+    switch ((opcode & 0xF000u) >> 12u)
+    {
+    case 0x0:
+        if (byte == 0xE0) std::memset(getVideo(lane), 0, Chip8Specs::ScreenHeight * sizeof(uint64_t));
+        else if (byte == 0xEE) Instructions::opc_00EE(machine);
+        break;
+    case 0x1: Instructions::opc_1nnn(machine, address); break;
+    case 0x2: Instructions::opc_2nnn(machine, address); break;
+    case 0x3: Instructions::opc_3xkk(machine, x, byte); break;
+    case 0x4: Instructions::opc_4xkk(machine, x, byte); break;
+    case 0x5: Instructions::opc_5xy0(machine, x, y); break;
+    case 0x6: Instructions::opc_6xkk(machine, x, byte); break;
+    case 0x7: Instructions::opc_7xkk(machine, x, byte); break;
+    case 0x8:
+        switch (nibble)
+        {
+        case 0x0: Instructions::opc_8xy0(machine, x, y); break;
+        case 0x1: Instructions::opc_8xy1<Profile>(machine, x, y); break;
+        case 0x2: Instructions::opc_8xy2<Profile>(machine, x, y); break;
+        case 0x3: Instructions::opc_8xy3<Profile>(machine, x, y); break;
+        case 0x4: Instructions::opc_8xy4(machine, x, y); break;
+        case 0x5: Instructions::opc_8xy5(machine, x, y); break;
+        case 0x6: Instructions::opc_8xy6<Profile>(machine, x, y); break;
+        case 0x7: Instructions::opc_8xy7(machine, x, y); break;
+        case 0xE: Instructions::opc_8xyE<Profile>(machine, x, y); break;
+        default: break;
+        }
+        break;
+    case 0x9: Instructions::opc_9xy0(machine, x, y); break;
+    case 0xA: Instructions::opc_Annn(machine, address); break;
+    case 0xB: Instructions::opc_Bnnn<Profile>(machine, x, address); break;
+    case 0xC: Instructions::opc_Cxkk(machine, x, byte); break;
+    case 0xD: Instructions::opc_Dxyn<Profile>(machine, x, y, nibble); break;
+    case 0xE:
+        if (byte == 0x9E) Instructions::opc_Ex9E(machine, x);
+        else if (byte == 0xA1) Instructions::opc_ExA1(machine, x);
+        break;
+    case 0xF:
+        switch (byte)
+        {
+        case 0x07: Instructions::opc_Fx07(machine, x); break;
+        case 0x0A: Instructions::opc_Fx0A(machine, x); break;
+        case 0x15: Instructions::opc_Fx15(machine, x); break;
+        case 0x18: Instructions::opc_Fx18(machine, x); break;
+        case 0x1E: Instructions::opc_Fx1E(machine, x); break;
+        case 0x29: Instructions::opc_Fx29(machine, x); break;
+        case 0x33: Instructions::opc_Fx33(machine, x); break;
+        case 0x55: Instructions::opc_Fx55<Profile>(machine, x); break;
+        case 0x65: Instructions::opc_Fx65<Profile>(machine, x); break;
+        default: break;
+        }
+        break;
+    }
+}
+
+// Runs the group lane by lane, for instructions without kernel
+void VectorMachine::executeGroupLanes(uint16_t opcode, uint16_t leader_pc)
+{
+    for (size_t lane {} ; lane < lane_count ; ++lane)
+    {
+        if (!group_mask8[lane]) continue;
+
+        pc[lane] = leader_pc + 2;
+        (this->*execute_lane)(lane, opcode);
+    }
+}
+
+size_t VectorMachine::countGroups()
+{
+    size_t groups {};
+    ++stamp;
+
+    for (size_t lane {} ; lane < lane_count ; ++lane)
+    {
+        if (!active[lane] || address_stamps[pc[lane]] == stamp) continue;
+
+        address_stamps[pc[lane]] = stamp;
+        ++groups;
+    }
+
+    return groups;
+}
+
+// One instruction on every running lane, lanes sharing an
+// address are executed together by the kernels
+void VectorMachine::StepMasked()
+{
+    std::copy(active.begin(), active.end(), pending.begin());
+
+    size_t leader { static_cast<size_t>(std::find(active.begin(), active.begin() + lane_count, 0xFFFFu) - active.begin()) };
+    size_t groups {};
+
+    while (leader < lane_count)
+    {
+        uint16_t leader_pc { pc[leader] };
+        uint16_t opcode { fetch(leader) };
+        size_t next_leader { kernels->selectGroup(views, leader_pc) };
+
+        // Code written by the program may differ between lanes,
+        // lanes holding another instruction wait for their own group
+        if (memory_written[leader_pc % Chip8Specs::ClassicMemorySize] || memory_written[(leader_pc + 1) % Chip8Specs::ClassicMemorySize])
+        {
+            for (size_t lane {leader + 1} ; lane < lane_count ; ++lane)
+            {
+                if (!group_mask8[lane] || fetch(lane) == opcode) continue;
+
+                group_mask8[lane] = 0;
+                group_mask16[lane] = 0;
+                pending[lane] = 0xFFFFu;
+                next_leader = std::min(next_leader, lane);
+            }
+        }
+
+        if (hasQuirkFreeKernel(opcode, quirkFlagsOf(quirks)) && kernels->executeGroup(views, opcode, leader_pc))
+        {
+            // Jumps onto themselves halt the whole group
+            if ((opcode & 0xF000u) == 0x1000u && (opcode & MASK_OPC_ADDR) == leader_pc)
+            {
+                for (size_t lane {} ; lane < lane_count ; ++lane)
+                    if (group_mask8[lane]) halt(lane);
+            }
+        }
+        else executeGroupLanes(opcode, leader_pc);
+
+        leader = next_leader;
+        ++groups;
+    }
+
+    if (groups > max_groups) diverged = true;
+}
+
+void VectorMachine::StepLanes()
+{
+    for (size_t lane {} ; lane < lane_count ; ++lane)
+    {
+        if (!active[lane]) continue;
+
+        uint16_t opcode { fetch(lane) };
+        pc[lane] += 2;
+        (this->*execute_lane)(lane, opcode);
+    }
+
+    // Lanes often meet again, for instance in the main loop
+    if (kernels && countGroups() <= max_groups) diverged = false;
+}
+
+uint32_t VectorMachine::Run(uint32_t max_steps)
+{
+    uint32_t steps {};
+
+    for ( ; steps < max_steps && running_lanes > 0 ; ++steps)
+    {
+        if (kernels && !diverged) StepMasked();
+        else StepLanes();
+    }
+
+    return steps;
+}
+
+void VectorMachine::TickTimers()
+{
+    if (kernels)
+    {
+        kernels->tickTimers(views);
+        return;
+    }
+
+    for (size_t lane {} ; lane < padded_lanes ; ++lane)
+    {
+        if (delay_timer[lane] > 0) --delay_timer[lane];
+        if (sound_timer[lane] > 0) --sound_timer[lane];
+    }
+}
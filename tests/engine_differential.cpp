@@ -0,0 +1,129 @@
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "cpu.hpp"
+#include "generated_rom.hpp"
+#include "machine_model.hpp"
+#include "random.hpp"
+
+/*
+    Differential test of the execution engines: generated ROMs
+    run on the interpreter, the threaded engine and the
+    recompiler, the save states have to be byte-identical after
+    every frame. Engines missing from the build are skipped
+*/
+
+namespace
+{
+    constexpr int RomCount {48};
+    constexpr size_t RomSize {1024};
+    constexpr int FrameCount {100};
+    constexpr uint32_t InstructionsPerFrame {200};
+
+    struct EngineRun
+    {
+        CpuEngine engine {};
+        const char* name {};
+    };
+
+    constexpr EngineRun Engines[] {
+        {CpuEngine::Interpreter, "interpreter"},
+        {CpuEngine::Threaded,    "threaded"},
+        {CpuEngine::Recompiler,  "recompiler"},
+    };
+
+    std::unique_ptr<Chip8> makeMachine(MachineModel model, const std::vector<uint8_t>& rom, uint64_t seed)
+    {
+        auto chip8 { std::make_unique<Chip8>() };
+        chip8->setModel(model);
+        chip8->setSeed(seed);
+        chip8->loadRom(rom.data(), rom.size());
+        return chip8;
+    }
+
+    // Returns false and reports the first difference
+    bool compareStates(const std::vector<uint8_t>& expected, const std::vector<uint8_t>& actual,
+                       const std::string& run, int frame)
+    {
+        if (expected == actual) return true;
+
+        size_t offset {};
+        while (offset < expected.size() && offset < actual.size() && expected[offset] == actual[offset])
+            ++offset;
+
+        std::cerr << run << ": save states differ after frame " << frame
+                  << " at offset " << offset << " (sizes " << expected.size()
+                  << " and " << actual.size() << ")\n";
+        return false;
+    }
+}
+
+int main()
+{
+    int failures {};
+    int compared {};
+
+    for (MachineModel model : {MachineModel::Chip8, MachineModel::Schip, MachineModel::XoChip})
+    {
+        for (int index {} ; index < RomCount ; ++index)
+        {
+            uint64_t seed { static_cast<uint64_t>(index) };
+            std::vector<uint8_t> rom { generateRom(seed, RomSize) };
+
+            std::vector<std::unique_ptr<Chip8>> machines {};
+            std::vector<const char*> names {};
+
+            for (const EngineRun& run : Engines)
+            {
+                auto chip8 { makeMachine(model, rom, seed) };
+                if (!chip8->getCpu()->setEngine(run.engine)) continue;
+
+                machines.push_back(std::move(chip8));
+                names.push_back(run.name);
+            }
+
+            std::vector<uint8_t> expected {};
+            std::vector<uint8_t> actual {};
+
+            for (int frame {} ; frame < FrameCount ; ++frame)
+            {
+                // The same keys on every machine, changing now and then
+                RandomGenerator keys {seed * FrameCount + static_cast<uint64_t>(frame / 8)};
+                uint8_t key { static_cast<uint8_t>(keys.get() % Chip8Specs::KeysCount) };
+                bool pressed { keys.get() < 128 };
+
+                for (auto& chip8 : machines)
+                {
+                    chip8->setKeypad(key, pressed);
+                    chip8->Run(InstructionsPerFrame);
+                    chip8->TickTimers();
+                }
+
+                machines[0]->saveState(expected);
+
+                bool same {true};
+                for (size_t i {1} ; i < machines.size() ; ++i)
+                {
+                    machines[i]->saveState(actual);
+                    std::string run { std::string(machineModelName(model)) + " ROM " + std::to_string(index)
+                                      + ", " + names[i] + " against " + names[0] };
+                    same = compareStates(expected, actual, run, frame) && same;
+                }
+
+                ++compared;
+                if (!same)
+                {
+                    ++failures;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::cerr << compared << " frames compared, " << failures << " ROMs differ\n";
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,44 @@
+#ifndef CHIP8_TESTS_GENERATED_ROM_HPP
+#define CHIP8_TESTS_GENERATED_ROM_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "constants.hpp"
+#include "random.hpp"
+
+// === Header only function ===
+/*
+    ROMs for the differential tests: random bytes, with a share
+    of instructions kept inside the program (jumps, calls and
+    index loads to its own addresses) so that it loops, calls
+    and modifies itself instead of running off into empty memory
+*/
+
+inline std::vector<uint8_t> generateRom(uint64_t seed, size_t size)
+{
+    static constexpr uint8_t AddressKinds[] {0x1, 0x2, 0xA};
+
+    RandomGenerator random {seed};
+    std::vector<uint8_t> rom(size);
+
+    for (size_t i {} ; i + 1 < size ; i += 2)
+    {
+        rom[i] = random.get();
+        rom[i + 1] = random.get();
+
+        if (random.get() < 96)
+        {
+            uint16_t word { random.get() };
+            word = static_cast<uint16_t>((word << 8u) | random.get());
+
+            uint16_t target { static_cast<uint16_t>(Chip8Specs::ProgramStartAddress + word % (size / 2) * 2) };
+            rom[i] = static_cast<uint8_t>((AddressKinds[random.get() % 3] << 4u) | (target >> 8u));
+            rom[i + 1] = static_cast<uint8_t>(target & 0xFFu);
+        }
+    }
+
+    return rom;
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chip8.hpp"
+#include "cpu.hpp"
+#include "generated_rom.hpp"
+#include "vector_machine.hpp"
+
+/*
+    Differential test of the vector machine: every lane runs
+    next to a Chip8 instance with the same seed and the same
+    keys, on generated ROMs, with and without the SIMD kernels.
+    Lanes get different inputs so that they diverge, and have
+    to match their Chip8 after every frame
+*/
+
+namespace
+{
+    constexpr int RomCount {12};
+    constexpr size_t RomSize {1024};
+    constexpr size_t LaneCount {40};
+    constexpr int FrameCount {50};
+    constexpr uint32_t InstructionsPerFrame {100};
+
+    constexpr QuirkProfile Profiles[] {QuirkProfile::Vip, QuirkProfile::Chip48, QuirkProfile::Schip, QuirkProfile::XoChip};
+
+    uint64_t laneSeed(uint64_t rom_seed, size_t lane) { return rom_seed * LaneCount + lane; }
+
+    // Returns the first field that differs, empty when the lane matches
+    std::string compareLane(VectorMachine& vector, size_t lane, Chip8& chip8, bool with_memory)
+    {
+        Cpu* cpu { chip8.getCpu() };
+
+        if (vector.isHalted(lane) != cpu->isHalted()) return "halted";
+        if (vector.getPC(lane) != cpu->getPC()) return "pc";
+        if (vector.getSP(lane) != cpu->getSP()) return "sp";
+        if (vector.getIndexRegister(lane) != chip8.getIndexRegister()) return "index register";
+        if (vector.getDelayTimer(lane) != chip8.getDelayTimer()) return "delay timer";
+        if (vector.getSoundTimer(lane) != chip8.getSoundTimer()) return "sound timer";
+
+        for (uint8_t i {} ; i < Chip8Specs::RegisterCount ; ++i)
+            if (vector.getRegister(lane, i) != cpu->getRegister(i)) return "V" + std::to_string(i);
+
+        for (int y {} ; y < Chip8Specs::ScreenHeight ; ++y)
+            if (vector.getVideo(lane)[y] != chip8.getVideo()[y]) return "screen row " + std::to_string(y);
+
+        if (with_memory)
+        {
+            for (int address {} ; address < Chip8Specs::ClassicMemorySize ; ++address)
+                if (vector.getMemoryAt(lane, address) != chip8.getMemoryAt(address))
+                    return "memory at " + std::to_string(address);
+        }
+
+        return {};
+    }
+
+    // Returns false and reports the first lane that differs
+    bool runRom(const std::vector<uint8_t>& rom, uint64_t seed, QuirkProfile profile, bool scalar)
+    {
+        VectorMachine vector {LaneCount};
+        vector.setScalar(scalar);
+        vector.setQuirks(profile);
+        vector.loadRom(rom.data(), rom.size());
+
+        std::vector<std::unique_ptr<Chip8>> machines {};
+
+        for (size_t lane {} ; lane < LaneCount ; ++lane)
+        {
+            auto chip8 { std::make_unique<Chip8>() };
+            chip8->setModel(MachineModel::Chip8);
+            chip8->getCpu()->setQuirks(profile);
+            chip8->setSeed(laneSeed(seed, lane));
+            chip8->loadRom(rom.data(), rom.size());
+
+            vector.setSeed(lane, laneSeed(seed, lane));
+            machines.push_back(std::move(chip8));
+        }
+
+        for (int frame {} ; frame < FrameCount ; ++frame)
+        {
+            for (size_t lane {} ; lane < LaneCount ; ++lane)
+            {
+                // A key of its own per lane, changing now and then
+                RandomGenerator keys {laneSeed(seed, lane) * FrameCount + static_cast<uint64_t>(frame / 4)};
+                uint8_t key { static_cast<uint8_t>(keys.get() % Chip8Specs::KeysCount) };
+                uint8_t pressed { static_cast<uint8_t>(keys.get() < 128 ? 1 : 0) };
+
+                vector.setKeypad(lane, key, pressed);
+                machines[lane]->setKeypad(key, pressed);
+            }
+
+            vector.Run(InstructionsPerFrame);
+            vector.TickTimers();
+
+            bool last_frame { frame == FrameCount - 1 };
+
+            for (size_t lane {} ; lane < LaneCount ; ++lane)
+            {
+                machines[lane]->Run(InstructionsPerFrame);
+                machines[lane]->TickTimers();
+
+                std::string field { compareLane(vector, lane, *machines[lane], last_frame) };
+                if (field.empty()) continue;
+
+                std::cerr << "ROM " << seed << ", " << quirkProfileName(profile)
+                          << (scalar ? ", scalar" : ", kernels") << ": lane " << lane
+                          << " differs from Chip8 after frame " << frame << " (" << field << ")\n";
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main()
+{
+    int failures {};
+    int runs {};
+
+    for (int index {} ; index < RomCount ; ++index)
+    {
+        uint64_t seed { static_cast<uint64_t>(index) };
+        std::vector<uint8_t> rom { generateRom(seed, RomSize) };
+
+        for (QuirkProfile profile : Profiles)
+        {
+            for (bool scalar : {false, true})
+            {
+                ++runs;
+                if (!runRom(rom, seed, profile, scalar)) ++failures;
+            }
+        }
+    }
+
+    std::cerr << runs << " runs of " << LaneCount << " lanes, " << failures << " differ\n";
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}